@@ -18,6 +18,7 @@
 #include <vector>
 
 #include "restclient-cpp/restclient.h"
+#include "restclient-cpp/helpers.h"
 #include "restclient-cpp/version.h"
 
 /**
@@ -175,6 +176,12 @@ class Connection {
     // set connection timeout to seconds
     void SetTimeout(int seconds);
 
+    // set CURLOPT_TIMEOUT_MS, used instead of SetTimeout when not 0
+    void SetTimeoutMs(int milliseconds);
+
+    // set CURLOPT_CONNECTTIMEOUT_MS (0: curl default)
+    void SetConnectTimeoutMs(int milliseconds);
+
     // set file progress callback
     void SetFileProgressCallback(curl_progress_callback progressFn);
 
@@ -205,6 +212,15 @@ class Connection {
     // set CURLOPT_SSLKEY. Default format is PEM
     void SetKeyPath(const std::string& keyPath);
 
+    // set CURLOPT_SSLCERT_BLOB, the certificate is kept in memory
+    void SetCertBlob(const std::string& certBlob);
+
+    // set CURLOPT_SSLKEY_BLOB, the key is kept in memory
+    void SetKeyBlob(const std::string& keyBlob);
+
+    // set CURLOPT_SSLKEYTYPE (e.g. "PEM" or "DER")
+    void SetKeyType(const std::string& keyType);
+
     // set CURLOPT_SSL_VERIFYPEER. Default is true.
     void SetVerifyPeer(bool verifyPeer);
 
@@ -223,10 +239,50 @@ class Connection {
     // set CURLOPT_WRITEFUNCTION
     void SetWriteFunction(WriteCallback write_callback);
 
+    // set CURLOPT_HTTP_VERSION (e.g. CURL_HTTP_VERSION_2TLS). Default is
+    // libcurl's own default
+    void SetHttpVersion(long httpVersion);
+
+    // set CURLOPT_PIPEWAIT, wait for a connection to multiplex on instead of
+    // opening a new one. Default is false.
+    void SetPipeWait(bool pipeWait);
+
+    // keep the connection level options on the curl handle between the
+    // requests, instead of setting them again after curl_easy_reset
+    void SetPersistentOptions(bool persistent);
+
+    // send the body of every verb from the caller's buffer (CURLOPT_POSTFIELDS
+    // with CURLOPT_CUSTOMREQUEST), instead of copying it through the read
+    // callback. Default is true.
+    void SetZeroCopyBody(bool zeroCopy);
+
+    // let curl send "Expect: 100-continue" for the larger bodies, which costs
+    // a round trip (or a 1 s wait). Default is false.
+    void SetExpectContinue(bool expectContinue);
+
+    // headers of the next request only, sent besides the connection's ones
+    void SetRequestHeaders(RestClient::HeaderFields headers);
+
+    // timeout of the next request only (e.g. the remaining time before a
+    // deadline), the connect timeout is capped to it as well. 0: none
+    void SetRequestTimeoutMs(int milliseconds);
+
+    // set CURLOPT_SHARE (the share object has to outlive the connection)
+    void SetShareHandle(CURLSH* shareHandle);
+
+    // set CURLOPT_RESOLVE, "host:port:address[,address...]" entries, the
+    // name lookup of these hosts is skipped. Same entries are not set again
+    void SetResolve(const std::vector<std::string>& entries);
+
     std::string GetUserAgent();
 
     RestClient::Connection::Info GetInfo();
 
+    // timings of the last request, without copying the whole Info
+    const RequestInfo& GetLastRequestInfo() const;
+    // number of requests completed on this connection
+    uint64_t GetRequestCount() const;
+
     // set headers
     void SetHeaders(RestClient::HeaderFields headers);
 
@@ -269,6 +325,15 @@ class Connection {
     RestClient::Response*
     get(const std::string& uri, RestClient::Response* response);
 
+    // Asynchronous usage: set up the handle, let the caller drive the
+    // transfer (e.g. with curl multi), then collect the results
+    CURL* PrepareRequest(const std::string& method,
+                         const std::string& uri,
+                         const char* data_ptr,
+                         const size_t data_size,
+                         RestClient::Response* response);
+    void CompleteRequest(CURLcode res, RestClient::Response* response);
+
     void SetLogger(const std::shared_ptr<Logger>& value);
 
  private:
@@ -277,6 +342,9 @@ class Connection {
     std::string baseUrl;
     RestClient::HeaderFields headerFields;
     int timeout;
+    int timeoutMs;
+    int connectTimeoutMs;
+    int requestTimeoutMs;
     bool followRedirects;
     int maxRedirects;
     bool noSignal;
@@ -289,16 +357,40 @@ class Connection {
     std::string customUserAgent;
     std::string caInfoFilePath;
     RequestInfo lastRequest;
+    uint64_t requestCount;
     std::string certPath;
     std::string certType;
     std::string keyPath;
     std::string keyPassword;
+    std::string certBlob;
+    std::string keyBlob;
+    std::string keyType;
     bool verifyPeer;
     bool verifyHost;
     std::string uriProxy;
     std::string unixSocketPath;
+    CURLSH* shareHandle;
+    std::vector<std::string> resolveEntries;
+    curl_slist* resolveList;
+    long httpVersion;
+    bool pipeWait;
     char curlErrorBuf[CURL_ERROR_SIZE];
     RestClient::WriteCallback writeCallback;
+    curl_slist* headerList;
+    curl_slist* staticHeaderList;
+    RestClient::HeaderFields requestHeaders;
+    bool persistentOptions;
+    bool optionsApplied;
+    bool zeroCopyBody;
+    bool expectContinue;
+    RestClient::Helpers::UploadObject uploadObject;
+    void setBodyFields(const std::string& method, const char* data_ptr,
+                       const size_t data_size);
+    bool hasHeader(const std::string& name) const;
+    void prepareCurlRequest(const std::string& uri, RestClient::Response* resp);
+    void applyConnectionOptions();
+    void freeRequestHeaderList();
+    void freeHeaderLists();
     RestClient::Response*
     performCurlRequest(const std::string& uri, RestClient::Response* resp);
     RestClient::Response performCurlRequest(const std::string& uri);
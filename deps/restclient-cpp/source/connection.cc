@@ -11,8 +11,10 @@
 
 #include <curl/curl.h>
 
+#include <algorithm>
 #include <cstring>
 #include <string>
+#include <strings.h>
 #include <iostream>
 #include <map>
 #include <stdexcept>
@@ -29,13 +31,17 @@
  *
  */
 RestClient::Connection::Connection(const std::string& baseUrl)
-                               : headerFields(), lastRequest() {
+                               : headerFields(), lastRequest(),
+                                 requestCount(0) {
   this->curlHandle = curl_easy_init();
   if (!this->curlHandle) {
     throw std::runtime_error("Couldn't initialize curl handle");
   }
   this->baseUrl = baseUrl;
   this->timeout = 0;
+  this->timeoutMs = 0;
+  this->connectTimeoutMs = 0;
+  this->requestTimeoutMs = 0;
   this->followRedirects = false;
   this->maxRedirects = -1l;
   this->noSignal = false;
@@ -44,6 +50,18 @@ RestClient::Connection::Connection(const std::string& baseUrl)
   this->writeCallback = RestClient::Helpers::write_callback;
   this->verifyPeer = true;
   this->verifyHost = true;
+  this->headerList = NULL;
+  this->staticHeaderList = NULL;
+  this->persistentOptions = false;
+  this->optionsApplied = false;
+  this->zeroCopyBody = true;
+  this->expectContinue = false;
+  this->shareHandle = NULL;
+  this->resolveList = NULL;
+  this->httpVersion = CURL_HTTP_VERSION_NONE;
+  this->pipeWait = false;
+  this->uploadObject.data = NULL;
+  this->uploadObject.length = 0;
 }
 
 /**
@@ -62,6 +80,10 @@ void RestClient::Connection::Terminate() {
     curl_easy_cleanup(this->curlHandle);
   }
   this->curlHandle = NULL;
+  this->freeHeaderLists();
+  curl_slist_free_all(this->resolveList);
+  this->resolveList = NULL;
+  this->optionsApplied = false;
 }
 
 RestClient::Connection::~Connection() {
@@ -102,6 +124,28 @@ RestClient::Connection::GetInfo() {
   return ret;
 }
 
+/**
+ * @brief get the diagnostics of the last request only. Cheaper than
+ * GetInfo, meant to be called after every request (e.g. for metrics).
+ *
+ * @return RestClient::Connection::RequestInfo struct
+ */
+const RestClient::Connection::RequestInfo&
+RestClient::Connection::GetLastRequestInfo() const {
+  return this->lastRequest;
+}
+
+/**
+ * @brief get the number of requests completed on this connection, so a
+ * caller can tell whether the last request info is new
+ *
+ * @return number of completed requests
+ */
+uint64_t
+RestClient::Connection::GetRequestCount() const {
+  return this->requestCount;
+}
+
 /**
  * @brief append a header to the internal map
  *
@@ -112,6 +156,7 @@ RestClient::Connection::GetInfo() {
 void
 RestClient::Connection::AppendHeader(const std::string& key,
                                      const std::string& value) {
+  this->optionsApplied = false;
   this->headerFields.insert({key, value});
 }
 
@@ -124,6 +169,7 @@ RestClient::Connection::AppendHeader(const std::string& key,
  */
 void
 RestClient::Connection::SetHeaders(RestClient::HeaderFields headers) {
+  this->optionsApplied = false;
 #if __cplusplus >= 201103L
   this->headerFields = std::move(headers);
 #else
@@ -149,6 +195,7 @@ RestClient::Connection::GetHeaders() {
  */
 void
 RestClient::Connection::FollowRedirects(bool follow, int maxRedirects) {
+  this->optionsApplied = false;
   this->followRedirects = follow;
   this->maxRedirects = maxRedirects;
 }
@@ -162,6 +209,7 @@ RestClient::Connection::FollowRedirects(bool follow, int maxRedirects) {
  */
 void
 RestClient::Connection::SetUserAgent(const std::string& userAgent) {
+  this->optionsApplied = false;
   this->customUserAgent = userAgent;
 }
 
@@ -174,6 +222,7 @@ RestClient::Connection::SetUserAgent(const std::string& userAgent) {
  */
 void
 RestClient::Connection::SetCAInfoFilePath(const std::string& caInfoFilePath) {
+  this->optionsApplied = false;
   this->caInfoFilePath = caInfoFilePath;
 }
 
@@ -206,9 +255,34 @@ RestClient::Connection::GetUserAgent() {
  */
 void
 RestClient::Connection::SetTimeout(int seconds) {
+  this->optionsApplied = false;
   this->timeout = seconds;
 }
 
+/**
+ * @brief set timeout for connection in milliseconds, instead of seconds
+ *
+ * @param milliseconds - timeout in milliseconds, 0 to use SetTimeout
+ *
+ */
+void
+RestClient::Connection::SetTimeoutMs(int milliseconds) {
+  this->optionsApplied = false;
+  this->timeoutMs = milliseconds;
+}
+
+/**
+ * @brief set timeout of the connect phase (including the TLS handshake)
+ *
+ * @param milliseconds - timeout in milliseconds, 0 for the curl default
+ *
+ */
+void
+RestClient::Connection::SetConnectTimeoutMs(int milliseconds) {
+  this->optionsApplied = false;
+  this->connectTimeoutMs = milliseconds;
+}
+
 /**
  * @brief switch off curl signals for connection (see CURLOPT_NONSIGNAL). By
  * default signals are used, except when timeout is given.
@@ -218,6 +292,7 @@ RestClient::Connection::SetTimeout(int seconds) {
  */
 void
 RestClient::Connection::SetNoSignal(bool no) {
+  this->optionsApplied = false;
   this->noSignal = no;
 }
 
@@ -230,6 +305,7 @@ RestClient::Connection::SetNoSignal(bool no) {
 void
 RestClient::Connection::SetFileProgressCallback(curl_progress_callback
                                                 progressFn) {
+  this->optionsApplied = false;
   this->progressFn = progressFn;
 }
 
@@ -241,6 +317,7 @@ RestClient::Connection::SetFileProgressCallback(curl_progress_callback
  */
 void
 RestClient::Connection::SetFileProgressCallbackData(void* data) {
+  this->optionsApplied = false;
   this->progressFnData = data;
 }
 
@@ -254,6 +331,7 @@ RestClient::Connection::SetFileProgressCallbackData(void* data) {
 void
 RestClient::Connection::SetBasicAuth(const std::string& username,
                                      const std::string& password) {
+  this->optionsApplied = false;
   this->basicAuth.username = username;
   this->basicAuth.password = password;
 }
@@ -266,6 +344,7 @@ RestClient::Connection::SetBasicAuth(const std::string& username,
  */
 void
 RestClient::Connection::SetCertPath(const std::string& cert) {
+  this->optionsApplied = false;
   this->certPath = cert;
 }
 
@@ -277,6 +356,7 @@ RestClient::Connection::SetCertPath(const std::string& cert) {
  */
 void
 RestClient::Connection::SetCertType(const std::string& certType) {
+  this->optionsApplied = false;
   this->certType = certType;
 }
 
@@ -288,9 +368,48 @@ RestClient::Connection::SetCertType(const std::string& certType) {
  */
 void
 RestClient::Connection::SetKeyPath(const std::string& keyPath) {
+  this->optionsApplied = false;
   this->keyPath = keyPath;
 }
 
+/**
+ * @brief set client certificate from memory, instead of a file. Requires
+ * libcurl 7.71.0 or later.
+ *
+ * @param certificate (chain) content, format according to SetCertType
+ *
+ */
+void
+RestClient::Connection::SetCertBlob(const std::string& certBlob) {
+  this->optionsApplied = false;
+  this->certBlob = certBlob;
+}
+
+/**
+ * @brief set private key from memory, instead of a file. Requires libcurl
+ * 7.71.0 or later.
+ *
+ * @param key content, format according to SetKeyType
+ *
+ */
+void
+RestClient::Connection::SetKeyBlob(const std::string& keyBlob) {
+  this->optionsApplied = false;
+  this->keyBlob = keyBlob;
+}
+
+/**
+ * @brief set key type
+ *
+ * @param key type (e.g. "PEM" or "DER")
+ *
+ */
+void
+RestClient::Connection::SetKeyType(const std::string& keyType) {
+  this->optionsApplied = false;
+  this->keyType = keyType;
+}
+
 /**
  * @brief set key password
  *
@@ -299,6 +418,7 @@ RestClient::Connection::SetKeyPath(const std::string& keyPath) {
  */
 void
 RestClient::Connection::SetKeyPassword(const std::string& keyPassword) {
+  this->optionsApplied = false;
   this->keyPassword = keyPassword;
 }
 
@@ -310,6 +430,7 @@ RestClient::Connection::SetKeyPassword(const std::string& keyPassword) {
  */
 void
 RestClient::Connection::SetVerifyPeer(bool verifyPeer) {
+  this->optionsApplied = false;
   this->verifyPeer = verifyPeer;
 }
 
@@ -321,6 +442,7 @@ RestClient::Connection::SetVerifyPeer(bool verifyPeer) {
  */
 void
 RestClient::Connection::SetVerifyHost(bool verifyHost) {
+  this->optionsApplied = false;
   this->verifyHost = verifyHost;
 }
 
@@ -332,6 +454,7 @@ RestClient::Connection::SetVerifyHost(bool verifyHost) {
  */
 void
 RestClient::Connection::SetProxy(const std::string& uriProxy) {
+  this->optionsApplied = false;
   std::string uriProxyUpper = uriProxy;
   // check if the provided address is prefixed with "http"
   std::transform(uriProxyUpper.begin(), uriProxyUpper.end(),
@@ -353,6 +476,7 @@ RestClient::Connection::SetProxy(const std::string& uriProxy) {
  */
 void
 RestClient::Connection::SetUnixSocketPath(const std::string& unixSocketPath) {
+  this->optionsApplied = false;
   this->unixSocketPath = unixSocketPath;
 }
 
@@ -370,6 +494,137 @@ writeCallback) {
   this->writeCallback = writeCallback;
 }
 
+/**
+ * @brief set the HTTP protocol version. With CURL_HTTP_VERSION_2TLS HTTP/2 is
+ * negotiated via ALPN on https, falling back to HTTP/1.1 if the server does
+ * not support it.
+ *
+ * @param httpVersion - one of the CURL_HTTP_VERSION_* values
+ *
+ */
+void
+RestClient::Connection::SetHttpVersion(long httpVersion) {
+  this->optionsApplied = false;
+  this->httpVersion = httpVersion;
+}
+
+/**
+ * @brief prefer waiting for an existing connection to multiplex on, over
+ * opening a new one. Only has an effect when the handle is driven by a curl
+ * multi handle with multiplexing enabled.
+ *
+ * @param pipeWait - true to wait
+ *
+ */
+void
+RestClient::Connection::SetPipeWait(bool pipeWait) {
+  this->optionsApplied = false;
+  this->pipeWait = pipeWait;
+}
+
+/**
+ * @brief send the request body directly from the caller's buffer for every
+ * verb (CURLOPT_POSTFIELDS, the verb set by CURLOPT_CUSTOMREQUEST), instead
+ * of copying it into curl's upload buffer through the read callback. The
+ * buffer has to be kept alive until the request completes.
+ *
+ * @param zeroCopy - false to upload PUT and PATCH bodies through the read
+ * callback
+ *
+ */
+void
+RestClient::Connection::SetZeroCopyBody(bool zeroCopy) {
+  this->zeroCopyBody = zeroCopy;
+}
+
+/**
+ * @brief let curl ask for "100 Continue" before sending a larger body. Off
+ * by default, as it costs a round trip per request, or a 1 s wait if the
+ * server does not answer it. An Expect header set by the caller is kept.
+ *
+ * @param expectContinue - true to let curl send the Expect header
+ *
+ */
+void
+RestClient::Connection::SetExpectContinue(bool expectContinue) {
+  this->expectContinue = expectContinue;
+}
+
+/**
+ * @brief keep the connection level options (CA, verification, timeouts,
+ * proxy, user agent, static headers, ...) on the curl handle between the
+ * requests. They are set once, and again only after one of them changes.
+ * After a request only the verb specific options are reset, instead of
+ * curl_easy_reset, so a request costs only the URL, the request headers and
+ * the body.
+ *
+ * @param persistent - true to keep the options
+ *
+ */
+void
+RestClient::Connection::SetPersistentOptions(bool persistent) {
+  this->persistentOptions = persistent;
+  this->optionsApplied = false;
+}
+
+/**
+ * @brief set headers for the next request only. They are sent in addition
+ * to the connection's headers (see SetHeaders/AppendHeader), and forgotten
+ * once the request is completed.
+ *
+ * @param headers to set
+ */
+void
+RestClient::Connection::SetRequestHeaders(RestClient::HeaderFields headers) {
+  this->requestHeaders = std::move(headers);
+}
+
+/**
+ * @brief set the timeout of the next request only, e.g. the time remaining
+ * before the deadline of the caller. The connect timeout is capped to it as
+ * well. The connection's timeouts are set back once the request is
+ * completed.
+ *
+ * @param milliseconds - timeout of the request, 0 for none
+ */
+void
+RestClient::Connection::SetRequestTimeoutMs(int milliseconds) {
+  this->requestTimeoutMs = milliseconds;
+}
+
+/**
+ * @brief set the curl share object used by the connection. Sharing DNS
+ * cache, TLS sessions and connections lets other handles (e.g. on other
+ * threads) to profit from the already done lookups and handshakes.
+ * See https://curl.se/libcurl/c/CURLOPT_SHARE.html
+ *
+ * @param shareHandle - share object, NULL to stop sharing
+ *
+ */
+void
+RestClient::Connection::SetShareHandle(CURLSH* shareHandle) {
+  this->optionsApplied = false;
+  this->shareHandle = shareHandle;
+}
+
+/**
+ * @brief set the addresses of hosts, so curl does not look them up. The
+ * entries get into the DNS cache (the shared one, if any) when the next
+ * transfer starts, replacing the earlier addresses of the same host and
+ * port. See https://curl.se/libcurl/c/CURLOPT_RESOLVE.html
+ *
+ * @param entries - "host:port:address[,address...]" strings
+ *
+ */
+void
+RestClient::Connection::SetResolve(const std::vector<std::string>& entries) {
+  if (entries == this->resolveEntries) {
+    return;
+  }
+  this->optionsApplied = false;
+  this->resolveEntries = entries;
+}
+
 /**
  * @brief helper function to get called from the actual request methods to
  * prepare the curlHandle for transfer with generic options, perform the
@@ -406,15 +661,52 @@ RestClient::Connection::performCurlRequest(const std::string& uri) {
 RestClient::Response*
 RestClient::Connection::performCurlRequest(const std::string& uri,
                                            RestClient::Response* ret) {
+  CURLcode res = CURLE_OK;
+
+  prepareCurlRequest(uri, ret);
+  res = curl_easy_perform(getCurlHandle());
+  CompleteRequest(res, ret);
+
+  return ret;
+}
+
+/**
+ * @brief set up the curlHandle with the generic options for the transfer.
+ * The verb specific options are expected to be set already.
+ *
+ * @param uri URI to query
+ * @param ret Reference to the response struct that should be filled
+ */
+void
+RestClient::Connection::prepareCurlRequest(const std::string& uri,
+                                           RestClient::Response* ret) {
   // init return type
   ret->body.clear();
   ret->code = 0;
   ret->headers.clear();
 
   std::string url = std::string(this->baseUrl + uri);
-  std::string headerString;
-  CURLcode res = CURLE_OK;
-  curl_slist* headerList = NULL;
+
+  // free header list of a not completed request
+  this->freeRequestHeaderList();
+  this->curlErrorBuf[0] = '\0';
+
+  if (!this->persistentOptions || !this->optionsApplied) {
+    this->applyConnectionOptions();
+    this->optionsApplied = this->persistentOptions;
+  }
+
+  /** timeout of this request only */
+  if (this->requestTimeoutMs > 0) {
+    int connectMs = this->connectTimeoutMs > 0 ?
+        std::min(this->connectTimeoutMs, this->requestTimeoutMs) :
+        this->requestTimeoutMs;
+    curl_easy_setopt(getCurlHandle(), CURLOPT_TIMEOUT_MS,
+                     static_cast<int64_t>(this->requestTimeoutMs));
+    curl_easy_setopt(getCurlHandle(), CURLOPT_CONNECTTIMEOUT_MS,
+                     static_cast<int64_t>(connectMs));
+    curl_easy_setopt(getCurlHandle(), CURLOPT_NOSIGNAL, 1);
+  }
 
   /** set query URL */
   curl_easy_setopt(getCurlHandle(), CURLOPT_URL, url.c_str());
@@ -428,16 +720,52 @@ RestClient::Connection::performCurlRequest(const std::string& uri,
                    Helpers::header_callback);
   /** callback object for headers */
   curl_easy_setopt(getCurlHandle(), CURLOPT_HEADERDATA, ret);
-  /** set http headers */
+
+  /** set http headers, the request ones chained before the static ones */
+  curl_slist* tail = NULL;
+  for (HeaderFields::const_iterator it = this->requestHeaders.begin();
+      it != this->requestHeaders.end(); ++it) {
+    std::string headerString = it->first;
+    headerString += ": ";
+    headerString += it->second;
+    this->headerList = curl_slist_append(this->headerList,
+                                         headerString.c_str());
+    tail = tail ? tail->next : this->headerList;
+  }
+  /** an empty header removes the one curl would add */
+  if (!this->expectContinue && !this->hasHeader("Expect")) {
+    this->headerList = curl_slist_append(this->headerList, "Expect:");
+    tail = tail ? tail->next : this->headerList;
+  }
+  if (tail) {
+    tail->next = this->staticHeaderList;
+    curl_easy_setopt(getCurlHandle(), CURLOPT_HTTPHEADER, this->headerList);
+  } else {
+    curl_easy_setopt(getCurlHandle(), CURLOPT_HTTPHEADER,
+                     this->staticHeaderList);
+  }
+}
+
+/**
+ * @brief set the connection level options on the curlHandle. Without
+ * persistent options this runs for every request, as curl_easy_reset clears
+ * the handle after each.
+ */
+void
+RestClient::Connection::applyConnectionOptions() {
+  std::string headerString;
+
+  /** static http headers */
+  curl_slist_free_all(this->staticHeaderList);
+  this->staticHeaderList = NULL;
   for (HeaderFields::const_iterator it = this->headerFields.begin();
       it != this->headerFields.end(); ++it) {
     headerString = it->first;
     headerString += ": ";
     headerString += it->second;
-    headerList = curl_slist_append(headerList, headerString.c_str());
+    this->staticHeaderList = curl_slist_append(this->staticHeaderList,
+                                               headerString.c_str());
   }
-  curl_easy_setopt(getCurlHandle(), CURLOPT_HTTPHEADER,
-      headerList);
 
   // set basic auth if configured
   if (this->basicAuth.username.length() > 0) {
@@ -455,11 +783,20 @@ RestClient::Connection::performCurlRequest(const std::string& uri,
                    this->GetUserAgent().c_str());
 
   // set timeout
-  if (this->timeout) {
+  if (this->timeoutMs) {
+    curl_easy_setopt(getCurlHandle(), CURLOPT_TIMEOUT_MS,
+                     static_cast<int64_t>(this->timeoutMs));
+    // dont want to get a sig alarm on timeout
+    curl_easy_setopt(getCurlHandle(), CURLOPT_NOSIGNAL, 1);
+  } else if (this->timeout) {
     curl_easy_setopt(getCurlHandle(), CURLOPT_TIMEOUT, this->timeout);
     // dont want to get a sig alarm on timeout
     curl_easy_setopt(getCurlHandle(), CURLOPT_NOSIGNAL, 1);
   }
+  if (this->connectTimeoutMs) {
+    curl_easy_setopt(getCurlHandle(), CURLOPT_CONNECTTIMEOUT_MS,
+                     static_cast<int64_t>(this->connectTimeoutMs));
+  }
   // set follow redirect
   if (this->followRedirects == true) {
     curl_easy_setopt(getCurlHandle(), CURLOPT_FOLLOWLOCATION, 1L);
@@ -511,12 +848,35 @@ RestClient::Connection::performCurlRequest(const std::string& uri,
     curl_easy_setopt(getCurlHandle(), CURLOPT_SSLKEY,
                      this->keyPath.c_str());
   }
+  // set key type
+  if (!this->keyType.empty()) {
+    curl_easy_setopt(getCurlHandle(), CURLOPT_SSLKEYTYPE,
+                     this->keyType.c_str());
+  }
   // set key password
   if (!this->keyPassword.empty()) {
     curl_easy_setopt(getCurlHandle(), CURLOPT_KEYPASSWD,
                      this->keyPassword.c_str());
   }
 
+#if LIBCURL_VERSION_NUM >= 0x074700
+  // set in-memory cert and key, the blobs live as long as the connection
+  if (!this->certBlob.empty()) {
+    struct curl_blob blob;
+    blob.data = const_cast<char*>(this->certBlob.data());
+    blob.len = this->certBlob.size();
+    blob.flags = CURL_BLOB_NOCOPY;
+    curl_easy_setopt(getCurlHandle(), CURLOPT_SSLCERT_BLOB, &blob);
+  }
+  if (!this->keyBlob.empty()) {
+    struct curl_blob blob;
+    blob.data = const_cast<char*>(this->keyBlob.data());
+    blob.len = this->keyBlob.size();
+    blob.flags = CURL_BLOB_NOCOPY;
+    curl_easy_setopt(getCurlHandle(), CURLOPT_SSLKEY_BLOB, &blob);
+  }
+#endif
+
   // set peer verification
   curl_easy_setopt(getCurlHandle(), CURLOPT_SSL_VERIFYPEER,
                    this->verifyPeer ? 1L : 0L);
@@ -539,7 +899,96 @@ RestClient::Connection::performCurlRequest(const std::string& uri,
                      this->unixSocketPath.c_str());
   }
 
-  res = curl_easy_perform(getCurlHandle());
+  // set HTTP version
+  if (this->httpVersion != CURL_HTTP_VERSION_NONE) {
+    curl_easy_setopt(getCurlHandle(), CURLOPT_HTTP_VERSION,
+                     this->httpVersion);
+  }
+
+  // wait for multiplexing
+  if (this->pipeWait) {
+    curl_easy_setopt(getCurlHandle(), CURLOPT_PIPEWAIT, 1L);
+  }
+
+  // set share object (curl_easy_reset clears it)
+  if (this->shareHandle) {
+    curl_easy_setopt(getCurlHandle(), CURLOPT_SHARE, this->shareHandle);
+  }
+
+  // pinned addresses, the list is read when the transfer starts
+  curl_slist_free_all(this->resolveList);
+  this->resolveList = NULL;
+  for (std::vector<std::string>::const_iterator it =
+      this->resolveEntries.begin(); it != this->resolveEntries.end(); ++it) {
+    this->resolveList = curl_slist_append(this->resolveList, it->c_str());
+  }
+  if (this->resolveList) {
+    curl_easy_setopt(getCurlHandle(), CURLOPT_RESOLVE, this->resolveList);
+  }
+}
+
+/**
+ * @brief set up the curlHandle for a request of the given verb without
+ * performing it. Meant for driving the transfer from outside, e.g. by adding
+ * the returned handle to a curl multi handle. Once the transfer is done,
+ * CompleteRequest has to be called with the result code. The data pointed by
+ * data_ptr and the response struct have to be kept alive until then.
+ *
+ * @param method HTTP verb (GET, POST, PUT, PATCH, DELETE, HEAD, OPTIONS)
+ * @param uri URI to query
+ * @param data_ptr request body pointer (ignored for GET, HEAD and OPTIONS,
+ * and for the other verbs without a body, when the body is copied)
+ * @param data_size request body size
+ * @param ret Reference to the response struct that should be filled
+ *
+ * @return the prepared curl handle
+ */
+CURL*
+RestClient::Connection::PrepareRequest(const std::string& method,
+                                       const std::string& uri,
+                                       const char* data_ptr,
+                                       const size_t data_size,
+                                       RestClient::Response* ret) {
+  if (method == "HEAD" || method == "OPTIONS") {
+    curl_easy_setopt(getCurlHandle(), CURLOPT_CUSTOMREQUEST, method.c_str());
+    curl_easy_setopt(getCurlHandle(), CURLOPT_NOBODY, 1L);
+  } else if (method == "POST" || (this->zeroCopyBody && method != "GET" &&
+             (data_size > 0 || method == "PUT" || method == "PATCH"))) {
+    this->setBodyFields(method, data_ptr, data_size);
+  } else if (method == "PUT" || method == "PATCH") {
+    /** the upload object has to outlive this call */
+    this->uploadObject.data = data_ptr;
+    this->uploadObject.length = data_size;
+
+    if (method == "PATCH") {
+      curl_easy_setopt(getCurlHandle(), CURLOPT_CUSTOMREQUEST, "PATCH");
+    }
+    curl_easy_setopt(getCurlHandle(), CURLOPT_UPLOAD, 1L);
+    curl_easy_setopt(getCurlHandle(), CURLOPT_READFUNCTION,
+                     RestClient::Helpers::read_callback);
+    curl_easy_setopt(getCurlHandle(), CURLOPT_READDATA, &this->uploadObject);
+    curl_easy_setopt(getCurlHandle(), CURLOPT_INFILESIZE,
+                     static_cast<int64_t>(data_size));
+  } else if (method != "GET") {
+    curl_easy_setopt(getCurlHandle(), CURLOPT_CUSTOMREQUEST, method.c_str());
+  }
+
+  prepareCurlRequest(uri, ret);
+
+  return getCurlHandle();
+}
+
+/**
+ * @brief collect the result of a transfer set up with PrepareRequest (or
+ * by the synchronous verb methods), record some stats from the request and
+ * then reset the handle with curl_easy_reset to its default state.
+ *
+ * @param res result code of the transfer
+ * @param ret Reference to the response struct that should be filled
+ */
+void
+RestClient::Connection::CompleteRequest(CURLcode res,
+                                        RestClient::Response* ret) {
   this->lastRequest.curlCode = res;
   if (res != CURLE_OK) {
     int retCode = res;
@@ -572,11 +1021,120 @@ RestClient::Connection::performCurlRequest(const std::string& uri,
                     &this->lastRequest.redirectTime);
   curl_easy_getinfo(getCurlHandle(), CURLINFO_REDIRECT_COUNT,
                     &this->lastRequest.redirectCount);
+  ++this->requestCount;
   // free header list
-  curl_slist_free_all(headerList);
-  // reset curl handle
-  curl_easy_reset(getCurlHandle());
-  return ret;
+  this->freeRequestHeaderList();
+  this->requestHeaders.clear();
+
+  if (this->persistentOptions && this->optionsApplied) {
+    // the connection's timeouts are back for the next request
+    if (this->requestTimeoutMs > 0) {
+      int timeoutMs = this->timeoutMs ? this->timeoutMs : this->timeout * 1000;
+      curl_easy_setopt(getCurlHandle(), CURLOPT_TIMEOUT_MS,
+                       static_cast<int64_t>(timeoutMs));
+      curl_easy_setopt(getCurlHandle(), CURLOPT_CONNECTTIMEOUT_MS,
+                       static_cast<int64_t>(this->connectTimeoutMs));
+    }
+    // only the verb specific options go, the rest stays for the next request
+    // (setting POSTFIELDS switches to POST, so HTTPGET has to come last)
+    curl_easy_setopt(getCurlHandle(), CURLOPT_CUSTOMREQUEST, NULL);
+    curl_easy_setopt(getCurlHandle(), CURLOPT_POSTFIELDS, NULL);
+    curl_easy_setopt(getCurlHandle(), CURLOPT_POSTFIELDSIZE, -1L);
+    curl_easy_setopt(getCurlHandle(), CURLOPT_INFILESIZE, -1L);
+    curl_easy_setopt(getCurlHandle(), CURLOPT_POSTREDIR, 0L);
+    curl_easy_setopt(getCurlHandle(), CURLOPT_UPLOAD, 0L);
+    curl_easy_setopt(getCurlHandle(), CURLOPT_NOBODY, 0L);
+    curl_easy_setopt(getCurlHandle(), CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(getCurlHandle(), CURLOPT_HTTPHEADER,
+                     this->staticHeaderList);
+  } else {
+    // reset curl handle
+    curl_easy_reset(getCurlHandle());
+    this->optionsApplied = false;
+  }
+  this->requestTimeoutMs = 0;
+}
+
+/**
+ * @brief free the header list of the request. The static headers chained
+ * to its end are kept.
+ */
+void
+RestClient::Connection::freeRequestHeaderList() {
+  curl_slist* it = this->headerList;
+  while (it && it->next && it->next != this->staticHeaderList) {
+    it = it->next;
+  }
+  if (it) {
+    it->next = NULL;
+  }
+  curl_slist_free_all(this->headerList);
+  this->headerList = NULL;
+}
+
+/**
+ * @brief free both the request and the static header lists
+ */
+void
+RestClient::Connection::freeHeaderLists() {
+  this->freeRequestHeaderList();
+  curl_slist_free_all(this->staticHeaderList);
+  this->staticHeaderList = NULL;
+}
+
+/**
+ * @brief set the body of the request, to be sent from the caller's buffer.
+ * Verbs other than POST go as CURLOPT_CUSTOMREQUEST, without the form
+ * Content-Type curl adds to a POST (as the read callback upload had none),
+ * and keep their body when following a redirect.
+ *
+ * @param method HTTP verb
+ * @param data_ptr body pointer, has to outlive the request
+ * @param data_size body size
+ */
+void
+RestClient::Connection::setBodyFields(const std::string& method,
+                                      const char* data_ptr,
+                                      const size_t data_size) {
+  curl_easy_setopt(getCurlHandle(), CURLOPT_POST, 1L);
+  /** without fields curl would read the body from stdin */
+  curl_easy_setopt(getCurlHandle(), CURLOPT_POSTFIELDS,
+                   data_ptr ? data_ptr : "");
+  curl_easy_setopt(getCurlHandle(), CURLOPT_POSTFIELDSIZE_LARGE,
+                   static_cast<curl_off_t>(data_size));
+
+  if (method != "POST") {
+    curl_easy_setopt(getCurlHandle(), CURLOPT_CUSTOMREQUEST, method.c_str());
+    curl_easy_setopt(getCurlHandle(), CURLOPT_POSTREDIR,
+                     static_cast<int64_t>(CURL_REDIR_POST_ALL));
+    if (!this->hasHeader("Content-Type")) {
+      this->requestHeaders.insert(std::make_pair("Content-Type", ""));
+    }
+  }
+}
+
+/**
+ * @brief whether the request or the connection has the header, the name is
+ * compared case insensitively
+ *
+ * @param name header name
+ *
+ * @return true if found
+ */
+bool
+RestClient::Connection::hasHeader(const std::string& name) const {
+  const RestClient::HeaderFields* lists[] = {&this->requestHeaders,
+                                             &this->headerFields};
+  for (size_t i = 0; i < 2; ++i) {
+    for (HeaderFields::const_iterator it = lists[i]->begin();
+        it != lists[i]->end(); ++it) {
+      if (it->first.size() == name.size() &&
+          strncasecmp(it->first.c_str(), name.c_str(), name.size()) == 0) {
+        return true;
+      }
+    }
+  }
+  return false;
 }
 
 /**
@@ -643,11 +1201,7 @@ RestClient::Response
 RestClient::Connection::post(const std::string& url,
                              const char* data_ptr,
                              const size_t data_size) {
-  /** Now specify we want to POST data */
-  curl_easy_setopt(getCurlHandle(), CURLOPT_POST, 1L);
-  /** set post fields */
-  curl_easy_setopt(getCurlHandle(), CURLOPT_POSTFIELDS, data_ptr);
-  curl_easy_setopt(getCurlHandle(), CURLOPT_POSTFIELDSIZE, data_size);
+  this->setBodyFields("POST", data_ptr, data_size);
 
   return this->performCurlRequest(url);
 }
@@ -691,6 +1245,11 @@ RestClient::Response
 RestClient::Connection::put(const std::string& url,
                             const char* data_ptr,
                             const size_t data_size) {
+  if (this->zeroCopyBody) {
+    this->setBodyFields("PUT", data_ptr, data_size);
+    return this->performCurlRequest(url);
+  }
+
   /** initialize upload object */
   RestClient::Helpers::UploadObject up_obj;
   up_obj.data = data_ptr;
@@ -750,6 +1309,11 @@ RestClient::Response
 RestClient::Connection::patch(const std::string& url,
                               const char* data_ptr,
                               const size_t data_size) {
+  if (this->zeroCopyBody) {
+    this->setBodyFields("PATCH", data_ptr, data_size);
+    return this->performCurlRequest(url);
+  }
+
   /** initialize upload object */
   RestClient::Helpers::UploadObject up_obj;
   up_obj.data = data_ptr;
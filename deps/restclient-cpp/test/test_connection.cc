@@ -2,6 +2,9 @@
 #include "restclient-cpp/connection.h"
 #include <gtest/gtest.h>
 #include <json/json.h>
+#include <chrono>
+#include <iostream>
+#include <sstream>
 #include <string>
 
 #include "tests.h"
@@ -55,6 +58,25 @@ TEST_F(ConnectionTest, TestTimeout)
   EXPECT_EQ(28, res.code);
 }
 
+TEST_F(ConnectionTest, TestTimeoutMs)
+{
+  conn->SetTimeoutMs(500);
+  RestClient::Response res = conn->get("/delay/2");
+  EXPECT_EQ(28, res.code);
+}
+
+TEST_F(ConnectionTest, TestRequestTimeoutMs)
+{
+  conn->SetPersistentOptions(true);
+  conn->SetRequestTimeoutMs(500);
+  RestClient::Response res = conn->get("/delay/2");
+  EXPECT_EQ(28, res.code);
+
+  // only the one request had the short timeout
+  res = conn->get("/delay/1");
+  EXPECT_EQ(200, res.code);
+}
+
 TEST_F(ConnectionTestRemote, TestFailForInvalidCA)
 {
   // set a non-existing file for the CA file and it should fail to verify the peer
@@ -390,3 +412,194 @@ TEST_F(ConnectionTest, TestSetWriteFunction)
   EXPECT_EQ(200, res.code);
   EXPECT_EQ(ret, lineReceived.size() + lines);
 }
+
+TEST_F(ConnectionTest, TestPrepareAndCompleteRequest)
+{
+  RestClient::Response res = {};
+  std::string body = "{\"foo\": \"bar\"}";
+  CURL* handle = conn->PrepareRequest("POST", "/post", body.data(), body.size(), &res);
+
+  // drive the transfer with a multi handle, as an event loop would do
+  CURLM* multi = curl_multi_init();
+  curl_multi_add_handle(multi, handle);
+  int running = 1;
+  while (running) {
+    curl_multi_perform(multi, &running);
+    curl_multi_poll(multi, NULL, 0, 100, NULL);
+  }
+  CURLMsg* msg;
+  int msgs_left;
+  CURLcode result = CURLE_OK;
+  while ((msg = curl_multi_info_read(multi, &msgs_left))) {
+    result = msg->data.result;
+  }
+  curl_multi_remove_handle(multi, handle);
+  curl_multi_cleanup(multi);
+
+  conn->CompleteRequest(result, &res);
+  EXPECT_EQ(200, res.code);
+
+  Json::Value root;
+  std::istringstream str(res.body);
+  str >> root;
+  EXPECT_EQ("bar", root["json"].get("foo", "").asString());
+}
+
+TEST_F(ConnectionTest, TestHttp2FallsBackToHttp11)
+{
+  // HTTP/2 is negotiated only over TLS, plain http stays on HTTP/1.1
+  conn->SetHttpVersion(CURL_HTTP_VERSION_2TLS);
+  conn->SetPipeWait(true);
+  RestClient::Response res = conn->get("/get");
+  EXPECT_EQ(200, res.code);
+}
+
+TEST_F(ConnectionTest, TestPersistentOptions)
+{
+  conn->SetPersistentOptions(true);
+  conn->AppendHeader("Foo", "bar");
+
+  conn->SetRequestHeaders({{"Dyn", "1"}});
+  RestClient::Response res = conn->post("/post", "data");
+  EXPECT_EQ(200, res.code);
+
+  Json::Value root;
+  std::istringstream str(res.body);
+  str >> root;
+  EXPECT_EQ("bar", root["headers"].get("Foo", "").asString());
+  EXPECT_EQ("1", root["headers"].get("Dyn", "").asString());
+
+  // the verb and the request headers are gone, the static ones stay
+  res = conn->get("/get");
+  EXPECT_EQ(200, res.code);
+
+  Json::Value root2;
+  std::istringstream str2(res.body);
+  str2 >> root2;
+  EXPECT_EQ("bar", root2["headers"].get("Foo", "").asString());
+  EXPECT_EQ("", root2["headers"].get("Dyn", "").asString());
+}
+
+TEST_F(ConnectionTest, TestResolvePinsAddress)
+{
+  // the name does not exist, only the pinned address lets the call through
+  std::string port = RestClient::TestServer.substr(
+      RestClient::TestServer.find(':') + 1);
+  RestClient::Connection pinned("http://pinned.invalid:" + port);
+  pinned.SetTimeout(10);
+  pinned.SetPersistentOptions(true);
+  pinned.SetResolve({"pinned.invalid:" + port + ":127.0.0.1"});
+
+  RestClient::Response res = pinned.get("/get");
+  EXPECT_EQ(200, res.code);
+
+  // kept with the persistent options
+  res = pinned.get("/get");
+  EXPECT_EQ(200, res.code);
+}
+
+TEST_F(ConnectionTest, TestPutZeroCopyBody)
+{
+  // above 1 KB, curl would ask for 100-continue
+  std::string body(4096, 'x');
+  RestClient::Response res = conn->put("/put", body);
+  EXPECT_EQ(200, res.code);
+
+  Json::Value root;
+  std::istringstream str(res.body);
+  str >> root;
+  EXPECT_EQ(body, root.get("data", "").asString());
+  EXPECT_EQ("", root["headers"].get("Expect", "").asString());
+  // no form Content-Type, as with the read callback upload
+  EXPECT_EQ("", root["headers"].get("Content-Type", "").asString());
+}
+
+TEST_F(ConnectionTest, TestPatchZeroCopyBody)
+{
+  std::string body(4096, 'p');
+  RestClient::Response res = conn->patch("/anything", body);
+  EXPECT_EQ(200, res.code);
+
+  Json::Value root;
+  std::istringstream str(res.body);
+  str >> root;
+  // the verb the server got, not only the body
+  EXPECT_EQ("PATCH", root.get("method", "").asString());
+  EXPECT_EQ(body, root.get("data", "").asString());
+  EXPECT_EQ("", root["headers"].get("Expect", "").asString());
+}
+
+TEST_F(ConnectionTest, TestPutZeroCopyVerb)
+{
+  RestClient::Response res = conn->put("/anything", "data");
+  EXPECT_EQ(200, res.code);
+
+  Json::Value root;
+  std::istringstream str(res.body);
+  str >> root;
+  EXPECT_EQ("PUT", root.get("method", "").asString());
+}
+
+TEST_F(ConnectionTest, TestPatchReadCallbackBody)
+{
+  conn->SetZeroCopyBody(false);
+  std::string body(4096, 'y');
+  RestClient::Response res = conn->patch("/patch", body);
+  EXPECT_EQ(200, res.code);
+
+  Json::Value root;
+  std::istringstream str(res.body);
+  str >> root;
+  EXPECT_EQ(body, root.get("data", "").asString());
+  EXPECT_EQ("", root["headers"].get("Expect", "").asString());
+}
+
+TEST_F(ConnectionTest, TestPrepareRequestDeleteBody)
+{
+  conn->SetPersistentOptions(true);
+  std::string body = "{\"foo\": \"bar\"}";
+  RestClient::Response res;
+
+  CURL* handle = conn->PrepareRequest("DELETE", "/delete", body.c_str(),
+                                      body.size(), &res);
+  conn->CompleteRequest(curl_easy_perform(handle), &res);
+  EXPECT_EQ(200, res.code);
+
+  Json::Value root;
+  std::istringstream str(res.body);
+  str >> root;
+  EXPECT_EQ(body, root.get("data", "").asString());
+
+  // the verb is gone with the request
+  res = conn->get("/get");
+  EXPECT_EQ(200, res.code);
+}
+
+// not a pass/fail check of the speed, the timings are printed and recorded
+TEST_F(ConnectionTest, TestUploadBenchmark)
+{
+  const int rounds = 50;
+  std::string body(64 * 1024, 'z');
+  conn->SetPersistentOptions(true);
+
+  double elapsed[2];
+  for (int zeroCopy = 0; zeroCopy < 2; ++zeroCopy) {
+    // the former behaviour: read callback with Expect: 100-continue
+    conn->SetZeroCopyBody(zeroCopy == 1);
+    conn->SetExpectContinue(zeroCopy == 0);
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+      RestClient::Response res = conn->put("/put", body);
+      ASSERT_EQ(200, res.code);
+    }
+    elapsed[zeroCopy] = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count() / rounds;
+  }
+
+  std::cout << "PUT 64 KiB, ms per request: read callback "
+            << elapsed[0] << ", zero copy " << elapsed[1] << std::endl;
+  RecordProperty("read_callback_us", static_cast<int>(elapsed[0] * 1000));
+  RecordProperty("zero_copy_us", static_cast<int>(elapsed[1] * 1000));
+}
@@ -15,6 +15,7 @@
 #include <optional>
 #include <set>
 #include <string>
+#include <utility>
 
 #include <nlohmann/json.hpp>
 #include <restbed>
@@ -53,6 +54,22 @@ class App_config
     bool get_mtls_enabled() const;
     bool get_target_verify_peer() const;
     bool get_target_verify_host() const;
+    bool get_target_http2_enabled() const;
+    bool get_async_enabled() const;
+    bool get_streaming_enabled() const;
+    bool get_metrics_enabled() const;
+    bool get_retry_enabled() const;
+    bool get_hedge_enabled() const;
+    bool get_breaker_enabled() const;
+    bool get_health_enabled() const;
+    bool get_warm_up_enabled() const;
+    bool get_warm_up_keep_warm() const;
+    bool get_tls_sessions_enabled() const;
+    bool get_dns_enabled() const;
+    bool get_coalescing_enabled() const;
+    bool get_cache_enabled() const;
+    bool get_bulkhead_enabled() const;
+    bool get_deadline_enabled() const;
 
     uint16_t get_port() const;
     uint16_t get_ssl_port() const;
@@ -60,8 +77,53 @@ class App_config
     uint get_worker_limit() const;
     uint get_connection_limit() const;
     uint get_path_max_depth() const;
+    uint get_pool_max_idle() const;
+    uint get_pool_max_idle_per_key() const;
+    uint get_async_max_connections() const;
+    uint get_target_max_concurrent_streams() const;
+    uint get_streaming_max_buffered() const;
+    uint get_target_timeout() const;
+    uint get_buffers_max_retained() const;
+    uint get_retry_max_attempts() const;
+    uint get_hedge_min_samples() const;
+    uint get_breaker_min_requests() const;
+    uint get_breaker_probes() const;
+    uint get_health_rise() const;
+    uint get_health_fall() const;
+    uint get_warm_up_connections() const;
+    uint get_warm_up_threads() const;
+    uint get_cache_shards() const;
+    uint get_bulkhead_max_concurrent() const;
+    uint get_bulkhead_max_queue() const;
+    uint get_bulkhead_reject_status() const;
+
+    double get_retry_budget_ratio() const;
+    double get_hedge_percentile() const;
+    double get_hedge_max_rate() const;
+    double get_breaker_failure_rate() const;
+
+    size_t get_body_spill_threshold() const;
+    size_t get_body_max_size() const;
+    size_t get_buffers_max_capacity() const;
+    size_t get_cache_max_bytes() const;
+    size_t get_cache_max_entry_bytes() const;
 
     std::chrono::milliseconds get_connection_timeout() const;
+    std::chrono::milliseconds get_pool_idle_timeout() const;
+    std::chrono::milliseconds get_metrics_log_interval() const;
+    std::chrono::milliseconds get_retry_base_backoff() const;
+    std::chrono::milliseconds get_retry_max_backoff() const;
+    std::chrono::milliseconds get_hedge_min_delay() const;
+    std::chrono::milliseconds get_breaker_window() const;
+    std::chrono::milliseconds get_breaker_open_time() const;
+    std::chrono::milliseconds get_health_interval() const;
+    std::chrono::milliseconds get_health_timeout() const;
+    std::chrono::milliseconds get_tls_sessions_save_interval() const;
+    std::chrono::milliseconds get_dns_refresh_interval() const;
+    std::chrono::milliseconds get_bulkhead_queue_timeout() const;
+    std::chrono::milliseconds get_target_timeout_ms() const;
+    std::chrono::milliseconds get_target_connect_timeout() const;
+    std::chrono::milliseconds get_deadline_max_budget() const;
 
     const std::string& get_cert_location() const;
     const std::string& get_bind_address() const;
@@ -71,9 +133,20 @@ class App_config
     const std::string& get_certificate_chain() const;
     const std::string& get_target_base_url() const;
     const std::string& get_target_ca() const;
+    const std::string& get_target_proxy() const;
+    const std::string& get_target_user_agent() const;
+    const std::string& get_target_balancing() const;
     const std::string& get_hs_version() const;
     const std::string& get_mtls_key_id() const;
     const std::string& get_keys_dir() const;
+    const std::string& get_body_temp_dir() const;
+    const std::string& get_metrics_path() const;
+    const std::string& get_retry_idempotency_header() const;
+    const std::string& get_health_path() const;
+    const std::string& get_health_identity() const;
+    const std::string& get_warm_up_path() const;
+    const std::string& get_tls_sessions_file() const;
+    const std::string& get_deadline_header() const;
 
     const std::optional<::restbed::Uri>& get_private_key() const;
     const std::optional<::restbed::Uri>& get_certificate() const;
@@ -92,9 +165,15 @@ class App_config
     bool has_pool_config(std::string const& name) const;
     const std::map<std::string, std::string>& get_hs_params() const;
     const std::map<std::string, std::string>& get_passwords() const;
+    const std::map<std::string, std::string>& get_target_headers() const;
+    const std::map<std::string, uint>& get_target_endpoints() const;
+    const std::map<std::string, std::pair<uint, uint>>& get_bulkhead_identities() const;
+    const std::map<std::string, std::chrono::milliseconds>& get_deadline_routes() const;
     const std::optional<std::string> get_password(std::string const& key) const;
 
     const std::set<std::string>& get_verbs() const;
+    const std::set<std::string>& get_hedge_verbs() const;
+    const std::set<std::string>& get_coalescing_headers() const;
 
     // setters
     void set_config(nlohmann::json const& j);
@@ -113,6 +192,19 @@ class App_config
     void set_authentication_handler(restbed_authentication_handler_fn const& fn);
 
     void set_pool_config(nlohmann::json const& j);
+    void set_target_endpoints(nlohmann::json const& j);
+    void set_metrics_config(nlohmann::json const& j);
+    void set_retry_config(nlohmann::json const& j);
+    void set_hedge_config(nlohmann::json const& j);
+    void set_breaker_config(nlohmann::json const& j);
+    void set_health_config(nlohmann::json const& j);
+    void set_warm_up_config(nlohmann::json const& j);
+    void set_tls_sessions_config(nlohmann::json const& j);
+    void set_dns_config(nlohmann::json const& j);
+    void set_coalescing_config(nlohmann::json const& j);
+    void set_cache_config(nlohmann::json const& j);
+    void set_bulkhead_config(nlohmann::json const& j);
+    void set_deadline_config(nlohmann::json const& j);
 
     private:
     App_config(const App_config&) = delete;                  // copy constructor
@@ -135,6 +227,22 @@ class App_config
     bool m_mtls_enabled;
     bool m_target_verify_peer;
     bool m_target_verify_host;
+    bool m_target_http2_enabled;
+    bool m_async_enabled;
+    bool m_streaming_enabled;
+    bool m_metrics_enabled;
+    bool m_retry_enabled;
+    bool m_hedge_enabled;
+    bool m_breaker_enabled;
+    bool m_health_enabled;
+    bool m_warm_up_enabled;
+    bool m_warm_up_keep_warm;
+    bool m_tls_sessions_enabled;
+    bool m_dns_enabled;
+    bool m_coalescing_enabled;
+    bool m_cache_enabled;
+    bool m_bulkhead_enabled;
+    bool m_deadline_enabled;
 
     uint16_t m_port;
     uint16_t m_ssl_port;
@@ -142,8 +250,53 @@ class App_config
     uint m_worker_limit;
     uint m_connection_limit;
     uint m_path_max_depth;
+    uint m_pool_max_idle;
+    uint m_pool_max_idle_per_key;
+    uint m_async_max_connections;
+    uint m_target_max_concurrent_streams;
+    uint m_streaming_max_buffered;
+    uint m_target_timeout;
+    uint m_buffers_max_retained;
+    uint m_retry_max_attempts;
+    uint m_hedge_min_samples;
+    uint m_breaker_min_requests;
+    uint m_breaker_probes;
+    uint m_health_rise;
+    uint m_health_fall;
+    uint m_warm_up_connections;
+    uint m_warm_up_threads;
+    uint m_cache_shards;
+    uint m_bulkhead_max_concurrent;
+    uint m_bulkhead_max_queue;
+    uint m_bulkhead_reject_status;
+
+    double m_retry_budget_ratio;
+    double m_hedge_percentile;
+    double m_hedge_max_rate;
+    double m_breaker_failure_rate;
+
+    size_t m_body_spill_threshold;
+    size_t m_body_max_size;
+    size_t m_buffers_max_capacity;
+    size_t m_cache_max_bytes;
+    size_t m_cache_max_entry_bytes;
 
     std::chrono::milliseconds m_connection_timeout;
+    std::chrono::milliseconds m_pool_idle_timeout;
+    std::chrono::milliseconds m_metrics_log_interval;
+    std::chrono::milliseconds m_retry_base_backoff;
+    std::chrono::milliseconds m_retry_max_backoff;
+    std::chrono::milliseconds m_hedge_min_delay;
+    std::chrono::milliseconds m_breaker_window;
+    std::chrono::milliseconds m_breaker_open_time;
+    std::chrono::milliseconds m_health_interval;
+    std::chrono::milliseconds m_health_timeout;
+    std::chrono::milliseconds m_tls_sessions_save_interval;
+    std::chrono::milliseconds m_dns_refresh_interval;
+    std::chrono::milliseconds m_bulkhead_queue_timeout;
+    std::chrono::milliseconds m_target_timeout_ms;
+    std::chrono::milliseconds m_target_connect_timeout;
+    std::chrono::milliseconds m_deadline_max_budget;
 
     std::string m_cert_location;
     std::string m_bind_address;
@@ -153,9 +306,20 @@ class App_config
     std::string m_certificate_chain;
     std::string m_target_base_url;
     std::string m_target_ca;
+    std::string m_target_proxy;
+    std::string m_target_user_agent;
+    std::string m_target_balancing;
     std::string m_hs_version;
     std::string m_mtls_key_id;
     std::string m_keys_dir;
+    std::string m_body_temp_dir;
+    std::string m_metrics_path;
+    std::string m_retry_idempotency_header;
+    std::string m_health_path;
+    std::string m_health_identity;
+    std::string m_warm_up_path;
+    std::string m_tls_sessions_file;
+    std::string m_deadline_header;
 
     std::optional<::restbed::Uri> m_private_key;
     std::optional<::restbed::Uri> m_certificate;
@@ -170,8 +334,16 @@ class App_config
 
     std::map<std::string, std::string> m_hs_params;
     std::map<std::string, std::string> m_passwords;
+    std::map<std::string, std::string> m_target_headers;
+    std::map<std::string, uint> m_target_endpoints;
+
+    // identity -> (max_concurrent, max_queue)
+    std::map<std::string, std::pair<uint, uint>> m_bulkhead_identities;
+    std::map<std::string, std::chrono::milliseconds> m_deadline_routes;
 
     std::set<std::string> m_verbs;
+    std::set<std::string> m_hedge_verbs;
+    std::set<std::string> m_coalescing_headers;
 };
 
 } // namespace app
@@ -12,6 +12,8 @@
 #include <string>
 #include <vector>
 
+#include <imp/toolbox/body_buffer.h>
+
 namespace imp
 {
 namespace crypto
@@ -38,5 +40,10 @@ std::vector<uint8_t> digest(std::string const& stringToHash, std::string const&
 
 std::vector<uint8_t> digest(std::vector<uint8_t> const& bytesToHash, std::string const& algorithm);
 
+/**
+ *  Creates a hash for a (sealed) body buffer, reading the spilled bodies from their mapping.
+ */
+std::vector<uint8_t> digest(imp::toolbox::Body_buffer const& body, std::string const& algorithm);
+
 } // namespace crypto
 } // namespace imp
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include <imp/crypto/openssl.h>
+
+namespace imp
+{
+namespace crypto
+{
+
+typedef std::function<std::optional<std::string>(std::string const& key_id)> password_lookup_fn;
+
+/**
+ *  Client identity, loaded once from the key store directory.
+ *
+ *  The parsed key and certificate chain are kept for signing. For the mTLS handshake
+ *  the key is kept decrypted in DER and the chain in PEM format, these are handed to
+ *  curl as blobs. (Unlike an SSL_CTX callback, the blobs are part of curl's connection
+ *  and TLS session matching, so a connection is never reused for another identity.)
+ */
+struct Identity
+{
+    std::string key_id;
+    std::unique_ptr<EVP_PKEY, EVP_PKEY_delete> pkey;
+    std::vector<std::unique_ptr<X509, X509_delete>> chain;
+
+    std::string key_der;
+    std::string cert_pem;
+};
+
+// singleton
+class Key_store
+{
+    public:
+    Key_store() { }
+    ~Key_store() { }
+
+    static Key_store* get_instance();
+
+    // loads all <key_id>.key (and <key_id>.pem, if exists) files of the directory
+    size_t load(std::string const& dir, password_lookup_fn const& password_fn);
+
+    std::shared_ptr<const Identity> get_identity(std::string const& key_id) const;
+    EVP_PKEY* get_pkey(std::string const& key_id) const;
+    std::vector<std::string> get_key_ids() const;
+
+    private:
+    Key_store(const Key_store&) = delete;
+    Key_store& operator=(const Key_store& other) = delete;
+    Key_store(Key_store&& other) = delete;
+    Key_store& operator=(Key_store&& other) = delete;
+
+    static std::shared_ptr<Identity> load_identity(std::string const& key_id, std::string const& key_file, std::string const& cert_file, std::optional<std::string> const& password);
+
+    mutable std::shared_mutex m_mutex;
+    std::map<std::string, std::shared_ptr<const Identity>> m_identities;
+};
+
+} // namespace crypto
+} // namespace imp
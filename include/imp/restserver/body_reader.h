@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include <imp/toolbox/body_buffer.h>
+
+// forward declare
+namespace restbed
+{
+class Session;
+}
+
+namespace imp
+{
+namespace restserver
+{
+
+typedef std::function<void(const std::shared_ptr<restbed::Session>)> body_ready_fn;
+
+/**
+ *  An empty buffer, which spills to upstream/body/temp_dir above upstream/body/spill_threshold.
+ */
+std::shared_ptr<imp::toolbox::Body_buffer> make_body_buffer();
+
+/**
+ *  Reads the request body (as given by Content-Length) into the buffer piece by piece,
+ *  so a large body is never held in memory as a whole. The buffer is sealed before the
+ *  callback runs.
+ *
+ *  A body without a length (Transfer-Encoding) is refused with 411, one larger than
+ *  upstream/body/max_size with 413: the session is closed, the callback does not run.
+ */
+void fetch_body(const std::shared_ptr<restbed::Session> session, std::shared_ptr<imp::toolbox::Body_buffer> body, body_ready_fn const& fn);
+
+} // namespace restserver
+} // namespace imp
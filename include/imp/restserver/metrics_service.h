@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <restbed>
+
+namespace imp
+{
+namespace restserver
+{
+
+/**
+ *  Scrape endpoint of the upstream latency metrics (Prometheus text format).
+ */
+class Metrics_service
+{
+    public:
+    Metrics_service(restbed::Service& service, std::string const& path);
+    ~Metrics_service() { }
+
+    private:
+    Metrics_service(const Metrics_service&) = delete;
+    Metrics_service& operator=(const Metrics_service& other) = delete;
+
+    static void get_handler(const std::shared_ptr<restbed::Session> session);
+
+    std::shared_ptr<restbed::Resource> m_resource;
+};
+
+} // namespace restserver
+} // namespace imp
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace imp
+{
+namespace toolbox
+{
+
+/**
+ *  Request / response body. Small bodies are kept in memory, the ones above the spill
+ *  threshold are written to an unlinked temporary file, which is mapped to the memory
+ *  once the body is complete. So the digest and the upload read the same pages, and
+ *  the resident size does not depend on the payload size.
+ *
+ *  Usage: append(...) the parts, seal(), then data() / size().
+ */
+class Body_buffer
+{
+    public:
+    explicit Body_buffer(size_t spill_threshold = std::numeric_limits<size_t>::max(), std::string const& temp_dir = "/tmp");
+    Body_buffer(Body_buffer&& other);
+    Body_buffer& operator=(Body_buffer&& other);
+    ~Body_buffer();
+
+    void append(const void* data, size_t size);
+    void assign(std::string const& data);
+
+    // no more appends, maps the spilled file
+    void seal();
+
+    const char* data() const;
+    size_t size() const;
+    bool empty() const;
+    bool is_spilled() const;
+
+    void clear();
+
+    private:
+    Body_buffer(const Body_buffer&) = delete;
+    Body_buffer& operator=(const Body_buffer& other) = delete;
+
+    void spill();
+    void write_fd(const void* data, size_t size);
+    void release();
+
+    size_t m_spill_threshold;
+    std::string m_temp_dir;
+
+    std::vector<char> m_memory;
+
+    int m_fd;
+    size_t m_size;
+    void* m_map;
+    bool m_sealed;
+};
+
+} // namespace toolbox
+} // namespace imp
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include <curl/curl.h>
+#include <restbed>
+#include <restclient-cpp/restclient.h>
+
+#include <imp/toolbox/body_buffer.h>
+#include <imp/upstream/connection_pool.h>
+#include <imp/upstream/deadline_policy.h>
+#include <imp/upstream/load_balancer.h>
+#include <imp/upstream/response_stream.h>
+
+namespace imp
+{
+namespace upstream
+{
+
+struct Async_call;
+
+typedef std::function<void(RestClient::Response& response)> completion_fn;
+typedef std::function<void(Async_call& call)> sign_fn;
+
+/**
+ *  One forwarded call handed over to the engine. The engine owns it until completion,
+ *  hence the body and the response live here.
+ */
+struct Async_call
+{
+    explicit Async_call(Pooled_connection&& connection);
+
+    Pooled_connection connection;
+
+    // optional, the endpoint picked by the Load_balancer (of the connection's base url)
+    Endpoint_lease endpoint;
+
+    std::string method;
+    std::string uri;
+    // set on the connection for every attempt (and the hedge), as they are dropped once
+    // a request is completed
+    RestClient::HeaderFields request_headers;
+    imp::toolbox::Body_buffer body;
+    RestClient::Response response;
+
+    // optional, the body goes directly to the client instead of response.body (on_complete
+    // has to call its finish())
+    std::shared_ptr<Response_stream> stream;
+
+    // optional, the headers are indexed here instead of response.headers
+    std::shared_ptr<Header_store> headers;
+
+    // signing / mTLS identity of the call, keeps apart its cached and coalesced answers
+    // (the mTLS identity of the connection by default)
+    std::string identity;
+
+    // the client sent an idempotency key, so the call may be retried whatever the verb is
+    bool idempotent;
+
+    // number of attempts started so far
+    uint attempt;
+
+    // optional, the call is not started (or retried) after this, and its transfer gets only
+    // the time remaining
+    std::optional<deadline_t> deadline;
+
+    // optional, once it is set (the client went away), the call is cancelled and completes
+    // with CURLE_ABORTED_BY_CALLBACK; unless it leads coalesced calls, which still wait
+    disconnect_flag disconnected;
+
+    // set by the engine: the coalescing key, which the call leads
+    std::string flight;
+
+    // optional, called on the engine thread right before each attempt (the first one too) and
+    // the hedge is sent, to sign it (e.g. with a fresh Date) by updating request_headers of the
+    // call to be sent. The caller must not sign before submit(): a call answered from the
+    // cache or by a coalesced one, rejected, queued or expired has to cost no signature
+    sign_fn on_sign;
+
+    // called on the engine thread, should not block (e.g. session->close(...) is fine)
+    completion_fn on_complete;
+
+    // set by the engine: this is the second copy of a hedged call, and the other transfer
+    // of the pair, while both are running
+    bool is_hedge;
+    CURL* peer;
+};
+
+/**
+ *  Non-blocking upstream engine. The transfers are driven by curl_multi_socket_action
+ *  from a single event loop thread, so the restbed workers are not blocked during the
+ *  upstream round trip. HTTP/2 transfers of the same target and identity are
+ *  multiplexed over a shared connection. Failed calls are retried here, according to
+ *  the Retry_policy, so the client does not have to repeat the whole round trip. Slow
+ *  calls may be hedged, according to the Hedge_policy. While the Circuit_breaker of a
+ *  target is open, its calls complete at once with 503. A call past its deadline
+ *  completes with 504, without being sent. A call whose client went away is cancelled,
+ *  so its connection is given back at once instead of after the upstream answer.
+ */
+// singleton
+class Async_engine
+{
+    public:
+    Async_engine();
+    ~Async_engine();
+
+    static Async_engine* get_instance();
+
+    void start();
+    void stop();
+    bool is_running() const;
+
+    void submit(std::unique_ptr<Async_call> call);
+
+    size_t get_in_flight() const;
+
+    // Prometheus text exposition format
+    std::string get_text() const;
+
+    // unpauses a transfer, callable from any thread
+    void resume(CURL* handle);
+
+    void set_max_connections(long max_connections);
+    void set_max_concurrent_streams(long max_streams);
+
+    private:
+    Async_engine(const Async_engine&) = delete;
+    Async_engine& operator=(const Async_engine& other) = delete;
+    Async_engine(Async_engine&& other) = delete;
+    Async_engine& operator=(Async_engine&& other) = delete;
+
+    void admit(std::unique_ptr<Async_call> call);
+    void enqueue(std::unique_ptr<Async_call> call);
+    void run();
+    void wakeup();
+    void add_pending();
+    void add_delayed();
+    CURL* add_call(std::unique_ptr<Async_call> call);
+    bool retry(std::unique_ptr<Async_call>& call);
+    void send_hedges();
+    void send_hedge(CURL* handle, Async_call& call);
+    void cancel(CURL* handle);
+    void remove_hedge_timer(CURL* handle);
+    void resume_paused();
+    void check_finished();
+    void cancel_abandoned();
+    void finish(CURL* handle, CURLcode result);
+    void abort_all();
+
+    static int progress_callback(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+    static int socket_callback(CURL* handle, curl_socket_t socket, int what, void* userp, void* socketp);
+    static int timer_callback(CURLM* multi, long timeout_ms, void* userp);
+
+    CURLM* m_multi;
+    int m_epoll_fd;
+    int m_wakeup_fd;
+    // when curl wants CURL_SOCKET_TIMEOUT, none if it has no timer running
+    std::optional<std::chrono::steady_clock::time_point> m_timer;
+    long m_max_connections;
+    long m_max_concurrent_streams;
+    std::chrono::steady_clock::time_point m_next_sweep;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::atomic<size_t> m_in_flight;
+    std::atomic<uint64_t> m_cancelled;
+
+    std::mutex m_mutex;
+    std::deque<std::unique_ptr<Async_call>> m_pending;
+    std::deque<CURL*> m_resumed;
+
+    // touched only by the engine thread
+    std::map<CURL*, std::unique_ptr<Async_call>> m_active;
+    std::multimap<std::chrono::steady_clock::time_point, std::unique_ptr<Async_call>> m_delayed;
+    std::multimap<std::chrono::steady_clock::time_point, CURL*> m_hedge_timers;
+};
+
+} // namespace upstream
+} // namespace imp
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <string>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  Reusable response body buffers. Every thread keeps its own free list, so there is no
+ *  locking. A buffer keeps its capacity while it is in the pool, unless the capacity is
+ *  above the retention cap (then it is freed, so one huge response does not pin memory).
+ */
+class Buffer_pool
+{
+    public:
+    // empty string, with the capacity of an earlier response if there is one
+    static std::string acquire();
+    static void release(std::string&& buffer);
+
+    static void set_limits(size_t max_buffers, size_t max_capacity);
+
+    // reserves for the announced length, up to the retention cap
+    static void reserve(std::string& buffer, size_t content_length);
+
+    private:
+    Buffer_pool() = delete;
+};
+
+} // namespace upstream
+} // namespace imp
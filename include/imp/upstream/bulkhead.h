@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include <imp/upstream/deadline_policy.h>
+#include <imp/upstream/latency_histogram.h>
+
+namespace imp
+{
+namespace upstream
+{
+
+class Bulkhead;
+
+/**
+ *  One of the concurrent calls an identity may have. The slot is given to the next
+ *  waiter of the identity when the permit is destroyed.
+ */
+class Bulkhead_permit
+{
+    public:
+    Bulkhead_permit(Bulkhead* bulkhead, std::string const& identity);
+    ~Bulkhead_permit();
+
+    const std::string& get_identity() const;
+
+    private:
+    Bulkhead_permit(const Bulkhead_permit&) = delete;
+    Bulkhead_permit& operator=(const Bulkhead_permit& other) = delete;
+
+    Bulkhead* m_bulkhead;
+    std::string m_identity;
+};
+
+// shared, so that it can be captured by the completion of the call
+typedef std::function<void(std::shared_ptr<Bulkhead_permit> permit)> admit_fn;
+
+// the HTTP status to answer the client with
+typedef std::function<void(int status)> reject_fn;
+
+/**
+ *  Per-identity concurrency limits (the identity is the mTLS key id or the signing key
+ *  alias of the call). An identity may have max_concurrent calls in progress; further
+ *  calls wait in a bounded FIFO queue, up to the queue timeout. A call finding the queue
+ *  full is rejected at once (with 429 by default), a call waiting too long with 503.
+ *
+ *  So one identity with a slow or flooded target can not occupy all the workers, and
+ *  the others keep their latency. The waiters hold no thread: they are admitted by the
+ *  release of a permit, and expired by expire_waiting(), which should run periodically.
+ *  A call with a deadline does not wait beyond it, it is rejected with 504.
+ *
+ *  Async_engine::submit() acquires the slot of each call, by Async_call::identity.
+ */
+// singleton
+class Bulkhead
+{
+    public:
+    struct Limits
+    {
+        uint max_concurrent;
+        uint max_queue;
+    };
+
+    Bulkhead();
+    ~Bulkhead() { }
+
+    static Bulkhead* get_instance();
+
+    bool is_enabled() const;
+
+    // on_admit is called at once, or later on the thread releasing a permit; on_reject at once,
+    // or on the thread running expire_waiting()
+    void acquire(std::string const& identity, admit_fn const& on_admit, reject_fn const& on_reject, std::optional<deadline_t> const& deadline = std::nullopt);
+
+    // rejects the waiters, which are over the queue timeout
+    void expire_waiting();
+
+    // rejects all the waiters, e.g. when nothing is sent any more
+    void reject_waiting(int status);
+
+    std::chrono::milliseconds get_queue_timeout() const;
+
+    // Prometheus text exposition format
+    std::string get_text() const;
+
+    // limits: the ones of specific identities, the others get the default ones
+    void set_config(bool enabled, Limits const& default_limits, std::map<std::string, Limits> const& limits, std::chrono::milliseconds queue_timeout, int reject_status);
+
+    private:
+    Bulkhead(const Bulkhead&) = delete;
+    Bulkhead& operator=(const Bulkhead& other) = delete;
+    Bulkhead(Bulkhead&& other) = delete;
+    Bulkhead& operator=(Bulkhead&& other) = delete;
+
+    friend class Bulkhead_permit;
+
+    struct Waiter
+    {
+        std::chrono::steady_clock::time_point since;
+
+        // the queue timeout, or the deadline of the call if that is earlier
+        std::chrono::steady_clock::time_point expires;
+        int expired_status;
+
+        admit_fn on_admit;
+        reject_fn on_reject;
+    };
+
+    struct Compartment
+    {
+        Limits limits;
+        uint in_use = 0;
+        std::deque<Waiter> queue;
+
+        Latency_histogram wait;
+        std::atomic<uint64_t> admitted{0};
+        std::atomic<uint64_t> rejected{0};
+        std::atomic<uint64_t> timed_out{0};
+    };
+
+    void release(std::string const& identity);
+
+    // the identity itself if known, "" otherwise
+    std::string get_compartment_id(std::string const& identity) const;
+
+    // created on first use
+    Compartment& get_compartment(std::string const& identity);
+
+    bool m_enabled;
+    Limits m_default_limits;
+    std::map<std::string, Limits> m_limits;
+    std::chrono::milliseconds m_queue_timeout;
+    int m_reject_status;
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, std::unique_ptr<Compartment>> m_compartments;
+};
+
+} // namespace upstream
+} // namespace imp
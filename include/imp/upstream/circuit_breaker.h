@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <restclient-cpp/restclient.h>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  Per-target circuit breaker. The outcomes of the calls are counted in a sliding
+ *  window; when the failure rate (transport errors, timeouts, 502 / 503 / 504) goes
+ *  above the threshold, the circuit opens and the calls of the target fail at once
+ *  with 503, instead of waiting for the connect timeout.
+ *
+ *  After open_time the circuit gets half-open: a few probe calls are let through.
+ *  If they all succeed, the circuit closes; any failure opens it again.
+ */
+// singleton
+class Circuit_breaker
+{
+    public:
+    enum class State
+    {
+        closed,
+        open,
+        half_open
+    };
+
+    Circuit_breaker();
+    ~Circuit_breaker() { }
+
+    static Circuit_breaker* get_instance();
+
+    bool is_enabled() const;
+
+    // false, if the call should fail fast
+    bool allow(std::string const& target);
+
+    void record(std::string const& target, RestClient::Response const& response);
+
+    State get_state(std::string const& target);
+
+    static bool is_failure(RestClient::Response const& response);
+
+    void set_config(bool enabled, std::chrono::milliseconds window, uint min_requests, double failure_rate, std::chrono::milliseconds open_time, uint probes);
+
+    private:
+    Circuit_breaker(const Circuit_breaker&) = delete;
+    Circuit_breaker& operator=(const Circuit_breaker& other) = delete;
+    Circuit_breaker(Circuit_breaker&& other) = delete;
+    Circuit_breaker& operator=(Circuit_breaker&& other) = delete;
+
+    static constexpr size_t bucket_count = 10;
+
+    struct Bucket
+    {
+        int64_t slot;
+        uint successes;
+        uint failures;
+    };
+
+    struct Target_state
+    {
+        State state = State::closed;
+        std::chrono::steady_clock::time_point since;
+        uint probes_sent = 0;
+        uint probes_passed = 0;
+        std::array<Bucket, bucket_count> buckets = {};
+    };
+
+    Bucket& get_bucket(Target_state& state, std::chrono::steady_clock::time_point now) const;
+    void count(Target_state const& state, std::chrono::steady_clock::time_point now, uint& successes, uint& failures) const;
+    void change_state(std::string const& target, Target_state& state, State new_state, std::chrono::steady_clock::time_point now);
+
+    bool m_enabled;
+    std::chrono::milliseconds m_window;
+    uint m_min_requests;
+    double m_failure_rate;
+    std::chrono::milliseconds m_open_time;
+    uint m_probes;
+
+    std::mutex m_mutex;
+    std::map<std::string, Target_state> m_targets;
+};
+
+} // namespace upstream
+} // namespace imp
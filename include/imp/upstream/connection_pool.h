@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <restclient-cpp/connection.h>
+
+#include <imp/upstream/upstream_profile.h>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  Identifies the connections, which are interchangeable. A curl handle keeps its
+ *  live connections and TLS sessions across requests, so a handle may only be
+ *  handed out again for the same target, client identity, verify settings and
+ *  protocol version.
+ */
+struct Pool_key
+{
+    std::string base_url;
+    std::string identity;
+    bool verify_peer;
+    bool verify_host;
+    bool http2;
+
+    bool operator<(Pool_key const& other) const;
+};
+
+typedef std::function<std::unique_ptr<RestClient::Connection>(Pool_key const&)> connection_creator_fn;
+
+class Connection_pool;
+
+/**
+ *  Lease of a pooled connection. Returns the connection to the pool when destroyed.
+ */
+class Pooled_connection
+{
+    public:
+    Pooled_connection(Connection_pool* pool, Pool_key const& key, std::unique_ptr<RestClient::Connection> connection);
+    Pooled_connection(Pooled_connection&& other) = default;
+    ~Pooled_connection();
+
+    // the current connection (if any) goes back to the pool
+    Pooled_connection& operator=(Pooled_connection&& other);
+
+    RestClient::Connection* operator->() const;
+    RestClient::Connection& operator*() const;
+    RestClient::Connection* get() const;
+
+    Pool_key const& get_key() const;
+
+    // the timings of the request completed last go to the upstream metrics, once per request
+    // done on release as well, so the blocking calls are measured too
+    void record();
+
+    // the connection would not be returned to the pool (e.g. after a transport error)
+    void discard();
+
+    private:
+    Pooled_connection(const Pooled_connection&) = delete;
+    Pooled_connection& operator=(const Pooled_connection& other) = delete;
+
+    Connection_pool* m_pool;
+    Pool_key m_key;
+    std::unique_ptr<RestClient::Connection> m_connection;
+
+    // request count of the connection, when recorded last
+    uint64_t m_recorded;
+};
+
+// singleton
+class Connection_pool
+{
+    public:
+    Connection_pool();
+    ~Connection_pool() { }
+
+    static Connection_pool* get_instance();
+
+    Pooled_connection acquire(Pool_key const& key);
+
+    // a new connection set up for the key, not part of the pool
+    std::unique_ptr<RestClient::Connection> create(Pool_key const& key);
+    void release(Pool_key const& key, std::unique_ptr<RestClient::Connection> connection);
+
+    // takes out the idle connections of the key (most recently used first), e.g. to refresh them
+    std::vector<std::unique_ptr<RestClient::Connection>> take_idle(Pool_key const& key, size_t max_count);
+
+    // drops the idle connections not used for longer than the idle timeout
+    void evict_expired();
+    void clear();
+
+    size_t get_idle_count() const;
+    uint get_max_idle_per_key() const;
+    std::chrono::milliseconds get_idle_timeout() const;
+
+    void set_creator(connection_creator_fn const& fn);
+    void set_profile(Upstream_profile const& profile);
+    // the limits apply only to the idle connections, the ones checked out are not counted
+    void set_limits(uint max_idle, uint max_idle_per_key, std::chrono::milliseconds idle_timeout);
+
+    private:
+    Connection_pool(const Connection_pool&) = delete;
+    Connection_pool& operator=(const Connection_pool& other) = delete;
+    Connection_pool(Connection_pool&& other) = delete;
+    Connection_pool& operator=(Connection_pool&& other) = delete;
+
+    struct Idle_entry
+    {
+        std::unique_ptr<RestClient::Connection> connection;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    void evict_expired_locked(std::chrono::steady_clock::time_point now);
+    void evict_oldest_locked();
+
+    mutable std::mutex m_mutex;
+    std::map<Pool_key, std::deque<Idle_entry>> m_idle;
+    size_t m_idle_count;
+
+    uint m_max_idle;
+    uint m_max_idle_per_key;
+    std::chrono::milliseconds m_idle_timeout;
+
+    connection_creator_fn m_creator;
+    Upstream_profile m_profile;
+};
+
+} // namespace upstream
+} // namespace imp
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <imp/upstream/connection_pool.h>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  Opens warm connections into the pool before the first call needs them: for every
+ *  client identity and every target endpoint, DNS, TCP and the mTLS handshake are done
+ *  ahead. A connection is warmed up by a HEAD of the configured path, the answer itself
+ *  does not matter.
+ *
+ *  In keep-warm mode the same is repeated periodically, on a thread of its own: the idle
+ *  connections are used again (so neither the pool nor the target closes them), the
+ *  missing ones are opened.
+ */
+// singleton
+class Connection_warmer
+{
+    public:
+    Connection_warmer();
+    ~Connection_warmer();
+
+    static Connection_warmer* get_instance();
+
+    // keep-warm: warms up again every interval, until stopped
+    void start();
+    void stop();
+
+    // blocks until all the keys are warm
+    void warm_up();
+
+    void set_config(Pool_key const& key_template, std::vector<std::string> const& identities, std::string const& path, uint connections, uint threads, std::chrono::milliseconds interval);
+
+    private:
+    Connection_warmer(const Connection_warmer&) = delete;
+    Connection_warmer& operator=(const Connection_warmer& other) = delete;
+    Connection_warmer(Connection_warmer&& other) = delete;
+    Connection_warmer& operator=(Connection_warmer&& other) = delete;
+
+    void run();
+
+    // returns the number of usable connections left in the pool
+    uint warm_up(Pool_key const& key);
+
+    Pool_key m_key_template;
+    std::vector<std::string> m_identities;
+    std::string m_path;
+    uint m_connections;
+    uint m_threads;
+    std::chrono::milliseconds m_interval;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::mutex m_mutex;
+    std::condition_variable m_stop;
+};
+
+} // namespace upstream
+} // namespace imp
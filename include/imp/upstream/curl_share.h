@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+
+#include <curl/curl.h>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  Process wide curl share object. DNS cache and TLS session IDs are shared by all
+ *  upstream handles, independently from the worker thread which runs the request.
+ *
+ *  The connection cache is not shared: curl does not support handles using a shared
+ *  connection cache concurrently, and the live connections belong to the pooled handles
+ *  (see Connection_pool), which limits and evicts them.
+ *
+ *  TLS sessions are matched by curl with the client certificate settings too, hence
+ *  these are never reused across mTLS identities.
+ */
+// singleton
+class Curl_share
+{
+    public:
+    Curl_share();
+    ~Curl_share();
+
+    static Curl_share* get_instance();
+
+    // nullptr after cleanup()
+    CURLSH* get_handle() const;
+
+    // releases the share, has to run before curl_global_cleanup(), once no handle uses it
+    void cleanup();
+
+    private:
+    Curl_share(const Curl_share&) = delete;
+    Curl_share& operator=(const Curl_share& other) = delete;
+    Curl_share(Curl_share&& other) = delete;
+    Curl_share& operator=(Curl_share&& other) = delete;
+
+    static void lock_callback(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr);
+    static void unlock_callback(CURL* handle, curl_lock_data data, void* userptr);
+
+    CURLSH* m_share;
+    std::mutex m_mutexes[CURL_LOCK_DATA_LAST];
+};
+
+} // namespace upstream
+} // namespace imp
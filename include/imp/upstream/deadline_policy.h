@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace imp
+{
+namespace upstream
+{
+
+typedef std::chrono::steady_clock::time_point deadline_t;
+
+/**
+ *  End-to-end deadlines. The time budget of a call comes from the client (a header with
+ *  the milliseconds it is willing to wait) or from the route (path prefix), the earlier
+ *  one wins. The stages of the call (queueing, signing, the upstream transfer) only get
+ *  the time remaining, and a call whose deadline is gone is not started at all: nobody
+ *  would wait for its answer.
+ */
+// singleton
+class Deadline_policy
+{
+    public:
+    Deadline_policy();
+    ~Deadline_policy() { }
+
+    static Deadline_policy* get_instance();
+
+    bool is_enabled() const;
+
+    // none, if neither the client nor the route has a budget
+    //  - received: arrival of the inbound call
+    std::optional<deadline_t> get_deadline(std::string const& path, std::multimap<std::string, std::string> const& headers, deadline_t received) const;
+
+    // 0, if the deadline is gone
+    static std::chrono::milliseconds get_remaining(deadline_t deadline);
+
+    static bool is_expired(std::optional<deadline_t> const& deadline);
+
+    const std::string& get_header() const;
+
+    // routes: path prefix -> budget, the longest matching prefix applies
+    //  - max_budget: the upper limit of the client's budget
+    void set_config(bool enabled, std::string const& header, std::chrono::milliseconds max_budget, std::map<std::string, std::chrono::milliseconds> const& routes);
+
+    private:
+    Deadline_policy(const Deadline_policy&) = delete;
+    Deadline_policy& operator=(const Deadline_policy& other) = delete;
+    Deadline_policy(Deadline_policy&& other) = delete;
+    Deadline_policy& operator=(Deadline_policy&& other) = delete;
+
+    bool m_enabled;
+    std::string m_header;
+    std::chrono::milliseconds m_max_budget;
+    std::map<std::string, std::chrono::milliseconds> m_routes;
+};
+
+} // namespace upstream
+} // namespace imp
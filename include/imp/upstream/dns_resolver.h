@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  Background name lookup of the target endpoints. The hosts of the Load_balancer
+ *  endpoints are resolved at start and then every refresh interval, and the addresses
+ *  are pinned on the connections (CURLOPT_RESOLVE), so a call never waits for the
+ *  system resolver. If a lookup fails, the last known addresses are kept.
+ */
+// singleton
+class Dns_resolver
+{
+    public:
+    Dns_resolver();
+    ~Dns_resolver();
+
+    static Dns_resolver* get_instance();
+
+    // resolves the hosts once on the calling thread, then keeps refreshing them
+    void start();
+    void stop();
+
+    // resolves all the endpoint hosts once, on the calling thread
+    void resolve_all();
+
+    // "host:port:address[,address...]" entries for CURLOPT_RESOLVE, empty until resolved
+    std::shared_ptr<const std::vector<std::string>> get_entries() const;
+
+    void set_config(std::chrono::milliseconds refresh_interval);
+
+    private:
+    Dns_resolver(const Dns_resolver&) = delete;
+    Dns_resolver& operator=(const Dns_resolver& other) = delete;
+    Dns_resolver(Dns_resolver&& other) = delete;
+    Dns_resolver& operator=(Dns_resolver&& other) = delete;
+
+    void run();
+
+    std::chrono::milliseconds m_refresh_interval;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_stop;
+
+    // published for the connections, replaced as a whole on each refresh
+    std::shared_ptr<const std::vector<std::string>> m_entries;
+
+    // "host:port" -> last resolved entry, touched only by the resolving thread
+    std::map<std::string, std::string> m_resolved;
+};
+
+} // namespace upstream
+} // namespace imp
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  Response headers of one upstream call. The raw header lines are appended to a single
+ *  arena, and only the positions of the (trimmed) names and values are indexed, so
+ *  parsing a header does not allocate.
+ *
+ *  The returned views are valid until the next append / clear.
+ */
+class Header_store
+{
+    public:
+    explicit Header_store(size_t initial_capacity = 2048);
+    ~Header_store() { }
+
+    // one header line, as delivered by curl (with the line end)
+    void append_line(const char* data, size_t size);
+    void clear();
+
+    // case insensitive lookup, first match
+    std::optional<std::string_view> get(std::string_view name) const;
+    std::vector<std::string_view> get_all(std::string_view name) const;
+    bool contains(std::string_view name) const;
+
+    size_t size() const;
+    std::string_view get_name(size_t index) const;
+    std::string_view get_value(size_t index) const;
+
+    // strings are created here only, e.g. for restbed
+    std::multimap<std::string, std::string> to_multimap() const;
+
+    static bool iequals(std::string_view lhs, std::string_view rhs);
+
+    // CURLOPT_HEADERFUNCTION, userdata is the store
+    static size_t header_callback(void* data, size_t size, size_t nmemb, void* userdata);
+
+    private:
+    struct Entry
+    {
+        uint32_t name_offset;
+        uint32_t name_length;
+        uint32_t value_offset;
+        uint32_t value_length;
+    };
+
+    std::string m_arena;
+    std::vector<Entry> m_entries;
+};
+
+} // namespace upstream
+} // namespace imp
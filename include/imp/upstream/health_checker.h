@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <restclient-cpp/connection.h>
+
+#include <imp/upstream/connection_pool.h>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  Background probing of the target endpoints. Every interval a GET of the configured
+ *  path is sent to each endpoint of the Load_balancer (with the configured mTLS
+ *  identity). After `fall` failed probes in a row the endpoint is marked down, after
+ *  `rise` successful ones it is marked up again. A probe succeeds with a 2xx or 3xx
+ *  answer within the timeout.
+ *
+ *  Each endpoint has its own probe connection (set up like the pooled ones), which is
+ *  kept between the probes.
+ */
+// singleton
+class Health_checker
+{
+    public:
+    Health_checker();
+    ~Health_checker();
+
+    static Health_checker* get_instance();
+
+    void start();
+    void stop();
+
+    // probes all the endpoints once, on the calling thread
+    void check_all();
+
+    void set_config(Pool_key const& key_template, std::string const& path, std::chrono::milliseconds interval, std::chrono::milliseconds timeout, uint rise, uint fall);
+
+    private:
+    Health_checker(const Health_checker&) = delete;
+    Health_checker& operator=(const Health_checker& other) = delete;
+    Health_checker(Health_checker&& other) = delete;
+    Health_checker& operator=(Health_checker&& other) = delete;
+
+    struct Probe_state
+    {
+        std::unique_ptr<RestClient::Connection> connection;
+        uint successes = 0;
+        uint failures = 0;
+    };
+
+    void run();
+    bool probe(std::string const& base_url, Probe_state& state);
+
+    Pool_key m_key_template;
+    std::string m_path;
+    std::chrono::milliseconds m_interval;
+    std::chrono::milliseconds m_timeout;
+    uint m_rise;
+    uint m_fall;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    std::mutex m_mutex;
+    std::condition_variable m_stop;
+
+    // touched only by the checking thread
+    std::map<std::string, Probe_state> m_probes;
+};
+
+} // namespace upstream
+} // namespace imp
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  Hedged calls: when the target did not answer within its usual time (the observed
+ *  p95 of the target, whatever the identity of the calls), a second copy of the call
+ *  is sent. The first
+ *  answer wins, the other transfer is cancelled. This cuts the tail latency of a
+ *  target with a few slow responses, for a small amount of extra load.
+ *
+ *  Hedges are limited per target to max_rate of the calls, and are only sent after
+ *  min_samples calls of the target were measured (see Hedge_metrics).
+ */
+// singleton
+class Hedge_policy
+{
+    public:
+    Hedge_policy();
+    ~Hedge_policy() { }
+
+    static Hedge_policy* get_instance();
+
+    bool is_enabled() const;
+
+    // the verb is configured for hedging
+    bool is_hedgeable(std::string const& method) const;
+
+    // when to send the hedge, none if there is not enough data about the target (base url)
+    std::optional<std::chrono::microseconds> get_delay(std::string const& target) const;
+
+    // counts the hedge in the target's rate, false if the rate limit is reached
+    bool try_hedge(std::string const& target);
+
+    void set_config(bool enabled, std::set<std::string> const& verbs, double percentile, std::chrono::milliseconds min_delay, double max_rate, uint min_samples);
+
+    private:
+    Hedge_policy(const Hedge_policy&) = delete;
+    Hedge_policy& operator=(const Hedge_policy& other) = delete;
+    Hedge_policy(Hedge_policy&& other) = delete;
+    Hedge_policy& operator=(Hedge_policy&& other) = delete;
+
+    bool m_enabled;
+    std::set<std::string> m_verbs;
+    double m_percentile;
+    std::chrono::milliseconds m_min_delay;
+    double m_max_rate;
+    uint m_min_samples;
+};
+
+} // namespace upstream
+} // namespace imp
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  Lock-free latency histogram with HDR-like log-linear buckets: every power of two
+ *  is split into 16 sub-buckets, so the relative error stays below ~6% over the whole
+ *  range (1 us .. ~25 days). Recording is a few relaxed atomic operations, so any
+ *  thread may record while others read.
+ */
+class Latency_histogram
+{
+    public:
+    struct Snapshot
+    {
+        uint64_t count;
+        uint64_t sum_us;
+        uint64_t max_us;
+        uint64_t p50_us;
+        uint64_t p90_us;
+        uint64_t p99_us;
+        uint64_t p999_us;
+    };
+
+    Latency_histogram();
+    ~Latency_histogram() { }
+
+    void record(uint64_t value_us);
+
+    uint64_t get_count() const;
+    uint64_t get_percentile(double quantile) const;
+    Snapshot get_snapshot() const;
+
+    private:
+    Latency_histogram(const Latency_histogram&) = delete;
+    Latency_histogram& operator=(const Latency_histogram& other) = delete;
+
+    static const int sub_bucket_bits = 4;
+    static const uint64_t sub_bucket_count = 1 << sub_bucket_bits;
+    static const int max_value_bits = 41;
+    static const size_t bucket_count = (max_value_bits - sub_bucket_bits + 1) * sub_bucket_count;
+
+    static size_t bucket_index(uint64_t value);
+    static uint64_t bucket_value(size_t index);
+
+    std::array<std::atomic<uint64_t>, bucket_count> m_buckets;
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_max;
+};
+
+} // namespace upstream
+} // namespace imp
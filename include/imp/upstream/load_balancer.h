@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  One replica of the target, with the load figures the balancing policies use.
+ */
+class Upstream_endpoint
+{
+    public:
+    Upstream_endpoint(std::string const& base_url, uint weight);
+    ~Upstream_endpoint() { }
+
+    const std::string& get_base_url() const;
+    uint get_weight() const;
+
+    // calls picked for the endpoint, which did not complete yet
+    int get_outstanding() const;
+
+    // peak EWMA of the call times, 0 until the first call completed
+    double get_latency_us() const;
+
+    void observe(uint64_t latency_us);
+
+    // set by the health checks, a dead endpoint gets no calls
+    bool is_healthy() const;
+    void set_healthy(bool healthy);
+
+    // state of the smooth weighted round robin, guarded by the policy
+    int64_t current_weight;
+
+    private:
+    Upstream_endpoint(const Upstream_endpoint&) = delete;
+    Upstream_endpoint& operator=(const Upstream_endpoint& other) = delete;
+
+    friend class Endpoint_lease;
+
+    std::string m_base_url;
+    uint m_weight;
+    std::atomic<int> m_outstanding;
+    std::atomic<bool> m_healthy;
+
+    mutable std::mutex m_mutex;
+    double m_latency_us;
+    std::chrono::steady_clock::time_point m_observed;
+};
+
+/**
+ *  Counts a call as outstanding on its endpoint while it exists.
+ */
+class Endpoint_lease
+{
+    public:
+    Endpoint_lease();
+    explicit Endpoint_lease(std::shared_ptr<Upstream_endpoint> endpoint);
+    Endpoint_lease(Endpoint_lease&& other);
+    Endpoint_lease& operator=(Endpoint_lease&& other);
+    ~Endpoint_lease();
+
+    Upstream_endpoint* operator->() const;
+    Upstream_endpoint* get() const;
+    explicit operator bool() const;
+
+    private:
+    Endpoint_lease(const Endpoint_lease&) = delete;
+    Endpoint_lease& operator=(const Endpoint_lease& other) = delete;
+
+    std::shared_ptr<Upstream_endpoint> m_endpoint;
+};
+
+typedef std::vector<std::shared_ptr<Upstream_endpoint>> endpoint_list;
+typedef std::function<std::shared_ptr<Upstream_endpoint>(endpoint_list const&)> balancing_fn;
+
+/**
+ *  Spreads the calls over the replicas of the target. The policy is picked by name,
+ *  built in ones:
+ *   - round_robin: smooth weighted round robin
+ *   - least_outstanding: fewest calls in progress, relative to the weight
+ *   - peak_ewma: lowest (decaying, peak sensitive) average latency times the calls in progress
+ *
+ *  The pooled connections are keyed by the endpoint's base url, so a connection always
+ *  stays with its endpoint. Endpoints marked down by the health checks are skipped,
+ *  unless all of them are down.
+ */
+// singleton
+class Load_balancer
+{
+    public:
+    Load_balancer();
+    ~Load_balancer() { }
+
+    static Load_balancer* get_instance();
+
+    // the endpoint for the next call, empty lease if there are no endpoints
+    Endpoint_lease pick();
+
+    // endpoint of a base url, nullptr if it is not balanced
+    std::shared_ptr<Upstream_endpoint> find(std::string const& base_url) const;
+
+    endpoint_list get_endpoints() const;
+
+    void register_policy(std::string const& name, balancing_fn const& fn);
+
+    // base url -> weight
+    void set_endpoints(std::map<std::string, uint> const& endpoints, std::string const& policy);
+
+    private:
+    Load_balancer(const Load_balancer&) = delete;
+    Load_balancer& operator=(const Load_balancer& other) = delete;
+    Load_balancer(Load_balancer&& other) = delete;
+    Load_balancer& operator=(Load_balancer&& other) = delete;
+
+    mutable std::shared_mutex m_mutex;
+    endpoint_list m_endpoints;
+    balancing_fn m_policy;
+    std::map<std::string, balancing_fn> m_policies;
+};
+
+std::shared_ptr<Upstream_endpoint> round_robin_policy(endpoint_list const& endpoints);
+std::shared_ptr<Upstream_endpoint> least_outstanding_policy(endpoint_list const& endpoints);
+std::shared_ptr<Upstream_endpoint> peak_ewma_policy(endpoint_list const& endpoints);
+
+} // namespace upstream
+} // namespace imp
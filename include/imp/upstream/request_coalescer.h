@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <restclient-cpp/restclient.h>
+
+#include <imp/upstream/async_engine.h>
+#include <imp/upstream/header_store.h>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  Single-flight of identical GETs. While a call is in flight, the same GET (target,
+ *  path, query, signing / mTLS identity and the configured headers) is not sent to the
+ *  target again: it waits for the answer of the first one, and gets its own copy of it.
+ *  The duplicates cost no upstream round trip, and no signature either, as the engine
+ *  signs only the calls it sends (Async_call::on_sign). Async_engine::submit() does this
+ *  for the not streamed calls.
+ *
+ *  The first caller of a key leads: it sends the call with the completion returned by
+ *  lead(). The others join() and are completed from there. The leader has to complete
+ *  the key on every path, so it holds a Flight_guard until the call is handed over.
+ */
+// singleton
+class Request_coalescer
+{
+    public:
+    Request_coalescer();
+    ~Request_coalescer() { }
+
+    static Request_coalescer* get_instance();
+
+    bool is_enabled() const;
+
+    // the verb is coalesced (only GET)
+    bool is_coalescable(std::string const& method) const;
+
+    // identical calls have the same key, the headers are the ones of the client
+    std::string make_key(std::string const& method, std::string const& path, std::string const& query, std::string const& identity, std::multimap<std::string, std::string> const& headers) const;
+
+    // true: an identical call is in flight, on_complete gets a copy of its answer
+    // false: no such call, the caller has to lead (the key is taken by it from now)
+    bool join(std::string const& key, completion_fn const& on_complete);
+
+    // the completion of the leading call, it completes the waiters first
+    //  - headers: the header store of the call, if it has one
+    completion_fn lead(std::string const& key, completion_fn const& on_complete, std::shared_ptr<Header_store> const& headers = nullptr);
+
+    // completes the waiters of the key with a copy of the response and releases the key
+    // (called by the completion of lead(), or by the leader, if its call could not be sent)
+    void complete(std::string const& key, RestClient::Response const& response);
+
+    // other calls joined the key, so its call is to be finished even without its own client
+    bool has_waiters(std::string const& key);
+
+    // Prometheus text exposition format
+    std::string get_text() const;
+
+    void set_config(bool enabled, std::set<std::string> const& headers);
+
+    private:
+    Request_coalescer(const Request_coalescer&) = delete;
+    Request_coalescer& operator=(const Request_coalescer& other) = delete;
+    Request_coalescer(Request_coalescer&& other) = delete;
+    Request_coalescer& operator=(Request_coalescer&& other) = delete;
+
+    bool m_enabled;
+
+    // lower case names
+    std::set<std::string> m_headers;
+
+    std::mutex m_mutex;
+    std::map<std::string, std::vector<completion_fn>> m_flights;
+
+    std::atomic<uint64_t> m_leaders;
+    std::atomic<uint64_t> m_coalesced;
+};
+
+/**
+ *  Held by the leader of a key from join() until its call is handed over with the
+ *  completion of lead(). If the leader leaves before (e.g. by an exception), the
+ *  waiters are completed with 502, so they do not wait forever.
+ */
+class Flight_guard
+{
+    public:
+    explicit Flight_guard(std::string const& key);
+    ~Flight_guard();
+
+    // the completion of the call completes the key from now
+    void release();
+
+    private:
+    Flight_guard(const Flight_guard&) = delete;
+    Flight_guard& operator=(const Flight_guard& other) = delete;
+
+    std::string m_key;
+    bool m_released;
+};
+
+} // namespace upstream
+} // namespace imp
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <restclient-cpp/restclient.h>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  A stored answer of the target. Immutable once stored, a revalidation replaces it.
+ */
+struct Cached_response
+{
+    RestClient::Response response;
+
+    // the request headers named by Vary, with the values of the request stored
+    std::vector<std::pair<std::string, std::string>> vary;
+
+    // validators for the conditional request
+    std::string etag;
+    std::string last_modified;
+
+    std::chrono::steady_clock::time_point expires;
+
+    // Cache-Control: no-cache or max-age=0: stored, but always revalidated
+    bool must_revalidate;
+
+    size_t size;
+};
+
+/**
+ *  Shared cache of the forwarded GETs, following the Cache-Control, Vary and validators
+ *  of the target. The entries are keyed by the request (path, query) and the signing /
+ *  mTLS identity, so an answer is never served to another identity.
+ *
+ *  The memory is limited in bytes. The entries are spread over shards by key, each
+ *  having its own lock and LRU list, so the lookups of the workers do not serialize.
+ *
+ *  Usage: lookup(); a fresh entry is answered from the cache. A stale one is sent with
+ *  the headers of get_conditional_headers(), and a 304 answer is turned back into the
+ *  full response by revalidate(), without the body being transferred again. Any other
+ *  answer goes to store(). Async_engine::submit() does this for the not streamed GETs.
+ */
+// singleton
+class Response_cache
+{
+    public:
+    enum class Status
+    {
+        miss,
+        fresh,
+        stale
+    };
+
+    struct Lookup
+    {
+        Status status;
+        std::shared_ptr<const Cached_response> entry;
+    };
+
+    Response_cache();
+    ~Response_cache() { }
+
+    static Response_cache* get_instance();
+
+    bool is_enabled() const;
+
+    // the verb is cached (only GET)
+    bool is_cacheable(std::string const& method) const;
+
+    std::string make_key(std::string const& path, std::string const& query, std::string const& identity) const;
+
+    // the headers are the ones of the client (checked against the Vary of the entry)
+    Lookup lookup(std::string const& key, std::multimap<std::string, std::string> const& headers);
+
+    // If-None-Match / If-Modified-Since for revalidating a stale entry
+    RestClient::HeaderFields get_conditional_headers(Cached_response const& entry) const;
+
+    // keeps the response, if the target allows it
+    void store(std::string const& key, std::multimap<std::string, std::string> const& headers, RestClient::Response const& response);
+
+    // the full response of a 304 answer, the entry is refreshed by the new headers
+    RestClient::Response revalidate(std::string const& key, std::multimap<std::string, std::string> const& headers, Cached_response const& entry, RestClient::Response const& not_modified);
+
+    void erase(std::string const& key);
+    void clear();
+
+    size_t get_size() const;
+
+    // Prometheus text exposition format
+    std::string get_text() const;
+
+    void set_config(bool enabled, size_t max_bytes, size_t max_entry_bytes, uint shards);
+
+    private:
+    Response_cache(const Response_cache&) = delete;
+    Response_cache& operator=(const Response_cache& other) = delete;
+    Response_cache(Response_cache&& other) = delete;
+    Response_cache& operator=(Response_cache&& other) = delete;
+
+    typedef std::list<std::pair<std::string, std::shared_ptr<const Cached_response>>> lru_list;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        lru_list lru;
+        std::unordered_map<std::string, lru_list::iterator> index;
+        size_t size = 0;
+    };
+
+    Shard& get_shard(std::string const& key);
+    void insert(std::string const& key, std::shared_ptr<const Cached_response> entry);
+
+    // nullptr, if the response may not be stored
+    std::shared_ptr<Cached_response> make_entry(std::multimap<std::string, std::string> const& headers, RestClient::Response const& response) const;
+
+    bool m_enabled;
+    size_t m_max_bytes;
+    size_t m_max_entry_bytes;
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+    std::atomic<uint64_t> m_revalidated;
+    std::atomic<uint64_t> m_stored;
+    std::atomic<uint64_t> m_evicted;
+};
+
+} // namespace upstream
+} // namespace imp
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <curl/curl.h>
+#include <restbed>
+#include <restclient-cpp/helpers.h>
+#include <restclient-cpp/restclient.h>
+
+#include <imp/upstream/header_store.h>
+
+namespace imp
+{
+namespace upstream
+{
+
+typedef std::function<void()> resume_fn;
+
+// set from any thread once the client went away (e.g. by the error handler of its session),
+// the engine reads only this, it does not use the restbed session from its thread
+typedef std::shared_ptr<std::atomic<bool>> disconnect_flag;
+
+/**
+ *  Passes the upstream response through to the inbound session while it arrives.
+ *
+ *  Status and headers are sent once the upstream header block is complete, the body
+ *  chunks are yielded as curl delivers them. When the client reads slower than the
+ *  target sends, the transfer is paused (CURL_WRITEFUNC_PAUSE) above the high
+ *  watermark, and resumed when the written data drops below the low watermark. So
+ *  at most about max_buffered bytes are held per call.
+ *
+ *  The curl callbacks run on the engine thread, but the session is used only from the
+ *  restbed workers: every yield() and close() is scheduled on the service, in order and
+ *  one at a time. The write completions run on the restbed workers as well.
+ *
+ *  The stream is created on the thread of the request handler. The on_complete of the
+ *  Async_call carrying the stream has to call finish(), which closes the session.
+ */
+class Response_stream : public std::enable_shared_from_this<Response_stream>
+{
+    public:
+    Response_stream(::restbed::Service& service, std::shared_ptr<::restbed::Session> session, size_t max_buffered);
+    ~Response_stream() { }
+
+    // engine side
+    // the response gets the status code, the headers are kept in the stream only
+    void attach(CURL* handle, RestClient::Response* response, resume_fn const& fn, disconnect_flag const& disconnected = nullptr);
+    // to be called by the completion of the call
+    void finish(RestClient::Response const& response);
+
+    bool is_headers_sent() const;
+    Header_store const& get_headers() const;
+    size_t get_buffered() const;
+
+    // nullptr, when streaming (or the async engine) is disabled in the app config
+    static std::shared_ptr<Response_stream> from_config(::restbed::Service& service, std::shared_ptr<::restbed::Session> session);
+
+    static size_t header_callback(void* data, size_t size, size_t nmemb, void* userdata);
+    static size_t write_callback(void* data, size_t size, size_t nmemb, void* userdata);
+
+    private:
+    Response_stream(const Response_stream&) = delete;
+    Response_stream& operator=(const Response_stream& other) = delete;
+    Response_stream(Response_stream&& other) = delete;
+    Response_stream& operator=(Response_stream&& other) = delete;
+
+    void send_headers();
+    void send_chunk(const char* data, size_t size);
+    void written(size_t size);
+    bool is_disconnected() const;
+    void post(std::function<void()> task);
+    void run_tasks();
+
+    ::restbed::Service* m_service;
+    std::shared_ptr<::restbed::Session> m_session;
+    bool m_is_head;
+    CURL* m_handle;
+    RestClient::Response* m_response;
+    resume_fn m_resume;
+    disconnect_flag m_disconnected;
+
+    size_t m_high_watermark;
+    size_t m_low_watermark;
+
+    bool m_headers_sent;
+    bool m_chunked;
+    Header_store m_headers;
+
+    std::atomic<size_t> m_buffered;
+    std::atomic<bool> m_paused;
+
+    // session calls waiting for a restbed worker, m_scheduled while one is draining them
+    std::mutex m_mutex;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_scheduled;
+};
+
+} // namespace upstream
+} // namespace imp
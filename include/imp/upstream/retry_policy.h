@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+
+#include <restclient-cpp/restclient.h>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  Decides whether a failed upstream call is tried again, and when.
+ *
+ *  Only calls, which are safe to repeat are retried: safe verbs (GET, HEAD, OPTIONS,
+ *  TRACE), or any verb when the client sent an idempotency key. Transport errors and
+ *  502 / 503 answers are retried, with exponential backoff and full jitter.
+ *
+ *  The retries are limited by a budget shared by all the calls: every first attempt
+ *  deposits budget_ratio tokens, every retry takes one. So under a target outage the
+ *  retries add at most about budget_ratio extra load, instead of multiplying it.
+ */
+// singleton
+class Retry_policy
+{
+    public:
+    Retry_policy();
+    ~Retry_policy() { }
+
+    static Retry_policy* get_instance();
+
+    bool is_enabled() const;
+
+    // the request may be sent more than once
+    bool is_repeatable(std::string const& method, bool has_idempotency_key) const;
+
+    // the outcome of an attempt is worth another try
+    bool is_retryable(RestClient::Response const& response) const;
+
+    // called on every first attempt
+    void on_request();
+
+    // takes a token from the budget, false if it is exhausted or out of attempts
+    bool try_retry(uint attempt);
+
+    // wait before the given retry (1: first retry)
+    std::chrono::milliseconds get_backoff(uint attempt);
+
+    const std::string& get_idempotency_header() const;
+
+    void set_config(bool enabled, uint max_attempts, std::chrono::milliseconds base_backoff, std::chrono::milliseconds max_backoff, double budget_ratio, std::string const& idempotency_header);
+
+    private:
+    Retry_policy(const Retry_policy&) = delete;
+    Retry_policy& operator=(const Retry_policy& other) = delete;
+    Retry_policy(Retry_policy&& other) = delete;
+    Retry_policy& operator=(Retry_policy&& other) = delete;
+
+    bool m_enabled;
+    uint m_max_attempts;
+    std::chrono::milliseconds m_base_backoff;
+    std::chrono::milliseconds m_max_backoff;
+    double m_budget_ratio;
+    std::string m_idempotency_header;
+
+    std::mutex m_mutex;
+    double m_tokens;
+    double m_max_tokens;
+    std::mt19937 m_random;
+};
+
+} // namespace upstream
+} // namespace imp
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  Keeps the TLS sessions of the shared curl session cache (see Curl_share) in a file,
+ *  so the first calls after a restart resume the sessions instead of full handshakes.
+ *
+ *  The sessions are matched by curl's own session key (target host, port and the TLS
+ *  settings, including the client certificate), so a session is only resumed for the
+ *  same target and mTLS identity. The file holds session secrets, it is written with
+ *  0600 permissions.
+ *
+ *  Needs curl 8.12.0 or newer (curl_easy_ssls_export / import), with older versions
+ *  load and save only log that the feature is not available.
+ */
+// singleton
+class Tls_session_store
+{
+    public:
+    Tls_session_store();
+    ~Tls_session_store() { }
+
+    static Tls_session_store* get_instance();
+
+    void set_path(std::string const& path);
+
+    // imports the still valid sessions of the file into the shared cache
+    void load();
+
+    // writes the sessions of the shared cache into the file (replacing it)
+    void save();
+
+    private:
+    Tls_session_store(const Tls_session_store&) = delete;
+    Tls_session_store& operator=(const Tls_session_store& other) = delete;
+    Tls_session_store(Tls_session_store&& other) = delete;
+    Tls_session_store& operator=(Tls_session_store&& other) = delete;
+
+    std::mutex m_mutex;
+    std::string m_path;
+};
+
+} // namespace upstream
+} // namespace imp
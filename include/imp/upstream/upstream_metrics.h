@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+
+#include <restclient-cpp/connection.h>
+
+#include <imp/upstream/connection_pool.h>
+#include <imp/upstream/latency_histogram.h>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  Latencies of the upstream calls of one target and client identity, split by the
+ *  phases curl reports.
+ */
+struct Target_metrics
+{
+    Latency_histogram dns;
+    Latency_histogram connect;
+    Latency_histogram tls;
+    Latency_histogram server;
+    Latency_histogram total;
+    std::atomic<uint64_t> errors{0};
+};
+
+/**
+ *  What hedging needs of a target, whatever the identity of the calls: the total call
+ *  times, and the calls which could have been hedged, hedges sent and hedges answered
+ *  first.
+ */
+struct Hedge_metrics
+{
+    Latency_histogram total;
+    std::atomic<uint64_t> candidates{0};
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> won{0};
+};
+
+// singleton
+class Upstream_metrics
+{
+    public:
+    Upstream_metrics() { }
+    ~Upstream_metrics() { }
+
+    static Upstream_metrics* get_instance();
+
+    void record(Pool_key const& key, RestClient::Connection::RequestInfo const& info);
+
+    // created on first use, stays valid until the end of the process
+    Target_metrics& get_metrics(Pool_key const& key);
+    Hedge_metrics& get_hedge_metrics(std::string const& target);
+
+    // Prometheus text exposition format
+    std::string get_text() const;
+
+    // summary of all targets to the "upstream" logger
+    void log_dump() const;
+
+    private:
+    Upstream_metrics(const Upstream_metrics&) = delete;
+    Upstream_metrics& operator=(const Upstream_metrics& other) = delete;
+    Upstream_metrics(Upstream_metrics&& other) = delete;
+    Upstream_metrics& operator=(Upstream_metrics&& other) = delete;
+
+    // (target, identity)
+    typedef std::pair<std::string, std::string> metrics_key;
+
+    mutable std::shared_mutex m_mutex;
+    std::map<metrics_key, std::unique_ptr<Target_metrics>> m_metrics;
+    std::map<std::string, std::unique_ptr<Hedge_metrics>> m_hedge_metrics;
+};
+
+} // namespace upstream
+} // namespace imp
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <string>
+
+#include <restclient-cpp/connection.h>
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  Connection level settings of a target: everything, which is the same for all the
+ *  calls. Applied once to a new pooled connection, which keeps them on the curl handle
+ *  (persistent options), so a call only sets its URL, own headers and body.
+ */
+struct Upstream_profile
+{
+    Upstream_profile();
+
+    std::string ca_file;
+    std::string proxy;
+    std::string user_agent;
+    std::chrono::milliseconds timeout;         // 0: no limit
+    std::chrono::milliseconds connect_timeout; // 0: curl default
+    std::map<std::string, std::string> headers;
+
+    void apply(RestClient::Connection& connection) const;
+
+    static Upstream_profile from_config();
+};
+
+} // namespace upstream
+} // namespace imp
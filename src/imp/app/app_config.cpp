@@ -46,12 +46,71 @@ App_config::App_config()
 , m_hs_enabled(false)
 , m_mtls_enabled(false)
 , m_target_verify_peer(true)
+, m_target_http2_enabled(false)
+, m_async_enabled(false)
+, m_streaming_enabled(false)
+, m_metrics_enabled(false)
+, m_retry_enabled(false)
+, m_hedge_enabled(false)
+, m_breaker_enabled(false)
+, m_health_enabled(false)
+, m_warm_up_enabled(false)
+, m_warm_up_keep_warm(false)
+, m_tls_sessions_enabled(false)
+, m_dns_enabled(false)
+, m_coalescing_enabled(false)
+, m_cache_enabled(false)
+, m_bulkhead_enabled(false)
+, m_deadline_enabled(false)
 , m_port(80)
 , m_ssl_port(443)
 , m_worker_limit(1)
 , m_connection_limit(128)
 , m_path_max_depth(5)
+, m_pool_max_idle(64)
+, m_pool_max_idle_per_key(8)
+, m_async_max_connections(0)
+, m_target_max_concurrent_streams(100)
+, m_streaming_max_buffered(1048576)
+, m_target_timeout(0)
+, m_buffers_max_retained(8)
+, m_retry_max_attempts(3)
+, m_hedge_min_samples(100)
+, m_breaker_min_requests(20)
+, m_breaker_probes(3)
+, m_health_rise(2)
+, m_health_fall(2)
+, m_warm_up_connections(1)
+, m_warm_up_threads(4)
+, m_cache_shards(16)
+, m_bulkhead_max_concurrent(16)
+, m_bulkhead_max_queue(32)
+, m_bulkhead_reject_status(429)
+, m_retry_budget_ratio(0.1)
+, m_hedge_percentile(0.95)
+, m_hedge_max_rate(0.05)
+, m_breaker_failure_rate(0.5)
+, m_body_spill_threshold(4194304)
+, m_body_max_size(104857600)
+, m_buffers_max_capacity(8388608)
+, m_cache_max_bytes(67108864)
+, m_cache_max_entry_bytes(1048576)
 , m_connection_timeout(std::chrono::milliseconds(5000))
+, m_pool_idle_timeout(std::chrono::milliseconds(60000))
+, m_metrics_log_interval(std::chrono::milliseconds(0))
+, m_retry_base_backoff(std::chrono::milliseconds(50))
+, m_retry_max_backoff(std::chrono::milliseconds(1000))
+, m_hedge_min_delay(std::chrono::milliseconds(10))
+, m_breaker_window(std::chrono::milliseconds(10000))
+, m_breaker_open_time(std::chrono::milliseconds(5000))
+, m_health_interval(std::chrono::milliseconds(5000))
+, m_health_timeout(std::chrono::milliseconds(2000))
+, m_tls_sessions_save_interval(std::chrono::milliseconds(300000))
+, m_dns_refresh_interval(std::chrono::milliseconds(30000))
+, m_bulkhead_queue_timeout(std::chrono::milliseconds(1000))
+, m_target_timeout_ms(std::chrono::milliseconds(0))
+, m_target_connect_timeout(std::chrono::milliseconds(0))
+, m_deadline_max_budget(std::chrono::milliseconds(300000))
 , m_cert_location("")
 , m_bind_address("0.0.0.0")
 , m_ssl_bind_address("0.0.0.0")
@@ -60,14 +119,27 @@ App_config::App_config()
 , m_certificate_chain("")
 , m_target_base_url("")
 , m_target_ca("")
+, m_target_proxy("")
+, m_target_user_agent("")
+, m_target_balancing("round_robin")
 , m_hs_version("")
 , m_mtls_key_id("")
 , m_keys_dir("./")
+, m_body_temp_dir("/tmp")
+, m_metrics_path("/metrics")
+, m_retry_idempotency_header("Idempotency-Key")
+, m_health_path("/health")
+, m_health_identity("")
+, m_warm_up_path("/")
+, m_tls_sessions_file("tls_sessions.bin")
+, m_deadline_header("x-request-timeout-ms")
 , m_not_found_handler(nullptr)
 , m_method_not_allowed_handler(nullptr)
 , m_method_not_implemented_handler(nullptr)
 , m_error_handler(nullptr)
 , m_authentication_handler(nullptr)
+, m_hedge_verbs({"GET", "HEAD"})
+, m_coalescing_headers({"Accept"})
 {
 }
 
@@ -147,6 +219,86 @@ bool App_config::get_target_verify_host() const
     return m_target_verify_host;
 }
 
+bool App_config::get_target_http2_enabled() const
+{
+    return m_target_http2_enabled;
+}
+
+bool App_config::get_async_enabled() const
+{
+    return m_async_enabled;
+}
+
+bool App_config::get_streaming_enabled() const
+{
+    return m_streaming_enabled;
+}
+
+bool App_config::get_metrics_enabled() const
+{
+    return m_metrics_enabled;
+}
+
+bool App_config::get_retry_enabled() const
+{
+    return m_retry_enabled;
+}
+
+bool App_config::get_hedge_enabled() const
+{
+    return m_hedge_enabled;
+}
+
+bool App_config::get_breaker_enabled() const
+{
+    return m_breaker_enabled;
+}
+
+bool App_config::get_health_enabled() const
+{
+    return m_health_enabled;
+}
+
+bool App_config::get_warm_up_enabled() const
+{
+    return m_warm_up_enabled;
+}
+
+bool App_config::get_warm_up_keep_warm() const
+{
+    return m_warm_up_keep_warm;
+}
+
+bool App_config::get_tls_sessions_enabled() const
+{
+    return m_tls_sessions_enabled;
+}
+
+bool App_config::get_dns_enabled() const
+{
+    return m_dns_enabled;
+}
+
+bool App_config::get_coalescing_enabled() const
+{
+    return m_coalescing_enabled;
+}
+
+bool App_config::get_cache_enabled() const
+{
+    return m_cache_enabled;
+}
+
+bool App_config::get_bulkhead_enabled() const
+{
+    return m_bulkhead_enabled;
+}
+
+bool App_config::get_deadline_enabled() const
+{
+    return m_deadline_enabled;
+}
+
 uint16_t App_config::get_port() const
 {
     return m_port;
@@ -172,11 +324,233 @@ uint App_config::get_path_max_depth() const
     return m_path_max_depth;
 }
 
+uint App_config::get_pool_max_idle() const
+{
+    return m_pool_max_idle;
+}
+
+uint App_config::get_pool_max_idle_per_key() const
+{
+    return m_pool_max_idle_per_key;
+}
+
+uint App_config::get_async_max_connections() const
+{
+    return m_async_max_connections;
+}
+
+uint App_config::get_target_max_concurrent_streams() const
+{
+    return m_target_max_concurrent_streams;
+}
+
+uint App_config::get_streaming_max_buffered() const
+{
+    return m_streaming_max_buffered;
+}
+
+uint App_config::get_target_timeout() const
+{
+    return m_target_timeout;
+}
+
+uint App_config::get_buffers_max_retained() const
+{
+    return m_buffers_max_retained;
+}
+
+uint App_config::get_retry_max_attempts() const
+{
+    return m_retry_max_attempts;
+}
+
+uint App_config::get_hedge_min_samples() const
+{
+    return m_hedge_min_samples;
+}
+
+uint App_config::get_breaker_min_requests() const
+{
+    return m_breaker_min_requests;
+}
+
+uint App_config::get_breaker_probes() const
+{
+    return m_breaker_probes;
+}
+
+uint App_config::get_health_rise() const
+{
+    return m_health_rise;
+}
+
+uint App_config::get_health_fall() const
+{
+    return m_health_fall;
+}
+
+uint App_config::get_warm_up_connections() const
+{
+    return m_warm_up_connections;
+}
+
+uint App_config::get_warm_up_threads() const
+{
+    return m_warm_up_threads;
+}
+
+uint App_config::get_cache_shards() const
+{
+    return m_cache_shards;
+}
+
+uint App_config::get_bulkhead_max_concurrent() const
+{
+    return m_bulkhead_max_concurrent;
+}
+
+uint App_config::get_bulkhead_max_queue() const
+{
+    return m_bulkhead_max_queue;
+}
+
+uint App_config::get_bulkhead_reject_status() const
+{
+    return m_bulkhead_reject_status;
+}
+
+double App_config::get_retry_budget_ratio() const
+{
+    return m_retry_budget_ratio;
+}
+
+double App_config::get_hedge_percentile() const
+{
+    return m_hedge_percentile;
+}
+
+double App_config::get_hedge_max_rate() const
+{
+    return m_hedge_max_rate;
+}
+
+double App_config::get_breaker_failure_rate() const
+{
+    return m_breaker_failure_rate;
+}
+
+size_t App_config::get_body_spill_threshold() const
+{
+    return m_body_spill_threshold;
+}
+
+size_t App_config::get_body_max_size() const
+{
+    return m_body_max_size;
+}
+
+size_t App_config::get_buffers_max_capacity() const
+{
+    return m_buffers_max_capacity;
+}
+
+size_t App_config::get_cache_max_bytes() const
+{
+    return m_cache_max_bytes;
+}
+
+size_t App_config::get_cache_max_entry_bytes() const
+{
+    return m_cache_max_entry_bytes;
+}
+
 std::chrono::milliseconds App_config::get_connection_timeout() const
 {
     return m_connection_timeout;
 }
 
+std::chrono::milliseconds App_config::get_pool_idle_timeout() const
+{
+    return m_pool_idle_timeout;
+}
+
+std::chrono::milliseconds App_config::get_metrics_log_interval() const
+{
+    return m_metrics_log_interval;
+}
+
+std::chrono::milliseconds App_config::get_retry_base_backoff() const
+{
+    return m_retry_base_backoff;
+}
+
+std::chrono::milliseconds App_config::get_retry_max_backoff() const
+{
+    return m_retry_max_backoff;
+}
+
+std::chrono::milliseconds App_config::get_hedge_min_delay() const
+{
+    return m_hedge_min_delay;
+}
+
+std::chrono::milliseconds App_config::get_breaker_window() const
+{
+    return m_breaker_window;
+}
+
+std::chrono::milliseconds App_config::get_breaker_open_time() const
+{
+    return m_breaker_open_time;
+}
+
+std::chrono::milliseconds App_config::get_health_interval() const
+{
+    return m_health_interval;
+}
+
+std::chrono::milliseconds App_config::get_health_timeout() const
+{
+    return m_health_timeout;
+}
+
+std::chrono::milliseconds App_config::get_tls_sessions_save_interval() const
+{
+    return m_tls_sessions_save_interval;
+}
+
+std::chrono::milliseconds App_config::get_dns_refresh_interval() const
+{
+    return m_dns_refresh_interval;
+}
+
+std::chrono::milliseconds App_config::get_bulkhead_queue_timeout() const
+{
+    return m_bulkhead_queue_timeout;
+}
+
+/**
+ *  @return target/timeout_ms if given, target/timeout (in seconds) otherwise
+ */
+std::chrono::milliseconds App_config::get_target_timeout_ms() const
+{
+    if (m_target_timeout_ms.count() > 0)
+    {
+        return m_target_timeout_ms;
+    }
+    return std::chrono::seconds(m_target_timeout);
+}
+
+std::chrono::milliseconds App_config::get_target_connect_timeout() const
+{
+    return m_target_connect_timeout;
+}
+
+std::chrono::milliseconds App_config::get_deadline_max_budget() const
+{
+    return m_deadline_max_budget;
+}
+
 const std::string& App_config::get_cert_location() const
 {
     return m_cert_location;
@@ -217,6 +591,21 @@ const std::string& App_config::get_target_ca() const
     return m_target_ca;
 }
 
+const std::string& App_config::get_target_proxy() const
+{
+    return m_target_proxy;
+}
+
+const std::string& App_config::get_target_user_agent() const
+{
+    return m_target_user_agent;
+}
+
+const std::string& App_config::get_target_balancing() const
+{
+    return m_target_balancing;
+}
+
 const std::string& App_config::get_hs_version() const
 {
     return m_hs_version;
@@ -232,6 +621,46 @@ const std::string& App_config::get_keys_dir() const
     return m_keys_dir;
 }
 
+const std::string& App_config::get_body_temp_dir() const
+{
+    return m_body_temp_dir;
+}
+
+const std::string& App_config::get_metrics_path() const
+{
+    return m_metrics_path;
+}
+
+const std::string& App_config::get_retry_idempotency_header() const
+{
+    return m_retry_idempotency_header;
+}
+
+const std::string& App_config::get_health_path() const
+{
+    return m_health_path;
+}
+
+const std::string& App_config::get_health_identity() const
+{
+    return m_health_identity;
+}
+
+const std::string& App_config::get_warm_up_path() const
+{
+    return m_warm_up_path;
+}
+
+const std::string& App_config::get_tls_sessions_file() const
+{
+    return m_tls_sessions_file;
+}
+
+const std::string& App_config::get_deadline_header() const
+{
+    return m_deadline_header;
+}
+
 const std::optional<::restbed::Uri>& App_config::get_private_key() const
 {
     return m_private_key;
@@ -337,6 +766,26 @@ const std::map<std::string, std::string>& App_config::get_passwords() const
     return m_passwords;
 }
 
+const std::map<std::string, std::string>& App_config::get_target_headers() const
+{
+    return m_target_headers;
+}
+
+const std::map<std::string, uint>& App_config::get_target_endpoints() const
+{
+    return m_target_endpoints;
+}
+
+const std::map<std::string, std::pair<uint, uint>>& App_config::get_bulkhead_identities() const
+{
+    return m_bulkhead_identities;
+}
+
+const std::map<std::string, std::chrono::milliseconds>& App_config::get_deadline_routes() const
+{
+    return m_deadline_routes;
+}
+
 const std::optional<std::string> App_config::get_password(std::string const& key) const
 {
     auto const it = m_passwords.find(key);
@@ -352,6 +801,16 @@ const std::set<std::string>& App_config::get_verbs() const
     return m_verbs;
 }
 
+const std::set<std::string>& App_config::get_hedge_verbs() const
+{
+    return m_hedge_verbs;
+}
+
+const std::set<std::string>& App_config::get_coalescing_headers() const
+{
+    return m_coalescing_headers;
+}
+
 #define FILL_IF_EXISTS(jsn, path, variable) \
     if (jsn.contains(json_pointer(path)))   \
         variable = jsn[json_pointer(path)];
@@ -366,6 +825,225 @@ void App_config::set_connection_timeout(json const& j)
     m_connection_timeout = std::chrono::milliseconds(value);
 }
 
+void App_config::set_pool_config(json const& j)
+{
+    FILL_IF_EXISTS(j, "/max_idle", m_pool_max_idle);
+    FILL_IF_EXISTS(j, "/max_idle_per_key", m_pool_max_idle_per_key);
+
+    if (j.contains(json_pointer("/idle_timeout")))
+    {
+        uint64_t value = j[json_pointer("/idle_timeout")];
+        m_pool_idle_timeout = std::chrono::milliseconds(value);
+    }
+}
+
+/**
+ *  List of the target's replicas: [ { "base_url": "...", "weight": 1 }, ... ]
+ */
+void App_config::set_target_endpoints(json const& j)
+{
+    m_target_endpoints.clear();
+
+    for (auto const& endpoint : j)
+    {
+        string base_url = endpoint.at("base_url");
+        uint weight = endpoint.value("weight", 1u);
+
+        m_target_endpoints[base_url] = weight;
+    }
+}
+
+void App_config::set_metrics_config(json const& j)
+{
+    FILL_IF_EXISTS(j, "/enabled", m_metrics_enabled);
+    FILL_IF_EXISTS(j, "/path", m_metrics_path);
+
+    if (j.contains(json_pointer("/log_interval")))
+    {
+        uint64_t value = j[json_pointer("/log_interval")];
+        m_metrics_log_interval = std::chrono::milliseconds(value);
+    }
+}
+
+void App_config::set_retry_config(json const& j)
+{
+    FILL_IF_EXISTS(j, "/enabled", m_retry_enabled);
+    FILL_IF_EXISTS(j, "/max_attempts", m_retry_max_attempts);
+    FILL_IF_EXISTS(j, "/budget_ratio", m_retry_budget_ratio);
+    FILL_IF_EXISTS(j, "/idempotency_header", m_retry_idempotency_header);
+
+    if (j.contains(json_pointer("/base_backoff")))
+    {
+        uint64_t value = j[json_pointer("/base_backoff")];
+        m_retry_base_backoff = std::chrono::milliseconds(value);
+    }
+
+    if (j.contains(json_pointer("/max_backoff")))
+    {
+        uint64_t value = j[json_pointer("/max_backoff")];
+        m_retry_max_backoff = std::chrono::milliseconds(value);
+    }
+}
+
+void App_config::set_hedge_config(json const& j)
+{
+    FILL_IF_EXISTS(j, "/enabled", m_hedge_enabled);
+    FILL_IF_EXISTS(j, "/verbs", m_hedge_verbs);
+    FILL_IF_EXISTS(j, "/percentile", m_hedge_percentile);
+    FILL_IF_EXISTS(j, "/max_rate", m_hedge_max_rate);
+    FILL_IF_EXISTS(j, "/min_samples", m_hedge_min_samples);
+
+    if (j.contains(json_pointer("/min_delay")))
+    {
+        uint64_t value = j[json_pointer("/min_delay")];
+        m_hedge_min_delay = std::chrono::milliseconds(value);
+    }
+}
+
+void App_config::set_breaker_config(json const& j)
+{
+    FILL_IF_EXISTS(j, "/enabled", m_breaker_enabled);
+    FILL_IF_EXISTS(j, "/min_requests", m_breaker_min_requests);
+    FILL_IF_EXISTS(j, "/failure_rate", m_breaker_failure_rate);
+    FILL_IF_EXISTS(j, "/probes", m_breaker_probes);
+
+    if (j.contains(json_pointer("/window")))
+    {
+        uint64_t value = j[json_pointer("/window")];
+        m_breaker_window = std::chrono::milliseconds(value);
+    }
+
+    if (j.contains(json_pointer("/open_time")))
+    {
+        uint64_t value = j[json_pointer("/open_time")];
+        m_breaker_open_time = std::chrono::milliseconds(value);
+    }
+}
+
+void App_config::set_health_config(json const& j)
+{
+    FILL_IF_EXISTS(j, "/enabled", m_health_enabled);
+    FILL_IF_EXISTS(j, "/path", m_health_path);
+    FILL_IF_EXISTS(j, "/identity", m_health_identity);
+    FILL_IF_EXISTS(j, "/rise", m_health_rise);
+    FILL_IF_EXISTS(j, "/fall", m_health_fall);
+
+    if (j.contains(json_pointer("/interval")))
+    {
+        uint64_t value = j[json_pointer("/interval")];
+        m_health_interval = std::chrono::milliseconds(value);
+    }
+
+    if (j.contains(json_pointer("/timeout")))
+    {
+        uint64_t value = j[json_pointer("/timeout")];
+        m_health_timeout = std::chrono::milliseconds(value);
+    }
+}
+
+void App_config::set_warm_up_config(json const& j)
+{
+    FILL_IF_EXISTS(j, "/enabled", m_warm_up_enabled);
+    FILL_IF_EXISTS(j, "/path", m_warm_up_path);
+    FILL_IF_EXISTS(j, "/connections", m_warm_up_connections);
+    FILL_IF_EXISTS(j, "/threads", m_warm_up_threads);
+    FILL_IF_EXISTS(j, "/keep_warm", m_warm_up_keep_warm);
+}
+
+void App_config::set_tls_sessions_config(json const& j)
+{
+    FILL_IF_EXISTS(j, "/enabled", m_tls_sessions_enabled);
+    FILL_IF_EXISTS(j, "/file", m_tls_sessions_file);
+
+    if (j.contains(json_pointer("/save_interval")))
+    {
+        uint64_t value = j[json_pointer("/save_interval")];
+        m_tls_sessions_save_interval = std::chrono::milliseconds(value);
+    }
+}
+
+void App_config::set_dns_config(json const& j)
+{
+    FILL_IF_EXISTS(j, "/enabled", m_dns_enabled);
+
+    if (j.contains(json_pointer("/refresh_interval")))
+    {
+        uint64_t value = j[json_pointer("/refresh_interval")];
+        m_dns_refresh_interval = std::chrono::milliseconds(value);
+    }
+}
+
+void App_config::set_coalescing_config(json const& j)
+{
+    FILL_IF_EXISTS(j, "/enabled", m_coalescing_enabled);
+    FILL_IF_EXISTS(j, "/headers", m_coalescing_headers);
+}
+
+void App_config::set_cache_config(json const& j)
+{
+    FILL_IF_EXISTS(j, "/enabled", m_cache_enabled);
+    FILL_IF_EXISTS(j, "/max_bytes", m_cache_max_bytes);
+    FILL_IF_EXISTS(j, "/max_entry_bytes", m_cache_max_entry_bytes);
+    FILL_IF_EXISTS(j, "/shards", m_cache_shards);
+}
+
+/**
+ *  The limits of specific identities: { "key_id": { "max_concurrent": 4, "max_queue": 8 }, ... },
+ *  the missing ones are the defaults
+ */
+void App_config::set_bulkhead_config(json const& j)
+{
+    FILL_IF_EXISTS(j, "/enabled", m_bulkhead_enabled);
+    FILL_IF_EXISTS(j, "/max_concurrent", m_bulkhead_max_concurrent);
+    FILL_IF_EXISTS(j, "/max_queue", m_bulkhead_max_queue);
+    FILL_IF_EXISTS(j, "/reject_status", m_bulkhead_reject_status);
+
+    if (j.contains(json_pointer("/queue_timeout")))
+    {
+        uint64_t value = j[json_pointer("/queue_timeout")];
+        m_bulkhead_queue_timeout = std::chrono::milliseconds(value);
+    }
+
+    m_bulkhead_identities.clear();
+
+    if (j.contains(json_pointer("/identities")))
+    {
+        for (auto const& [identity, limits] : j[json_pointer("/identities")].items())
+        {
+            uint max_concurrent = limits.value("max_concurrent", m_bulkhead_max_concurrent);
+            uint max_queue = limits.value("max_queue", m_bulkhead_max_queue);
+
+            m_bulkhead_identities[identity] = std::make_pair(max_concurrent, max_queue);
+        }
+    }
+}
+
+/**
+ *  Budgets of the routes: { "/path/prefix": milliseconds, ... }
+ */
+void App_config::set_deadline_config(json const& j)
+{
+    FILL_IF_EXISTS(j, "/enabled", m_deadline_enabled);
+    FILL_IF_EXISTS(j, "/header", m_deadline_header);
+
+    if (j.contains(json_pointer("/max_budget")))
+    {
+        uint64_t value = j[json_pointer("/max_budget")];
+        m_deadline_max_budget = std::chrono::milliseconds(value);
+    }
+
+    m_deadline_routes.clear();
+
+    if (j.contains(json_pointer("/routes")))
+    {
+        for (auto const& [prefix, budget] : j[json_pointer("/routes")].items())
+        {
+            uint64_t value = budget;
+            m_deadline_routes[prefix] = std::chrono::milliseconds(value);
+        }
+    }
+}
+
 void App_config::set_private_key(json const& j)
 {
     std::string value = j;
@@ -454,6 +1132,61 @@ void App_config::set_config(nlohmann::json const& j)
     FILL_IF_EXISTS(j, "/target/ca", m_target_ca);
     FILL_IF_EXISTS(j, "/target/target_verify_peer", m_target_verify_peer);
     FILL_IF_EXISTS(j, "/target/target_verify_host", m_target_verify_host);
+    FILL_IF_EXISTS(j, "/target/timeout", m_target_timeout);
+
+    if (j.contains(json_pointer("/target/timeout_ms")))
+    {
+        uint64_t value = j[json_pointer("/target/timeout_ms")];
+        m_target_timeout_ms = std::chrono::milliseconds(value);
+    }
+
+    if (j.contains(json_pointer("/target/connect_timeout_ms")))
+    {
+        uint64_t value = j[json_pointer("/target/connect_timeout_ms")];
+        m_target_connect_timeout = std::chrono::milliseconds(value);
+    }
+
+    FILL_IF_EXISTS(j, "/target/proxy", m_target_proxy);
+    FILL_IF_EXISTS(j, "/target/user_agent", m_target_user_agent);
+    FILL_IF_EXISTS(j, "/target/headers", m_target_headers);
+    FILL_IF_EXISTS(j, "/target/http2/enabled", m_target_http2_enabled);
+    FILL_IF_EXISTS(j, "/target/http2/max_concurrent_streams", m_target_max_concurrent_streams);
+    FILL_IF_EXISTS(j, "/target/balancing", m_target_balancing);
+    CALL_IF_EXISTS(j, "/target/endpoints", set_target_endpoints);
+
+    // a single target is an endpoint list of one
+    if (m_target_endpoints.empty() && !m_target_base_url.empty())
+    {
+        m_target_endpoints[m_target_base_url] = 1;
+    }
+    else if (m_target_base_url.empty() && !m_target_endpoints.empty())
+    {
+        m_target_base_url = m_target_endpoints.begin()->first;
+    }
+
+    CALL_IF_EXISTS(j, "/upstream/pool", set_pool_config);
+    FILL_IF_EXISTS(j, "/upstream/async/enabled", m_async_enabled);
+    FILL_IF_EXISTS(j, "/upstream/async/max_connections", m_async_max_connections);
+    FILL_IF_EXISTS(j, "/upstream/streaming/enabled", m_streaming_enabled);
+    FILL_IF_EXISTS(j, "/upstream/streaming/max_buffered", m_streaming_max_buffered);
+    FILL_IF_EXISTS(j, "/upstream/body/spill_threshold", m_body_spill_threshold);
+    FILL_IF_EXISTS(j, "/upstream/body/max_size", m_body_max_size);
+    FILL_IF_EXISTS(j, "/upstream/body/temp_dir", m_body_temp_dir);
+    FILL_IF_EXISTS(j, "/upstream/buffers/max_retained", m_buffers_max_retained);
+    FILL_IF_EXISTS(j, "/upstream/buffers/max_capacity", m_buffers_max_capacity);
+    CALL_IF_EXISTS(j, "/upstream/retry", set_retry_config);
+    CALL_IF_EXISTS(j, "/upstream/hedge", set_hedge_config);
+    CALL_IF_EXISTS(j, "/upstream/circuit_breaker", set_breaker_config);
+    CALL_IF_EXISTS(j, "/upstream/health_check", set_health_config);
+    CALL_IF_EXISTS(j, "/upstream/warm_up", set_warm_up_config);
+    CALL_IF_EXISTS(j, "/upstream/tls_sessions", set_tls_sessions_config);
+    CALL_IF_EXISTS(j, "/upstream/dns", set_dns_config);
+    CALL_IF_EXISTS(j, "/upstream/coalescing", set_coalescing_config);
+    CALL_IF_EXISTS(j, "/upstream/cache", set_cache_config);
+    CALL_IF_EXISTS(j, "/upstream/bulkhead", set_bulkhead_config);
+    CALL_IF_EXISTS(j, "/upstream/deadline", set_deadline_config);
+
+    CALL_IF_EXISTS(j, "/metrics", set_metrics_config);
 
     FILL_IF_EXISTS(j, "/http_signature/enabled", m_hs_enabled);
     FILL_IF_EXISTS(j, "/http_signature/version", m_hs_version);
@@ -82,5 +82,10 @@ std::vector<uint8_t> digest(std::vector<uint8_t> const& bytesToHash, string cons
     return digest(bytesToHash.data(), bytesToHash.size(), algorithm);
 }
 
+std::vector<uint8_t> digest(imp::toolbox::Body_buffer const& body, string const& algorithm)
+{
+    return digest(body.data(), body.size(), algorithm);
+}
+
 } // namespace crypto
 } // namespace imp
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+
+#include <openssl/err.h>
+#include <openssl/pem.h>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/app/error.h>
+#include <imp/crypto/key_store.h>
+
+using imp::app::application_error;
+using std::make_shared;
+using std::optional;
+using std::shared_lock;
+using std::shared_ptr;
+using std::string;
+using std::unique_lock;
+using std::unique_ptr;
+
+namespace fs = std::filesystem;
+
+namespace imp
+{
+namespace crypto
+{
+
+// the default openssl callback would prompt on the terminal for the missing passwords
+static int password_callback(char* buf, int size, int rwflag, void* u)
+{
+    (void)rwflag;
+
+    auto password = static_cast<optional<string> const*>(u);
+    if (!password->has_value())
+    {
+        return 0;
+    }
+
+    int len = static_cast<int>(password->value().size());
+    if (len > size)
+    {
+        len = size;
+    }
+    memcpy(buf, password->value().data(), len);
+
+    return len;
+}
+
+static string bio_to_string(BIO* bio)
+{
+    char* data = nullptr;
+    long len = BIO_get_mem_data(bio, &data);
+
+    return string(data, len);
+}
+
+Key_store* Key_store::get_instance()
+{
+    static std::unique_ptr<Key_store> m_instance(new Key_store);
+    return m_instance.get();
+}
+
+/**
+ *  Loads the identities from the key store directory. Keys have to be in PEM format with
+ *  .key extension, the certificate chains in PEM format with .pem extension. The filename
+ *  without the extension is the key identifier.
+ *
+ *  @param dir Key store directory
+ *  @param password_fn Password lookup for the encrypted keys
+ *  @return Number of identities loaded
+ */
+size_t Key_store::load(string const& dir, password_lookup_fn const& password_fn)
+{
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("main"));
+
+    std::map<string, shared_ptr<const Identity>> identities;
+
+    std::error_code ec;
+    for (auto const& entry : fs::directory_iterator(dir, ec))
+    {
+        if (!entry.is_regular_file() || entry.path().extension() != ".key")
+        {
+            continue;
+        }
+
+        string key_id = entry.path().stem().string();
+        fs::path cert_file = entry.path();
+        cert_file.replace_extension(".pem");
+
+        try
+        {
+            identities[key_id] = load_identity(key_id, entry.path().string(), fs::exists(cert_file) ? cert_file.string() : "", password_fn(key_id));
+            LOG4CPLUS_DEBUG(logger, "Key loaded: " << key_id);
+        }
+        catch (std::exception const& exc)
+        {
+            LOG4CPLUS_ERROR(logger, "Key " << key_id << " cannot be loaded: " << exc.what());
+        }
+    }
+
+    if (ec)
+    {
+        throw application_error("ERR_KEY_STORE_CANNOT_READ: " + dir + " " + ec.message());
+    }
+
+    LOG4CPLUS_INFO(logger, "Key store loaded " << identities.size() << " identities from: " << dir);
+
+    unique_lock<std::shared_mutex> lock(m_mutex);
+    m_identities.swap(identities);
+
+    return m_identities.size();
+}
+
+shared_ptr<const Identity> Key_store::get_identity(string const& key_id) const
+{
+    shared_lock<std::shared_mutex> lock(m_mutex);
+
+    auto it = m_identities.find(key_id);
+    return (it != m_identities.end()) ? it->second : nullptr;
+}
+
+EVP_PKEY* Key_store::get_pkey(string const& key_id) const
+{
+    auto identity = get_identity(key_id);
+
+    // identities are never freed while the process runs
+    return identity ? identity->pkey.get() : nullptr;
+}
+
+std::vector<string> Key_store::get_key_ids() const
+{
+    shared_lock<std::shared_mutex> lock(m_mutex);
+
+    std::vector<string> key_ids;
+    for (auto const& identity : m_identities)
+    {
+        key_ids.push_back(identity.first);
+    }
+
+    return key_ids;
+}
+
+shared_ptr<Identity> Key_store::load_identity(string const& key_id, string const& key_file, string const& cert_file, optional<string> const& password)
+{
+    auto identity = make_shared<Identity>();
+    identity->key_id = key_id;
+
+    // private key, decrypted once
+    {
+        unique_ptr<BIO, BIO_delete> bio(BIO_new_file(key_file.c_str(), "r"));
+        if (!bio)
+        {
+            throw application_error("ERR_CERT_PRIVATE_KEY_CANNOT_OPEN: " + key_file);
+        }
+
+        identity->pkey.reset(PEM_read_bio_PrivateKey(bio.get(), nullptr, password_callback, const_cast<optional<string>*>(&password)));
+        if (!identity->pkey)
+        {
+            throw application_error("ERR_CERT_PRIVATE_KEY_CANNOT_READ: " + std::to_string(ERR_get_error()));
+        }
+
+        unique_ptr<BIO, BIO_delete> der(BIO_new(BIO_s_mem()));
+        if (!der || i2d_PrivateKey_bio(der.get(), identity->pkey.get()) != 1)
+        {
+            throw application_error("ERR_CRYPTO_OPENSSL_ERROR" + std::to_string(ERR_get_error()));
+        }
+        identity->key_der = bio_to_string(der.get());
+    }
+
+    // certificate chain, leaf first
+    if (!cert_file.empty())
+    {
+        unique_ptr<BIO, BIO_delete> bio(BIO_new_file(cert_file.c_str(), "r"));
+        if (!bio)
+        {
+            throw application_error("ERR_CERT_CANNOT_OPEN: " + cert_file);
+        }
+
+        unique_ptr<BIO, BIO_delete> pem(BIO_new(BIO_s_mem()));
+
+        X509* cert;
+        while ((cert = PEM_read_bio_X509(bio.get(), nullptr, nullptr, nullptr)) != nullptr)
+        {
+            identity->chain.emplace_back(cert);
+            PEM_write_bio_X509(pem.get(), cert);
+        }
+        ERR_clear_error(); // end of file
+
+        if (identity->chain.empty())
+        {
+            throw application_error("ERR_CERT_CANNOT_READ: " + cert_file);
+        }
+
+        if (X509_check_private_key(identity->chain.front().get(), identity->pkey.get()) != 1)
+        {
+            throw application_error("ERR_CERT_KEY_MISMATCH: " + cert_file);
+        }
+
+        identity->cert_pem = bio_to_string(pem.get());
+    }
+
+    return identity;
+}
+
+} // namespace crypto
+} // namespace imp
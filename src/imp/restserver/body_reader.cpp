@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <algorithm>
+
+#include <restbed>
+
+#include <imp/app/app_config.h>
+#include <imp/restserver/body_reader.h>
+#include <imp/upstream/header_store.h>
+
+using imp::app::App_config;
+using imp::toolbox::Body_buffer;
+using imp::upstream::Header_store;
+using restbed::Bytes;
+using restbed::Session;
+using std::shared_ptr;
+using std::string;
+
+namespace imp
+{
+namespace restserver
+{
+
+// size of one read from the client
+static const size_t fetch_chunk_size = 64 * 1024;
+
+static void fetch_next(const shared_ptr<Session> session, shared_ptr<Body_buffer> body, size_t remaining, body_ready_fn const& fn)
+{
+    if (remaining == 0)
+    {
+        body->seal();
+        fn(session);
+        return;
+    }
+
+    size_t length = std::min(remaining, fetch_chunk_size);
+
+    session->fetch(length, [body, remaining, length, fn](const shared_ptr<Session> session, const Bytes& data) {
+        body->append(data.data(), data.size());
+        fetch_next(session, body, remaining - length, fn);
+    });
+}
+
+shared_ptr<Body_buffer> make_body_buffer()
+{
+    auto app_config = App_config::get_instance();
+
+    return std::make_shared<Body_buffer>(app_config->get_body_spill_threshold(), app_config->get_body_temp_dir());
+}
+
+void fetch_body(const shared_ptr<Session> session, shared_ptr<Body_buffer> body, body_ready_fn const& fn)
+{
+    auto request = session->get_request();
+
+    // not forwarded as an empty body
+    string transfer_encoding = request->get_header("Transfer-Encoding", string());
+    if (!transfer_encoding.empty() && !Header_store::iequals(transfer_encoding, "identity"))
+    {
+        session->close(restbed::LENGTH_REQUIRED, "", {{"Content-Length", "0"}, {"Connection", "close"}});
+        return;
+    }
+
+    size_t content_length = request->get_header("Content-Length", size_t(0));
+
+    // the spill file would grow to whatever the client claims
+    if (content_length > App_config::get_instance()->get_body_max_size())
+    {
+        session->close(restbed::REQUEST_ENTITY_TOO_LARGE, "", {{"Content-Length", "0"}, {"Connection", "close"}});
+        return;
+    }
+
+    fetch_next(session, body, content_length, fn);
+}
+
+} // namespace restserver
+} // namespace imp
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <imp/restserver/metrics_service.h>
+#include <imp/upstream/async_engine.h>
+#include <imp/upstream/bulkhead.h>
+#include <imp/upstream/request_coalescer.h>
+#include <imp/upstream/response_cache.h>
+#include <imp/upstream/upstream_metrics.h>
+
+using imp::upstream::Async_engine;
+using imp::upstream::Bulkhead;
+using imp::upstream::Request_coalescer;
+using imp::upstream::Response_cache;
+using imp::upstream::Upstream_metrics;
+using restbed::Resource;
+using restbed::Service;
+using restbed::Session;
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+
+namespace imp
+{
+namespace restserver
+{
+
+Metrics_service::Metrics_service(Service& service, string const& path)
+: m_resource(make_shared<Resource>())
+{
+    m_resource->set_path(path);
+    m_resource->set_method_handler("GET", get_handler);
+
+    service.publish(m_resource);
+}
+
+void Metrics_service::get_handler(const shared_ptr<Session> session)
+{
+    string body = Upstream_metrics::get_instance()->get_text();
+    body.append(Request_coalescer::get_instance()->get_text());
+    body.append(Response_cache::get_instance()->get_text());
+    body.append(Bulkhead::get_instance()->get_text());
+    body.append(Async_engine::get_instance()->get_text());
+
+    session->close(restbed::OK, body, {{"Content-Type", "text/plain; version=0.0.4"}, {"Content-Length", std::to_string(body.size())}});
+}
+
+} // namespace restserver
+} // namespace imp
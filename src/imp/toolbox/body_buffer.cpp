@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <imp/app/error.h>
+#include <imp/toolbox/body_buffer.h>
+
+using imp::app::application_error;
+using std::string;
+
+namespace imp
+{
+namespace toolbox
+{
+
+Body_buffer::Body_buffer(size_t spill_threshold, string const& temp_dir)
+: m_spill_threshold(spill_threshold)
+, m_temp_dir(temp_dir)
+, m_memory()
+, m_fd(-1)
+, m_size(0)
+, m_map(nullptr)
+, m_sealed(false)
+{
+}
+
+Body_buffer::Body_buffer(Body_buffer&& other)
+: m_spill_threshold(other.m_spill_threshold)
+, m_temp_dir(std::move(other.m_temp_dir))
+, m_memory(std::move(other.m_memory))
+, m_fd(other.m_fd)
+, m_size(other.m_size)
+, m_map(other.m_map)
+, m_sealed(other.m_sealed)
+{
+    other.m_fd = -1;
+    other.m_size = 0;
+    other.m_map = nullptr;
+    other.m_sealed = false;
+}
+
+Body_buffer& Body_buffer::operator=(Body_buffer&& other)
+{
+    if (this != &other)
+    {
+        release();
+
+        m_spill_threshold = other.m_spill_threshold;
+        m_temp_dir = std::move(other.m_temp_dir);
+        m_memory = std::move(other.m_memory);
+        m_fd = other.m_fd;
+        m_size = other.m_size;
+        m_map = other.m_map;
+        m_sealed = other.m_sealed;
+
+        other.m_fd = -1;
+        other.m_size = 0;
+        other.m_map = nullptr;
+        other.m_sealed = false;
+    }
+
+    return *this;
+}
+
+Body_buffer::~Body_buffer()
+{
+    release();
+}
+
+void Body_buffer::append(const void* data, size_t size)
+{
+    if (m_sealed)
+    {
+        throw application_error("ERR_BODY_BUFFER_SEALED");
+    }
+
+    if (size == 0)
+    {
+        return;
+    }
+
+    if (m_fd < 0 && m_size + size > m_spill_threshold)
+    {
+        spill();
+    }
+
+    if (m_fd < 0)
+    {
+        const char* p = static_cast<const char*>(data);
+        m_memory.insert(m_memory.end(), p, p + size);
+    }
+    else
+    {
+        write_fd(data, size);
+    }
+
+    m_size += size;
+}
+
+void Body_buffer::assign(string const& data)
+{
+    clear();
+    append(data.data(), data.size());
+}
+
+void Body_buffer::seal()
+{
+    if (m_sealed)
+    {
+        return;
+    }
+
+    if (m_fd >= 0 && m_size > 0)
+    {
+        m_map = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+        if (m_map == MAP_FAILED)
+        {
+            m_map = nullptr;
+            throw application_error("ERR_BODY_BUFFER_MMAP: " + string(strerror(errno)));
+        }
+
+        // read once from the start, by the digest and again by the upload
+        madvise(m_map, m_size, MADV_SEQUENTIAL);
+    }
+
+    m_sealed = true;
+}
+
+const char* Body_buffer::data() const
+{
+    if (m_fd >= 0)
+    {
+        if (!m_sealed)
+        {
+            throw application_error("ERR_BODY_BUFFER_NOT_SEALED");
+        }
+        return static_cast<const char*>(m_map);
+    }
+
+    return m_memory.data();
+}
+
+size_t Body_buffer::size() const
+{
+    return m_size;
+}
+
+bool Body_buffer::empty() const
+{
+    return m_size == 0;
+}
+
+bool Body_buffer::is_spilled() const
+{
+    return m_fd >= 0;
+}
+
+void Body_buffer::clear()
+{
+    release();
+
+    m_memory.clear();
+    m_size = 0;
+    m_sealed = false;
+}
+
+/**
+ *  Moves the in-memory part to a new temporary file. The file is unlinked right away,
+ *  so it is gone with the descriptor, even if the process crashes.
+ */
+void Body_buffer::spill()
+{
+    string path = m_temp_dir;
+    if (path.empty() || path.back() != '/')
+    {
+        path.append("/");
+    }
+    path.append("scall-body-XXXXXX");
+
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+
+    m_fd = mkostemp(name.data(), O_CLOEXEC);
+    if (m_fd < 0)
+    {
+        throw application_error("ERR_BODY_BUFFER_TEMP_FILE: " + path + " " + strerror(errno));
+    }
+    unlink(name.data());
+
+    write_fd(m_memory.data(), m_memory.size());
+
+    std::vector<char>().swap(m_memory);
+}
+
+void Body_buffer::write_fd(const void* data, size_t size)
+{
+    const char* p = static_cast<const char*>(data);
+
+    while (size > 0)
+    {
+        ssize_t written = write(m_fd, p, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw application_error("ERR_BODY_BUFFER_WRITE: " + string(strerror(errno)));
+        }
+
+        p += written;
+        size -= written;
+    }
+}
+
+void Body_buffer::release()
+{
+    if (m_map)
+    {
+        munmap(m_map, m_size);
+        m_map = nullptr;
+    }
+
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+} // namespace toolbox
+} // namespace imp
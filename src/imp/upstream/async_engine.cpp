@@ -0,0 +1,1239 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <strings.h>
+#include <utility>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/app/app_config.h>
+#include <imp/app/error.h>
+#include <imp/upstream/async_engine.h>
+#include <imp/upstream/buffer_pool.h>
+#include <imp/upstream/bulkhead.h>
+#include <imp/upstream/circuit_breaker.h>
+#include <imp/upstream/hedge_policy.h>
+#include <imp/upstream/request_coalescer.h>
+#include <imp/upstream/response_cache.h>
+#include <imp/upstream/retry_policy.h>
+#include <imp/upstream/upstream_metrics.h>
+
+using imp::app::App_config;
+using imp::app::application_error;
+using std::lock_guard;
+using std::make_shared;
+using std::make_unique;
+using std::mutex;
+using std::string;
+using std::unique_ptr;
+using std::chrono::steady_clock;
+
+namespace imp
+{
+namespace upstream
+{
+
+// epoll_wait upper limit, when curl has no timer running
+static const int idle_wait_ms = 1000;
+static const int max_events = 64;
+
+// how often the active calls are checked for a disconnected client
+static const std::chrono::milliseconds sweep_interval(1000);
+
+/**
+ *  The target with the path, and the query of a call, for the coalescing and cache keys.
+ */
+static std::pair<string, string> split_uri(Async_call const& call)
+{
+    auto pos = call.uri.find('?');
+    string path = call.connection.get_key().base_url + call.uri.substr(0, pos);
+    string query = (pos == string::npos) ? string() : call.uri.substr(pos + 1);
+
+    return {path, query};
+}
+
+/**
+ *  An answer, which did not come from the call's own transfer, into its header store.
+ */
+static void fill_headers(Header_store& store, RestClient::HeaderFields const& headers)
+{
+    store.clear();
+
+    for (auto const& [name, value] : headers)
+    {
+        string line = name + ": " + value + "\r\n";
+        store.append_line(line.data(), line.size());
+    }
+}
+
+/**
+ *  The completion of a call joining an identical one, the coalescer gives the
+ *  headers in the response.
+ */
+static completion_fn make_waiter(Async_call const& call)
+{
+    return [on_complete = call.on_complete, headers = call.headers](RestClient::Response& response)
+    {
+        if (headers)
+        {
+            fill_headers(*headers, response.headers);
+        }
+
+        if (on_complete)
+        {
+            on_complete(response);
+        }
+    };
+}
+
+/**
+ *  The completion of a call going through the cache: a 304 answer to the revalidation
+ *  of the stale entry is turned back into the stored response, any other one is stored
+ *  (if the target allows it).
+ */
+static completion_fn make_cache_completion(string const& key, Async_call const& call, std::shared_ptr<const Cached_response> const& stale)
+{
+    return [key, request_headers = call.request_headers, headers = call.headers, stale, on_complete = call.on_complete](RestClient::Response& response)
+    {
+        auto cache = Response_cache::get_instance();
+
+        if (stale && response.code == 304)
+        {
+            RestClient::Response not_modified{response.code, {}, headers ? headers->to_multimap() : response.headers};
+            response = cache->revalidate(key, request_headers, *stale, not_modified);
+
+            if (headers)
+            {
+                fill_headers(*headers, response.headers);
+            }
+        }
+        else if (headers)
+        {
+            cache->store(key, request_headers, RestClient::Response{response.code, response.body, headers->to_multimap()});
+        }
+        else
+        {
+            cache->store(key, request_headers, response);
+        }
+
+        if (on_complete)
+        {
+            on_complete(response);
+        }
+    };
+}
+
+/**
+ *  Collects the headers of a not streamed call. The body is pre-sized from the
+ *  Content-Length, so large responses are not grown append by append.
+ */
+static size_t header_callback(void* data, size_t size, size_t nmemb, void* userdata)
+{
+    Async_call* call = static_cast<Async_call*>(userdata);
+    const char* line = static_cast<const char*>(data);
+    size_t length = size * nmemb;
+
+    if (call->headers)
+    {
+        call->headers->append_line(line, length);
+    }
+    else
+    {
+        RestClient::Helpers::header_callback(data, size, nmemb, &call->response);
+    }
+
+    static const size_t name_length = sizeof("content-length:") - 1;
+    if (length > name_length && strncasecmp(line, "content-length:", name_length) == 0)
+    {
+        Buffer_pool::reserve(call->response.body, strtoull(line + name_length, nullptr, 10));
+    }
+
+    return length;
+}
+
+// the client went away, and no coalesced call waits for the answer either
+static bool is_abandoned(Async_call const& call)
+{
+    if (!call.disconnected || !call.disconnected->load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+
+    return call.flight.empty() || !Request_coalescer::get_instance()->has_waiters(call.flight);
+}
+
+// the pooled connection may be used later without the engine (and this call)
+static void detach_progress(CURL* handle)
+{
+    curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 1L);
+}
+
+Async_call::Async_call(Pooled_connection&& connection)
+: connection(std::move(connection))
+, endpoint()
+, method("GET")
+, uri()
+, request_headers()
+, body(App_config::get_instance()->get_body_spill_threshold(), App_config::get_instance()->get_body_temp_dir())
+, response()
+, stream(nullptr)
+, headers(nullptr)
+, identity(this->connection.get_key().identity)
+, idempotent(false)
+, attempt(0)
+, deadline()
+, disconnected(nullptr)
+, flight()
+, on_sign(nullptr)
+, on_complete(nullptr)
+, is_hedge(false)
+, peer(nullptr)
+{
+}
+
+Async_engine::Async_engine()
+: m_multi(nullptr)
+, m_epoll_fd(-1)
+, m_wakeup_fd(-1)
+, m_timer()
+, m_max_connections(0)
+, m_max_concurrent_streams(100)
+, m_next_sweep()
+, m_running(false)
+, m_in_flight(0)
+, m_cancelled(0)
+{
+}
+
+Async_engine::~Async_engine()
+{
+    stop();
+}
+
+Async_engine* Async_engine::get_instance()
+{
+    static std::unique_ptr<Async_engine> m_instance(new Async_engine);
+    return m_instance.get();
+}
+
+void Async_engine::start()
+{
+    if (m_running)
+    {
+        return;
+    }
+
+    m_multi = curl_multi_init();
+    if (!m_multi)
+    {
+        throw application_error("ERR_UPSTREAM_CURL_MULTI_INIT");
+    }
+
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epoll_fd < 0 || m_wakeup_fd < 0)
+    {
+        throw application_error("ERR_UPSTREAM_EVENT_LOOP_INIT: " + std::string(strerror(errno)));
+    }
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = m_wakeup_fd;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wakeup_fd, &ev);
+
+    curl_multi_setopt(m_multi, CURLMOPT_SOCKETFUNCTION, Async_engine::socket_callback);
+    curl_multi_setopt(m_multi, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(m_multi, CURLMOPT_TIMERFUNCTION, Async_engine::timer_callback);
+    curl_multi_setopt(m_multi, CURLMOPT_TIMERDATA, this);
+    if (m_max_connections > 0)
+    {
+        curl_multi_setopt(m_multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, m_max_connections);
+    }
+
+    // the streams of one h2 connection are shared by the transfers having CURLOPT_PIPEWAIT
+    curl_multi_setopt(m_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#if LIBCURL_VERSION_NUM >= 0x074300
+    if (m_max_concurrent_streams > 0)
+    {
+        curl_multi_setopt(m_multi, CURLMOPT_MAX_CONCURRENT_STREAMS, m_max_concurrent_streams);
+    }
+#endif
+
+    m_timer.reset();
+    m_running = true;
+    m_thread = std::thread(&Async_engine::run, this);
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    LOG4CPLUS_INFO(logger, "Async upstream engine started");
+}
+
+void Async_engine::stop()
+{
+    if (!m_running)
+    {
+        return;
+    }
+
+    m_running = false;
+    wakeup();
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+
+    // they would be admitted by the permits released below, only to be refused
+    Bulkhead::get_instance()->reject_waiting(503);
+
+    abort_all();
+
+    curl_multi_cleanup(m_multi);
+    m_multi = nullptr;
+
+    close(m_wakeup_fd);
+    close(m_epoll_fd);
+    m_wakeup_fd = -1;
+    m_epoll_fd = -1;
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    LOG4CPLUS_INFO(logger, "Async upstream engine stopped");
+}
+
+bool Async_engine::is_running() const
+{
+    return m_running;
+}
+
+/**
+ *  Hands over a call to the event loop. Returns immediately, the result is delivered
+ *  through the call's on_complete callback on the engine thread.
+ *
+ *  A not streamed GET is answered from the Response_cache if it can be, right here on
+ *  the calling thread, without being signed. One, which is identical to a call in flight, is not sent: it gets
+ *  a copy of that answer, on the thread completing the other one. The others are subject
+ *  to the Bulkhead of their identity, a rejected call is completed with its status.
+ */
+void Async_engine::submit(unique_ptr<Async_call> call)
+{
+    if (!m_running)
+    {
+        throw application_error("ERR_UPSTREAM_ENGINE_NOT_RUNNING");
+    }
+
+    std::optional<string> cache_key;
+    std::shared_ptr<const Cached_response> stale;
+
+    auto cache = Response_cache::get_instance();
+    if (!call->stream && cache->is_cacheable(call->method))
+    {
+        auto [path, query] = split_uri(*call);
+        cache_key = cache->make_key(path, query, call->identity);
+
+        auto found = cache->lookup(*cache_key, call->request_headers);
+        if (found.status == Response_cache::Status::fresh)
+        {
+            RestClient::Response response = found.entry->response;
+            if (call->headers)
+            {
+                fill_headers(*call->headers, response.headers);
+            }
+            if (call->on_complete)
+            {
+                call->on_complete(response);
+            }
+            return;
+        }
+
+        if (found.status == Response_cache::Status::stale)
+        {
+            stale = found.entry;
+        }
+    }
+
+    std::optional<Flight_guard> flight;
+
+    auto coalescer = Request_coalescer::get_instance();
+    if (!call->stream && coalescer->is_coalescable(call->method))
+    {
+        auto [path, query] = split_uri(*call);
+        string key = coalescer->make_key(call->method, path, query, call->identity, call->request_headers);
+
+        if (coalescer->join(key, make_waiter(*call)))
+        {
+            return;
+        }
+
+        flight.emplace(key);
+        call->flight = key;
+        call->on_complete = coalescer->lead(key, call->on_complete, call->headers);
+    }
+
+    // before the coalesced waiters get the answer, a 304 is turned into the stored one
+    if (cache_key)
+    {
+        call->on_complete = make_cache_completion(*cache_key, *call, stale);
+
+        if (stale)
+        {
+            for (auto const& header : cache->get_conditional_headers(*stale))
+            {
+                call->request_headers.insert(header);
+            }
+        }
+    }
+
+    admit(std::move(call));
+
+    if (flight)
+    {
+        flight->release();
+    }
+}
+
+/**
+ *  The call is sent, once its identity has a free slot in the Bulkhead. The slot is held
+ *  until the call is completed (with its retries and hedge). A waiting call holds no
+ *  thread, it is sent from the thread releasing a slot. It is signed only then, by
+ *  add_call(), so its Date does not age in the queue.
+ */
+void Async_engine::admit(unique_ptr<Async_call> call)
+{
+    auto bulkhead = Bulkhead::get_instance();
+    if (!bulkhead->is_enabled())
+    {
+        enqueue(std::move(call));
+        return;
+    }
+
+    string identity = call->identity;
+    auto deadline = call->deadline;
+
+    // std::function needs a copyable capture
+    auto holder = make_shared<unique_ptr<Async_call>>(std::move(call));
+
+    bulkhead->acquire(
+        identity,
+        [this, holder](std::shared_ptr<Bulkhead_permit> permit)
+        {
+            auto& call = *holder;
+            call->on_complete = [permit, on_complete = call->on_complete](RestClient::Response& response)
+            {
+                if (on_complete)
+                {
+                    on_complete(response);
+                }
+            };
+            enqueue(std::move(call));
+        },
+        [holder](int status)
+        {
+            auto& call = *holder;
+            call->response.code = status;
+            call->response.body = "Upstream call rejected by the bulkhead";
+            if (call->on_complete)
+            {
+                call->on_complete(call->response);
+            }
+        },
+        deadline);
+}
+
+/**
+ *  Once the engine is stopping, the call is completed with CURLE_ABORTED_BY_CALLBACK:
+ *  e.g. one admitted by the Bulkhead, when abort_all() releases the permits.
+ */
+void Async_engine::enqueue(unique_ptr<Async_call> call)
+{
+    {
+        // checked under the lock, abort_all() takes the pending calls under it, after
+        // m_running is cleared
+        lock_guard<mutex> lock(m_mutex);
+        if (m_running)
+        {
+            m_pending.push_back(std::move(call));
+            ++m_in_flight;
+        }
+    }
+
+    if (call)
+    {
+        call->response.code = CURLE_ABORTED_BY_CALLBACK;
+        call->response.body = curl_easy_strerror(CURLE_ABORTED_BY_CALLBACK);
+        if (call->on_complete)
+        {
+            call->on_complete(call->response);
+        }
+        return;
+    }
+
+    // every first attempt earns a part of a retry
+    Retry_policy::get_instance()->on_request();
+
+    wakeup();
+}
+
+size_t Async_engine::get_in_flight() const
+{
+    return m_in_flight;
+}
+
+string Async_engine::get_text() const
+{
+    std::ostringstream os;
+
+    os << "# TYPE scall_upstream_in_flight gauge\n";
+    os << "scall_upstream_in_flight " << m_in_flight.load() << "\n";
+    os << "# TYPE scall_upstream_cancelled_total counter\n";
+    os << "scall_upstream_cancelled_total " << m_cancelled.load(std::memory_order_relaxed) << "\n";
+
+    return os.str();
+}
+
+void Async_engine::resume(CURL* handle)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_resumed.push_back(handle);
+    }
+
+    wakeup();
+}
+
+void Async_engine::set_max_connections(long max_connections)
+{
+    m_max_connections = max_connections;
+}
+
+void Async_engine::set_max_concurrent_streams(long max_streams)
+{
+    m_max_concurrent_streams = max_streams;
+}
+
+void Async_engine::wakeup()
+{
+    uint64_t one = 1;
+    if (write(m_wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+        LOG4CPLUS_ERROR(logger, "Async upstream engine wakeup failed: " << strerror(errno));
+    }
+}
+
+void Async_engine::run()
+{
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    struct epoll_event events[max_events];
+    int running_handles = 0;
+
+    while (m_running)
+    {
+        int wait_ms = idle_wait_ms;
+        if (m_timer)
+        {
+            // rounded up, not to spin before it is due
+            auto until = std::chrono::ceil<std::chrono::milliseconds>(*m_timer - steady_clock::now()).count();
+            wait_ms = static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(wait_ms, until)));
+        }
+        if (!m_active.empty())
+        {
+            wait_ms = std::min<int>(wait_ms, static_cast<int>(sweep_interval.count()));
+        }
+        if (!m_delayed.empty())
+        {
+            auto until = std::chrono::duration_cast<std::chrono::milliseconds>(m_delayed.begin()->first - steady_clock::now()).count();
+            wait_ms = static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(wait_ms, until)));
+        }
+        if (!m_hedge_timers.empty())
+        {
+            auto until = std::chrono::duration_cast<std::chrono::milliseconds>(m_hedge_timers.begin()->first - steady_clock::now()).count();
+            wait_ms = static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(wait_ms, until)));
+        }
+
+        int n = epoll_wait(m_epoll_fd, events, max_events, wait_ms);
+
+        if (n < 0)
+        {
+            if (errno != EINTR)
+            {
+                LOG4CPLUS_ERROR(logger, "epoll_wait failed: " << strerror(errno));
+            }
+            continue;
+        }
+
+        add_delayed();
+        send_hedges();
+
+        for (int i = 0; i < n; ++i)
+        {
+            if (events[i].data.fd == m_wakeup_fd)
+            {
+                uint64_t count;
+                while (read(m_wakeup_fd, &count, sizeof(count)) > 0)
+                {
+                }
+                add_pending();
+                resume_paused();
+                continue;
+            }
+
+            int flags = 0;
+            if (events[i].events & EPOLLIN)
+                flags |= CURL_CSELECT_IN;
+            if (events[i].events & EPOLLOUT)
+                flags |= CURL_CSELECT_OUT;
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+                flags |= CURL_CSELECT_ERR;
+
+            curl_multi_socket_action(m_multi, events[i].data.fd, flags, &running_handles);
+        }
+
+        // also under steady socket traffic: the transfer timeouts, and the start of the
+        // handles just added (curl asks for a 0 ms timeout) depend on it
+        if (m_timer && steady_clock::now() >= *m_timer)
+        {
+            // curl sets the next one from inside the call
+            m_timer.reset();
+            curl_multi_socket_action(m_multi, CURL_SOCKET_TIMEOUT, 0, &running_handles);
+        }
+
+        check_finished();
+        cancel_abandoned();
+    }
+}
+
+void Async_engine::add_pending()
+{
+    std::deque<unique_ptr<Async_call>> pending;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        pending.swap(m_pending);
+    }
+
+    for (auto& call : pending)
+    {
+        add_call(std::move(call));
+    }
+}
+
+// retries, which waited out their backoff
+void Async_engine::add_delayed()
+{
+    auto now = steady_clock::now();
+
+    while (!m_delayed.empty() && m_delayed.begin()->first <= now)
+    {
+        auto call = std::move(m_delayed.begin()->second);
+        m_delayed.erase(m_delayed.begin());
+
+        add_call(std::move(call));
+    }
+}
+
+/**
+ *  @return The handle of the transfer, nullptr if it could not be started
+ */
+CURL* Async_engine::add_call(unique_ptr<Async_call> call)
+{
+    CURL* handle = nullptr;
+
+    // the target is down, no point to wait for its timeout
+    if (!Circuit_breaker::get_instance()->allow(call->connection.get_key().base_url))
+    {
+        if (!call->is_hedge)
+        {
+            call->response.code = 503;
+            call->response.body = "Upstream circuit open";
+            if (call->on_complete)
+            {
+                call->on_complete(call->response);
+            }
+        }
+        --m_in_flight;
+        return nullptr;
+    }
+
+    // nobody waits for the answer any more, not worth to sign and send it (the first
+    // attempt is not signed yet either, see on_sign)
+    if (Deadline_policy::is_expired(call->deadline))
+    {
+        if (!call->is_hedge)
+        {
+            call->response.code = 504;
+            call->response.body = "Deadline exceeded";
+            if (call->on_complete)
+            {
+                call->on_complete(call->response);
+            }
+        }
+        --m_in_flight;
+        return nullptr;
+    }
+
+    // the client went away while the call was queued or backing off
+    if (is_abandoned(*call))
+    {
+        if (!call->is_hedge)
+        {
+            m_cancelled.fetch_add(1, std::memory_order_relaxed);
+            call->response.code = CURLE_ABORTED_BY_CALLBACK;
+            call->response.body = "Client disconnected";
+            if (call->on_complete)
+            {
+                call->on_complete(call->response);
+            }
+        }
+        --m_in_flight;
+        return nullptr;
+    }
+
+    try
+    {
+        // signed only now, so the Date is fresh even after waiting in the bulkhead or a backoff
+        if (call->on_sign)
+        {
+            call->on_sign(*call);
+        }
+        ++call->attempt;
+
+        call->connection->SetRequestHeaders(call->request_headers);
+        call->body.seal();
+        call->response.body = Buffer_pool::acquire();
+        if (call->deadline)
+        {
+            // at least 1 ms, 0 would mean no limit
+            auto remaining = Deadline_policy::get_remaining(*call->deadline);
+            call->connection->SetRequestTimeoutMs(static_cast<int>(std::max<int64_t>(1, remaining.count())));
+        }
+        handle = call->connection->PrepareRequest(call->method, call->uri, call->body.data(), call->body.size(), &call->response);
+    }
+    catch (std::exception const& exc)
+    {
+        // e.g. terminated connection
+        log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+        LOG4CPLUS_ERROR(logger, "Cannot prepare upstream call: " << exc.what());
+
+        // a failed hedge is dropped, the original call goes on
+        if (!call->is_hedge)
+        {
+            call->response.code = CURLE_FAILED_INIT;
+            call->response.body = exc.what();
+            if (call->on_complete)
+            {
+                call->on_complete(call->response);
+            }
+        }
+        --m_in_flight;
+        return nullptr;
+    }
+
+    if (call->stream)
+    {
+        call->stream->attach(handle, &call->response, [this, handle]() { resume(handle); }, call->disconnected);
+    }
+    else
+    {
+        if (call->headers)
+        {
+            call->headers->clear();
+        }
+        curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, header_callback);
+        curl_easy_setopt(handle, CURLOPT_HEADERDATA, call.get());
+    }
+
+    // checked by curl while the transfer moves, so the disconnect is noticed before the
+    // whole answer is read
+    if (call->disconnected)
+    {
+        curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, Async_engine::progress_callback);
+        curl_easy_setopt(handle, CURLOPT_XFERINFODATA, call.get());
+        curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+    }
+
+    // a hedge is armed for the first attempt of a not streamed call
+    auto hedge_policy = Hedge_policy::get_instance();
+    if (call->attempt == 1 && !call->is_hedge && !call->stream && !call->body.is_spilled() && hedge_policy->is_hedgeable(call->method))
+    {
+        string const& target = call->connection.get_key().base_url;
+        Upstream_metrics::get_instance()->get_hedge_metrics(target).candidates.fetch_add(1, std::memory_order_relaxed);
+
+        auto delay = hedge_policy->get_delay(target);
+        if (delay)
+        {
+            m_hedge_timers.emplace(steady_clock::now() + *delay, handle);
+        }
+    }
+
+    m_active[handle] = std::move(call);
+    curl_multi_add_handle(m_multi, handle);
+
+    return handle;
+}
+
+void Async_engine::resume_paused()
+{
+    std::deque<CURL*> resumed;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        resumed.swap(m_resumed);
+    }
+
+    for (auto handle : resumed)
+    {
+        // the transfer might be finished since
+        if (m_active.count(handle) != 0)
+        {
+            curl_easy_pause(handle, CURLPAUSE_CONT);
+        }
+    }
+}
+
+void Async_engine::check_finished()
+{
+    CURLMsg* msg;
+    int msgs_left;
+
+    while ((msg = curl_multi_info_read(m_multi, &msgs_left)))
+    {
+        if (msg->msg == CURLMSG_DONE)
+        {
+            // the message is invalidated by the handle removal
+            CURL* handle = msg->easy_handle;
+            CURLcode result = msg->data.result;
+
+            finish(handle, result);
+        }
+    }
+}
+
+/**
+ *  The progress callback is called only while the transfer moves; a target, which is
+ *  silent for long, is caught here.
+ */
+void Async_engine::cancel_abandoned()
+{
+    auto now = steady_clock::now();
+    if (now < m_next_sweep)
+    {
+        return;
+    }
+    m_next_sweep = now + sweep_interval;
+
+    std::vector<CURL*> abandoned;
+    for (auto const& [handle, call] : m_active)
+    {
+        if (is_abandoned(*call))
+        {
+            abandoned.push_back(handle);
+        }
+    }
+
+    // a hedged pair may go at once, through the first one
+    for (auto handle : abandoned)
+    {
+        if (m_active.count(handle) != 0)
+        {
+            finish(handle, CURLE_ABORTED_BY_CALLBACK);
+        }
+    }
+}
+
+void Async_engine::finish(CURL* handle, CURLcode result)
+{
+    curl_multi_remove_handle(m_multi, handle);
+
+    auto it = m_active.find(handle);
+    if (it == m_active.end())
+    {
+        return;
+    }
+
+    auto call = std::move(it->second);
+    m_active.erase(it);
+
+    if (call->disconnected)
+    {
+        detach_progress(handle);
+    }
+
+    call->connection->CompleteRequest(result, &call->response);
+
+    // the client went away: no retry, and the target is not blamed for it
+    if (result != CURLE_OK && is_abandoned(*call))
+    {
+        call->connection.discard();
+        remove_hedge_timer(handle);
+
+        if (call->peer)
+        {
+            cancel(call->peer);
+            call->peer = nullptr;
+        }
+
+        m_cancelled.fetch_add(1, std::memory_order_relaxed);
+        call->response.code = CURLE_ABORTED_BY_CALLBACK;
+        call->response.body = "Client disconnected";
+
+        try
+        {
+            if (call->on_complete)
+            {
+                call->on_complete(call->response);
+            }
+        }
+        catch (std::exception const& exc)
+        {
+            log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+            LOG4CPLUS_ERROR(logger, "Upstream completion handler failed: " << exc.what());
+        }
+
+        Buffer_pool::release(std::move(call->response.body));
+        --m_in_flight;
+        return;
+    }
+
+    call->connection.record();
+    if (result != CURLE_ABORTED_BY_CALLBACK)
+    {
+        Circuit_breaker::get_instance()->record(call->connection.get_key().base_url, call->response);
+
+        if (call->endpoint)
+        {
+            call->endpoint->observe(static_cast<uint64_t>(call->connection->GetLastRequestInfo().totalTime * 1000000.0));
+        }
+    }
+
+    if (result != CURLE_OK)
+    {
+        // connection state is unknown, not worth to keep
+        call->connection.discard();
+    }
+
+    remove_hedge_timer(handle);
+
+    // hedged: the first usable answer wins, a failed one leaves it to the other transfer
+    if (call->peer)
+    {
+        auto peer = m_active.find(call->peer);
+        if (peer != m_active.end())
+        {
+            if (Retry_policy::get_instance()->is_retryable(call->response))
+            {
+                // the call is still in progress through the other transfer, which now
+                // completes it (on its retries and early exits as well)
+                if (call->endpoint)
+                {
+                    peer->second->endpoint = std::move(call->endpoint);
+                }
+                peer->second->peer = nullptr;
+                peer->second->is_hedge = false;
+                Buffer_pool::release(std::move(call->response.body));
+                --m_in_flight;
+                return;
+            }
+
+            cancel(call->peer);
+
+            if (call->is_hedge)
+            {
+                Upstream_metrics::get_instance()->get_hedge_metrics(call->connection.get_key().base_url).won.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        call->peer = nullptr;
+    }
+
+    if (retry(call))
+    {
+        return;
+    }
+
+    try
+    {
+        if (call->on_complete)
+        {
+            call->on_complete(call->response);
+        }
+    }
+    catch (std::exception const& exc)
+    {
+        log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+        LOG4CPLUS_ERROR(logger, "Upstream completion handler failed: " << exc.what());
+    }
+
+    // unless the handler took it over
+    Buffer_pool::release(std::move(call->response.body));
+
+    --m_in_flight;
+}
+
+/**
+ *  Puts the call back after its backoff, if the policy allows another attempt.
+ *  A streamed call is retried only until something was sent to the client, a call
+ *  with a deadline only if the backoff ends before it.
+ *
+ *  @return true, if the call was taken over for a retry
+ */
+bool Async_engine::retry(unique_ptr<Async_call>& call)
+{
+    auto policy = Retry_policy::get_instance();
+
+    if (!m_running
+        || !policy->is_repeatable(call->method, call->idempotent)
+        || !policy->is_retryable(call->response)
+        || (call->stream && call->stream->is_headers_sent())
+        || Deadline_policy::is_expired(call->deadline)
+        || !policy->try_retry(call->attempt))
+    {
+        return false;
+    }
+
+    auto backoff = policy->get_backoff(call->attempt);
+
+    if (call->deadline && steady_clock::now() + backoff >= *call->deadline)
+    {
+        return false;
+    }
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    LOG4CPLUS_DEBUG(logger, "Retrying upstream call " << call->method << " " << call->uri << " (code " << call->response.code << ", attempt " << call->attempt << ") in " << backoff.count() << " ms");
+
+    // discarded after a transport error
+    if (!call->connection.get())
+    {
+        Pool_key key = call->connection.get_key();
+        call->connection = Connection_pool::get_instance()->acquire(key);
+    }
+
+    Buffer_pool::release(std::move(call->response.body));
+    call->response = RestClient::Response();
+
+    m_delayed.emplace(steady_clock::now() + backoff, std::move(call));
+
+    return true;
+}
+
+void Async_engine::send_hedges()
+{
+    auto now = steady_clock::now();
+
+    while (!m_hedge_timers.empty() && m_hedge_timers.begin()->first <= now)
+    {
+        CURL* handle = m_hedge_timers.begin()->second;
+        m_hedge_timers.erase(m_hedge_timers.begin());
+
+        auto it = m_active.find(handle);
+        if (it != m_active.end() && !it->second->peer && Hedge_policy::get_instance()->try_hedge(it->second->connection.get_key().base_url))
+        {
+            send_hedge(handle, *it->second);
+        }
+    }
+}
+
+/**
+ *  Starts the second copy of a call on another connection. It has its own response
+ *  and headers, which are handed to the original completion handler if it wins.
+ */
+void Async_engine::send_hedge(CURL* handle, Async_call& call)
+{
+    auto hedge = make_unique<Async_call>(Connection_pool::get_instance()->acquire(call.connection.get_key()));
+
+    hedge->method = call.method;
+    hedge->uri = call.uri;
+    hedge->request_headers = call.request_headers;
+    hedge->body.append(call.body.data(), call.body.size());
+    hedge->idempotent = call.idempotent;
+    hedge->attempt = call.attempt;
+    hedge->deadline = call.deadline;
+    hedge->disconnected = call.disconnected;
+    hedge->flight = call.flight;
+    hedge->on_sign = call.on_sign;
+    hedge->is_hedge = true;
+    hedge->peer = handle;
+
+    if (call.headers)
+    {
+        hedge->headers = make_shared<Header_store>();
+    }
+
+    hedge->on_complete = [on_complete = call.on_complete, headers = call.headers, own_headers = hedge->headers](RestClient::Response& response)
+    {
+        if (headers && own_headers)
+        {
+            *headers = std::move(*own_headers);
+        }
+
+        if (on_complete)
+        {
+            on_complete(response);
+        }
+    };
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    LOG4CPLUS_DEBUG(logger, "Hedging upstream call " << call.method << " " << call.uri);
+
+    ++m_in_flight;
+
+    CURL* hedge_handle = add_call(std::move(hedge));
+    if (hedge_handle)
+    {
+        call.peer = hedge_handle;
+    }
+}
+
+// stops the losing transfer of a hedged pair, without completing it
+void Async_engine::cancel(CURL* handle)
+{
+    curl_multi_remove_handle(m_multi, handle);
+
+    auto it = m_active.find(handle);
+    if (it == m_active.end())
+    {
+        return;
+    }
+
+    auto call = std::move(it->second);
+    m_active.erase(it);
+
+    remove_hedge_timer(handle);
+
+    if (call->disconnected)
+    {
+        detach_progress(handle);
+    }
+
+    call->connection->CompleteRequest(CURLE_ABORTED_BY_CALLBACK, &call->response);
+    call->connection.discard();
+
+    Buffer_pool::release(std::move(call->response.body));
+
+    --m_in_flight;
+}
+
+void Async_engine::remove_hedge_timer(CURL* handle)
+{
+    for (auto it = m_hedge_timers.begin(); it != m_hedge_timers.end();)
+    {
+        if (it->second == handle)
+        {
+            it = m_hedge_timers.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void Async_engine::abort_all()
+{
+    while (!m_active.empty())
+    {
+        finish(m_active.begin()->first, CURLE_ABORTED_BY_CALLBACK);
+    }
+
+    std::deque<unique_ptr<Async_call>> pending;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        pending.swap(m_pending);
+    }
+
+    for (auto& delayed : m_delayed)
+    {
+        pending.push_back(std::move(delayed.second));
+    }
+    m_delayed.clear();
+    m_hedge_timers.clear();
+
+    for (auto& call : pending)
+    {
+        call->response.code = CURLE_ABORTED_BY_CALLBACK;
+        call->response.body = curl_easy_strerror(CURLE_ABORTED_BY_CALLBACK);
+        if (call->on_complete)
+        {
+            call->on_complete(call->response);
+        }
+        --m_in_flight;
+    }
+}
+
+/**
+ *  Aborts the transfer (CURLE_ABORTED_BY_CALLBACK), when the client went away.
+ */
+int Async_engine::progress_callback(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+    (void)dltotal;
+    (void)dlnow;
+    (void)ultotal;
+    (void)ulnow;
+
+    return is_abandoned(*static_cast<Async_call*>(clientp)) ? 1 : 0;
+}
+
+int Async_engine::socket_callback(CURL* handle, curl_socket_t socket, int what, void* userp, void* socketp)
+{
+    (void)handle;
+    (void)socketp;
+
+    Async_engine* engine = static_cast<Async_engine*>(userp);
+
+    if (what == CURL_POLL_REMOVE)
+    {
+        epoll_ctl(engine->m_epoll_fd, EPOLL_CTL_DEL, socket, nullptr);
+        return 0;
+    }
+
+    struct epoll_event ev = {};
+    ev.data.fd = socket;
+    if (what & CURL_POLL_IN)
+        ev.events |= EPOLLIN;
+    if (what & CURL_POLL_OUT)
+        ev.events |= EPOLLOUT;
+
+    if (epoll_ctl(engine->m_epoll_fd, EPOLL_CTL_MOD, socket, &ev) != 0 && errno == ENOENT)
+    {
+        epoll_ctl(engine->m_epoll_fd, EPOLL_CTL_ADD, socket, &ev);
+    }
+
+    return 0;
+}
+
+int Async_engine::timer_callback(CURLM* multi, long timeout_ms, void* userp)
+{
+    (void)multi;
+
+    Async_engine* engine = static_cast<Async_engine*>(userp);
+    // -1: the timer is deleted
+    if (timeout_ms < 0)
+    {
+        engine->m_timer.reset();
+    }
+    else
+    {
+        engine->m_timer = steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    }
+
+    return 0;
+}
+
+} // namespace upstream
+} // namespace imp
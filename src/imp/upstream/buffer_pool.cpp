@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <atomic>
+#include <vector>
+
+#include <imp/upstream/buffer_pool.h>
+
+using std::string;
+
+namespace imp
+{
+namespace upstream
+{
+
+static std::atomic<size_t> max_buffers(8);
+static std::atomic<size_t> max_capacity(8 * 1024 * 1024);
+
+static thread_local std::vector<string> free_buffers;
+
+string Buffer_pool::acquire()
+{
+    if (free_buffers.empty())
+    {
+        return string();
+    }
+
+    string buffer = std::move(free_buffers.back());
+    free_buffers.pop_back();
+
+    return buffer;
+}
+
+void Buffer_pool::release(string&& buffer)
+{
+    if (buffer.capacity() > max_capacity || free_buffers.size() >= max_buffers)
+    {
+        return;
+    }
+
+    buffer.clear();
+    free_buffers.push_back(std::move(buffer));
+}
+
+void Buffer_pool::set_limits(size_t buffers, size_t capacity)
+{
+    max_buffers = buffers;
+    max_capacity = capacity;
+}
+
+void Buffer_pool::reserve(string& buffer, size_t content_length)
+{
+    // the length comes from the target, not trusted above the cap
+    size_t size = (content_length < max_capacity) ? content_length : max_capacity.load();
+
+    if (buffer.capacity() < size)
+    {
+        buffer.reserve(size);
+    }
+}
+
+} // namespace upstream
+} // namespace imp
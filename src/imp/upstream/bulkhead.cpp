@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/crypto/key_store.h>
+#include <imp/upstream/bulkhead.h>
+
+using imp::crypto::Key_store;
+using std::lock_guard;
+using std::make_shared;
+using std::make_unique;
+using std::map;
+using std::mutex;
+using std::string;
+using std::vector;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace imp
+{
+namespace upstream
+{
+
+static string escape_label(string const& value)
+{
+    string result;
+    result.reserve(value.size());
+
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+        {
+            result.push_back('\\');
+            result.push_back(c);
+        }
+        else if (c == '\n')
+        {
+            result.append("\\n");
+        }
+        else
+        {
+            result.push_back(c);
+        }
+    }
+
+    return result;
+}
+
+Bulkhead_permit::Bulkhead_permit(Bulkhead* bulkhead, string const& identity)
+: m_bulkhead(bulkhead)
+, m_identity(identity)
+{
+}
+
+Bulkhead_permit::~Bulkhead_permit()
+{
+    if (m_bulkhead)
+    {
+        m_bulkhead->release(m_identity);
+    }
+}
+
+const string& Bulkhead_permit::get_identity() const
+{
+    return m_identity;
+}
+
+Bulkhead::Bulkhead()
+: m_enabled(false)
+, m_default_limits({16, 32})
+, m_limits()
+, m_queue_timeout(milliseconds(1000))
+, m_reject_status(429)
+{
+}
+
+Bulkhead* Bulkhead::get_instance()
+{
+    static std::unique_ptr<Bulkhead> m_instance(new Bulkhead);
+    return m_instance.get();
+}
+
+bool Bulkhead::is_enabled() const
+{
+    return m_enabled;
+}
+
+/**
+ *  @param client_identity The mTLS key id or signing key alias of the call (empty, or not a known
+ *                         one: these calls share one compartment)
+ */
+void Bulkhead::acquire(string const& client_identity, admit_fn const& on_admit, reject_fn const& on_reject, std::optional<deadline_t> const& deadline)
+{
+    string const identity = get_compartment_id(client_identity);
+
+    if (Deadline_policy::is_expired(deadline))
+    {
+        if (on_reject)
+        {
+            on_reject(504);
+        }
+        return;
+    }
+
+    if (!m_enabled)
+    {
+        on_admit(make_shared<Bulkhead_permit>(nullptr, identity));
+        return;
+    }
+
+    bool admitted = false;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+
+        Compartment& compartment = get_compartment(identity);
+
+        if (compartment.in_use < compartment.limits.max_concurrent)
+        {
+            ++compartment.in_use;
+            compartment.wait.record(0);
+            compartment.admitted.fetch_add(1, std::memory_order_relaxed);
+            admitted = true;
+        }
+        else if (compartment.queue.size() < compartment.limits.max_queue)
+        {
+            auto now = steady_clock::now();
+
+            Waiter waiter{now, now + m_queue_timeout, 503, on_admit, on_reject};
+            if (deadline && *deadline < waiter.expires)
+            {
+                waiter.expires = *deadline;
+                waiter.expired_status = 504;
+            }
+
+            compartment.queue.push_back(std::move(waiter));
+            return;
+        }
+        else
+        {
+            compartment.rejected.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // the handlers are called outside of the lock, the permit releases into it
+    if (admitted)
+    {
+        on_admit(make_shared<Bulkhead_permit>(this, identity));
+    }
+    else if (on_reject)
+    {
+        on_reject(m_reject_status);
+    }
+}
+
+void Bulkhead::expire_waiting()
+{
+    if (!m_enabled)
+    {
+        return;
+    }
+
+    auto now = steady_clock::now();
+    vector<std::pair<reject_fn, int>> expired;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+
+        for (auto& [identity, compartment] : m_compartments)
+        {
+            // the deadlines make it unordered, but the queues are short
+            for (auto it = compartment->queue.begin(); it != compartment->queue.end();)
+            {
+                if (now >= it->expires)
+                {
+                    expired.emplace_back(std::move(it->on_reject), it->expired_status);
+                    it = compartment->queue.erase(it);
+                    compartment->timed_out.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    for (auto const& [on_reject, status] : expired)
+    {
+        if (on_reject)
+        {
+            on_reject(status);
+        }
+    }
+}
+
+void Bulkhead::reject_waiting(int status)
+{
+    vector<reject_fn> rejected;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+
+        for (auto& [identity, compartment] : m_compartments)
+        {
+            for (auto& waiter : compartment->queue)
+            {
+                rejected.push_back(std::move(waiter.on_reject));
+            }
+            compartment->queue.clear();
+        }
+    }
+
+    for (auto const& on_reject : rejected)
+    {
+        if (on_reject)
+        {
+            on_reject(status);
+        }
+    }
+}
+
+milliseconds Bulkhead::get_queue_timeout() const
+{
+    return m_queue_timeout;
+}
+
+string Bulkhead::get_text() const
+{
+    std::ostringstream os;
+
+    lock_guard<mutex> lock(m_mutex);
+
+    os << "# TYPE scall_bulkhead_in_use gauge\n";
+    for (auto const& [identity, compartment] : m_compartments)
+    {
+        os << "scall_bulkhead_in_use{identity=\"" << escape_label(identity) << "\"} " << compartment->in_use << "\n";
+    }
+
+    os << "# TYPE scall_bulkhead_queue_depth gauge\n";
+    for (auto const& [identity, compartment] : m_compartments)
+    {
+        os << "scall_bulkhead_queue_depth{identity=\"" << escape_label(identity) << "\"} " << compartment->queue.size() << "\n";
+    }
+
+    os << "# TYPE scall_bulkhead_wait_seconds summary\n";
+    for (auto const& [identity, compartment] : m_compartments)
+    {
+        auto snapshot = compartment->wait.get_snapshot();
+        string labels = "identity=\"" + escape_label(identity) + "\"";
+
+        os << "scall_bulkhead_wait_seconds{" << labels << ",quantile=\"0.5\"} " << snapshot.p50_us / 1e6 << "\n";
+        os << "scall_bulkhead_wait_seconds{" << labels << ",quantile=\"0.99\"} " << snapshot.p99_us / 1e6 << "\n";
+        os << "scall_bulkhead_wait_seconds_sum{" << labels << "} " << snapshot.sum_us / 1e6 << "\n";
+        os << "scall_bulkhead_wait_seconds_count{" << labels << "} " << snapshot.count << "\n";
+    }
+
+    os << "# TYPE scall_bulkhead_rejected_total counter\n";
+    for (auto const& [identity, compartment] : m_compartments)
+    {
+        string labels = "identity=\"" + escape_label(identity) + "\"";
+
+        os << "scall_bulkhead_rejected_total{" << labels << ",reason=\"queue_full\"} " << compartment->rejected.load(std::memory_order_relaxed) << "\n";
+        os << "scall_bulkhead_rejected_total{" << labels << ",reason=\"timeout\"} " << compartment->timed_out.load(std::memory_order_relaxed) << "\n";
+    }
+
+    return os.str();
+}
+
+void Bulkhead::set_config(bool enabled, Limits const& default_limits, map<string, Limits> const& limits, milliseconds queue_timeout, int reject_status)
+{
+    m_enabled = enabled;
+    m_default_limits = default_limits;
+    m_limits = limits;
+    m_queue_timeout = queue_timeout;
+    m_reject_status = reject_status;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_compartments.clear();
+    }
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    LOG4CPLUS_DEBUG(logger, "Bulkhead: enabled=" << enabled << " max_concurrent=" << default_limits.max_concurrent << " max_queue=" << default_limits.max_queue
+                                                 << " queue_timeout=" << queue_timeout.count() << " ms reject_status=" << reject_status << " identities=" << limits.size());
+}
+
+/**
+ *  The slot goes to the oldest waiter, which is not over the timeout yet.
+ */
+void Bulkhead::release(string const& identity)
+{
+    auto now = steady_clock::now();
+    vector<std::pair<reject_fn, int>> expired;
+    admit_fn next;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+
+        auto it = m_compartments.find(identity);
+        if (it == m_compartments.end())
+        {
+            // reconfigured meanwhile
+            return;
+        }
+
+        Compartment& compartment = *it->second;
+        --compartment.in_use;
+
+        while (!compartment.queue.empty() && !next)
+        {
+            Waiter waiter = std::move(compartment.queue.front());
+            compartment.queue.pop_front();
+
+            if (now >= waiter.expires)
+            {
+                expired.emplace_back(std::move(waiter.on_reject), waiter.expired_status);
+                compartment.timed_out.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            auto waited = now - waiter.since;
+
+            ++compartment.in_use;
+            compartment.wait.record(std::chrono::duration_cast<std::chrono::microseconds>(waited).count());
+            compartment.admitted.fetch_add(1, std::memory_order_relaxed);
+            next = std::move(waiter.on_admit);
+        }
+    }
+
+    for (auto const& [on_reject, status] : expired)
+    {
+        if (on_reject)
+        {
+            on_reject(status);
+        }
+    }
+
+    if (next)
+    {
+        next(make_shared<Bulkhead_permit>(this, identity));
+    }
+}
+
+/**
+ *  Only the configured identities and the ones in the Key_store get a compartment (and
+ *  metric labels) of their own, so a client can not create them by sending any name.
+ */
+string Bulkhead::get_compartment_id(string const& identity) const
+{
+    if (identity.empty() || m_limits.count(identity) != 0 || Key_store::get_instance()->get_identity(identity))
+    {
+        return identity;
+    }
+
+    return string();
+}
+
+Bulkhead::Compartment& Bulkhead::get_compartment(string const& identity)
+{
+    auto& compartment = m_compartments[identity];
+
+    if (!compartment)
+    {
+        compartment = make_unique<Compartment>();
+
+        auto it = m_limits.find(identity);
+        compartment->limits = (it != m_limits.end()) ? it->second : m_default_limits;
+    }
+
+    return *compartment;
+}
+
+} // namespace upstream
+} // namespace imp
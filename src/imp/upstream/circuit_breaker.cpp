@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <algorithm>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/circuit_breaker.h>
+
+using std::lock_guard;
+using std::mutex;
+using std::string;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace imp
+{
+namespace upstream
+{
+
+static const char* state_name(Circuit_breaker::State state)
+{
+    switch (state)
+    {
+        case Circuit_breaker::State::closed:
+            return "closed";
+        case Circuit_breaker::State::open:
+            return "open";
+        case Circuit_breaker::State::half_open:
+            return "half-open";
+    }
+
+    return "unknown";
+}
+
+Circuit_breaker::Circuit_breaker()
+: m_enabled(false)
+, m_window(milliseconds(10000))
+, m_min_requests(20)
+, m_failure_rate(0.5)
+, m_open_time(milliseconds(5000))
+, m_probes(3)
+{
+}
+
+Circuit_breaker* Circuit_breaker::get_instance()
+{
+    static std::unique_ptr<Circuit_breaker> m_instance(new Circuit_breaker);
+    return m_instance.get();
+}
+
+bool Circuit_breaker::is_enabled() const
+{
+    return m_enabled;
+}
+
+/**
+ *  @param target The base url of the target
+ *  @return true, if the call may go to the target
+ */
+bool Circuit_breaker::allow(string const& target)
+{
+    if (!m_enabled)
+    {
+        return true;
+    }
+
+    lock_guard<mutex> lock(m_mutex);
+
+    auto& state = m_targets[target];
+    auto now = steady_clock::now();
+
+    switch (state.state)
+    {
+        case State::closed:
+            return true;
+
+        case State::open:
+            if (now - state.since < m_open_time)
+            {
+                return false;
+            }
+            change_state(target, state, State::half_open, now);
+            break;
+
+        case State::half_open:
+            // the probes did not come back (e.g. cancelled), try again
+            if (state.probes_sent >= m_probes && now - state.since >= m_open_time)
+            {
+                state.probes_sent = 0;
+                state.since = now;
+            }
+            break;
+    }
+
+    if (state.probes_sent >= m_probes)
+    {
+        return false;
+    }
+
+    ++state.probes_sent;
+    return true;
+}
+
+void Circuit_breaker::record(string const& target, RestClient::Response const& response)
+{
+    if (!m_enabled)
+    {
+        return;
+    }
+
+    bool failure = is_failure(response);
+
+    lock_guard<mutex> lock(m_mutex);
+
+    auto& state = m_targets[target];
+    auto now = steady_clock::now();
+
+    switch (state.state)
+    {
+        case State::closed:
+        {
+            auto& bucket = get_bucket(state, now);
+            if (failure)
+            {
+                ++bucket.failures;
+            }
+            else
+            {
+                ++bucket.successes;
+            }
+
+            uint successes = 0;
+            uint failures = 0;
+            count(state, now, successes, failures);
+
+            uint total = successes + failures;
+            if (failure && total >= m_min_requests && failures >= m_failure_rate * total)
+            {
+                change_state(target, state, State::open, now);
+            }
+            break;
+        }
+
+        case State::half_open:
+            if (failure)
+            {
+                change_state(target, state, State::open, now);
+            }
+            else if (++state.probes_passed >= m_probes)
+            {
+                change_state(target, state, State::closed, now);
+            }
+            break;
+
+        case State::open:
+            // late answer of a call sent before the circuit opened
+            break;
+    }
+}
+
+Circuit_breaker::State Circuit_breaker::get_state(string const& target)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    auto it = m_targets.find(target);
+    return (it == m_targets.end()) ? State::closed : it->second.state;
+}
+
+/**
+ *  Transport errors (code < 100, including timeouts) and the gateway errors count as failures.
+ */
+bool Circuit_breaker::is_failure(RestClient::Response const& response)
+{
+    return response.code < 100 || response.code == 502 || response.code == 503 || response.code == 504;
+}
+
+void Circuit_breaker::set_config(bool enabled, milliseconds window, uint min_requests, double failure_rate, milliseconds open_time, uint probes)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    m_enabled = enabled;
+    m_window = std::max(window, milliseconds(bucket_count));
+    m_min_requests = std::max(min_requests, 1u);
+    m_failure_rate = failure_rate;
+    m_open_time = open_time;
+    m_probes = std::max(probes, 1u);
+    m_targets.clear();
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    LOG4CPLUS_DEBUG(logger, "Circuit breaker: enabled=" << enabled << " window=" << m_window.count() << " ms min_requests=" << m_min_requests << " failure_rate=" << failure_rate << " open_time=" << open_time.count() << " ms probes=" << m_probes);
+}
+
+// the bucket of the current slot, a stale one is reset on reuse
+Circuit_breaker::Bucket& Circuit_breaker::get_bucket(Target_state& state, steady_clock::time_point now) const
+{
+    int64_t slot_length = m_window.count() / bucket_count;
+    int64_t slot = std::chrono::duration_cast<milliseconds>(now.time_since_epoch()).count() / slot_length;
+
+    auto& bucket = state.buckets[slot % bucket_count];
+    if (bucket.slot != slot)
+    {
+        bucket = {slot, 0, 0};
+    }
+
+    return bucket;
+}
+
+void Circuit_breaker::count(Target_state const& state, steady_clock::time_point now, uint& successes, uint& failures) const
+{
+    int64_t slot_length = m_window.count() / bucket_count;
+    int64_t slot = std::chrono::duration_cast<milliseconds>(now.time_since_epoch()).count() / slot_length;
+
+    for (auto const& bucket : state.buckets)
+    {
+        if (slot - bucket.slot < static_cast<int64_t>(bucket_count))
+        {
+            successes += bucket.successes;
+            failures += bucket.failures;
+        }
+    }
+}
+
+void Circuit_breaker::change_state(string const& target, Target_state& state, State new_state, steady_clock::time_point now)
+{
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    if (new_state == State::open)
+    {
+        LOG4CPLUS_WARN(logger, "Circuit of " << target << " is open, calls fail fast for " << m_open_time.count() << " ms");
+    }
+    else
+    {
+        LOG4CPLUS_INFO(logger, "Circuit of " << target << " is " << state_name(new_state));
+    }
+
+    state.state = new_state;
+    state.since = now;
+    state.probes_sent = 0;
+    state.probes_passed = 0;
+
+    if (new_state == State::closed)
+    {
+        state.buckets = {};
+    }
+}
+
+} // namespace upstream
+} // namespace imp
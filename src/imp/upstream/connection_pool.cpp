@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <tuple>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/crypto/key_store.h>
+#include <imp/upstream/connection_pool.h>
+#include <imp/upstream/curl_share.h>
+#include <imp/upstream/dns_resolver.h>
+#include <imp/upstream/upstream_metrics.h>
+
+using imp::crypto::Key_store;
+using RestClient::Connection;
+using std::lock_guard;
+using std::make_unique;
+using std::mutex;
+using std::unique_ptr;
+using std::chrono::steady_clock;
+
+namespace imp
+{
+namespace upstream
+{
+
+bool Pool_key::operator<(Pool_key const& other) const
+{
+    return std::tie(base_url, identity, verify_peer, verify_host, http2) < std::tie(other.base_url, other.identity, other.verify_peer, other.verify_host, other.http2);
+}
+
+//--------------------------------------------------------
+//-
+//- Lease of a pooled connection
+//-
+//--------------------------------------------------------
+
+Pooled_connection::Pooled_connection(Connection_pool* pool, Pool_key const& key, unique_ptr<Connection> connection)
+: m_pool(pool)
+, m_key(key)
+, m_connection(std::move(connection))
+, m_recorded(m_connection ? m_connection->GetRequestCount() : 0)
+{
+}
+
+Pooled_connection::~Pooled_connection()
+{
+    record();
+
+    if (m_pool && m_connection)
+    {
+        m_pool->release(m_key, std::move(m_connection));
+    }
+}
+
+Pooled_connection& Pooled_connection::operator=(Pooled_connection&& other)
+{
+    if (this != &other)
+    {
+        record();
+
+        if (m_pool && m_connection)
+        {
+            m_pool->release(m_key, std::move(m_connection));
+        }
+
+        m_pool = other.m_pool;
+        m_key = std::move(other.m_key);
+        m_connection = std::move(other.m_connection);
+        m_recorded = other.m_recorded;
+    }
+
+    return *this;
+}
+
+Connection* Pooled_connection::operator->() const
+{
+    return m_connection.get();
+}
+
+Connection& Pooled_connection::operator*() const
+{
+    return *m_connection;
+}
+
+Connection* Pooled_connection::get() const
+{
+    return m_connection.get();
+}
+
+Pool_key const& Pooled_connection::get_key() const
+{
+    return m_key;
+}
+
+void Pooled_connection::record()
+{
+    if (!m_connection || m_connection->GetRequestCount() == m_recorded)
+    {
+        return;
+    }
+
+    m_recorded = m_connection->GetRequestCount();
+    Upstream_metrics::get_instance()->record(m_key, m_connection->GetLastRequestInfo());
+}
+
+void Pooled_connection::discard()
+{
+    record();
+    m_connection.reset();
+}
+
+//--------------------------------------------------------
+//-
+//- Pool of warm connections
+//-
+//--------------------------------------------------------
+
+Connection_pool::Connection_pool()
+: m_idle_count(0)
+, m_max_idle(64)
+, m_max_idle_per_key(8)
+, m_idle_timeout(std::chrono::milliseconds(60000))
+, m_creator(nullptr)
+, m_profile()
+{
+}
+
+Connection_pool* Connection_pool::get_instance()
+{
+    static std::unique_ptr<Connection_pool> m_instance(new Connection_pool);
+    return m_instance.get();
+}
+
+/**
+ *  Hands out the most recently used idle connection of the key, or creates a new one.
+ *
+ *  @param key The target, identity, verify settings and protocol the connection is used for
+ *  @return Lease, which gives the connection back to the pool when it goes out of scope
+ */
+Pooled_connection Connection_pool::acquire(Pool_key const& key)
+{
+    unique_ptr<Connection> connection;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+
+        evict_expired_locked(steady_clock::now());
+
+        auto it = m_idle.find(key);
+        if (it != m_idle.end() && !it->second.empty())
+        {
+            connection = std::move(it->second.back().connection);
+            it->second.pop_back();
+            --m_idle_count;
+
+            if (it->second.empty())
+            {
+                m_idle.erase(it);
+            }
+        }
+    }
+
+    if (connection)
+    {
+        // the addresses may have been refreshed since the connection was used
+        connection->SetResolve(*Dns_resolver::get_instance()->get_entries());
+        return Pooled_connection(this, key, std::move(connection));
+    }
+
+    // creating the curl handle does not need the lock
+    return Pooled_connection(this, key, create(key));
+}
+
+/**
+ *  Sets up a connection with the profile, the client identity and the shared curl caches.
+ */
+unique_ptr<Connection> Connection_pool::create(Pool_key const& key)
+{
+    connection_creator_fn creator;
+    Upstream_profile profile;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+
+        creator = m_creator;
+        profile = m_profile;
+    }
+
+    unique_ptr<Connection> connection;
+    if (creator)
+    {
+        connection = creator(key);
+    }
+    else
+    {
+        connection = make_unique<Connection>(key.base_url);
+        profile.apply(*connection);
+        connection->SetVerifyPeer(key.verify_peer);
+        connection->SetVerifyHost(key.verify_host);
+
+        if (key.http2)
+        {
+            // ALPN falls back to HTTP/1.1, if the target does not speak h2
+            connection->SetHttpVersion(CURL_HTTP_VERSION_2TLS);
+            connection->SetPipeWait(true);
+        }
+    }
+
+    // client identity from memory, the key is not parsed again on the handshakes
+    if (!key.identity.empty())
+    {
+        auto identity = Key_store::get_instance()->get_identity(key.identity);
+        if (identity && !identity->cert_pem.empty())
+        {
+            connection->SetCertType("PEM");
+            connection->SetCertBlob(identity->cert_pem);
+            connection->SetKeyType("DER");
+            connection->SetKeyBlob(identity->key_der);
+        }
+    }
+
+    // DNS and TLS sessions are shared across the worker threads
+    connection->SetShareHandle(Curl_share::get_instance()->get_handle());
+
+    // pre-resolved target addresses, the name lookup is not done by the call
+    connection->SetResolve(*Dns_resolver::get_instance()->get_entries());
+
+    return connection;
+}
+
+/**
+ *  Takes back a connection. If the limits do not allow to keep it, the connection is closed.
+ */
+void Connection_pool::release(Pool_key const& key, unique_ptr<Connection> connection)
+{
+    if (!connection)
+    {
+        return;
+    }
+
+    lock_guard<mutex> lock(m_mutex);
+
+    if (m_max_idle == 0 || m_max_idle_per_key == 0)
+    {
+        return;
+    }
+
+    auto it = m_idle.find(key);
+
+    if (it != m_idle.end() && it->second.size() >= m_max_idle_per_key)
+    {
+        // the oldest one of the key goes
+        it->second.pop_front();
+        --m_idle_count;
+    }
+    else if (m_idle_count >= m_max_idle)
+    {
+        evict_oldest_locked();
+    }
+
+    auto& entries = m_idle[key];
+    entries.push_back({std::move(connection), steady_clock::now()});
+    ++m_idle_count;
+}
+
+std::vector<unique_ptr<Connection>> Connection_pool::take_idle(Pool_key const& key, size_t max_count)
+{
+    std::vector<unique_ptr<Connection>> connections;
+
+    lock_guard<mutex> lock(m_mutex);
+
+    auto it = m_idle.find(key);
+    if (it == m_idle.end())
+    {
+        return connections;
+    }
+
+    while (!it->second.empty() && connections.size() < max_count)
+    {
+        connections.push_back(std::move(it->second.back().connection));
+        it->second.pop_back();
+        --m_idle_count;
+    }
+
+    if (it->second.empty())
+    {
+        m_idle.erase(it);
+    }
+
+    return connections;
+}
+
+void Connection_pool::evict_expired()
+{
+    lock_guard<mutex> lock(m_mutex);
+    evict_expired_locked(steady_clock::now());
+}
+
+void Connection_pool::clear()
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_idle.clear();
+    m_idle_count = 0;
+}
+
+size_t Connection_pool::get_idle_count() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_idle_count;
+}
+
+uint Connection_pool::get_max_idle_per_key() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_max_idle_per_key;
+}
+
+std::chrono::milliseconds Connection_pool::get_idle_timeout() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_idle_timeout;
+}
+
+void Connection_pool::set_creator(connection_creator_fn const& fn)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_creator = fn;
+}
+
+void Connection_pool::set_profile(Upstream_profile const& profile)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_profile = profile;
+}
+
+void Connection_pool::set_limits(uint max_idle, uint max_idle_per_key, std::chrono::milliseconds idle_timeout)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_max_idle = max_idle;
+    m_max_idle_per_key = max_idle_per_key;
+    m_idle_timeout = idle_timeout;
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    LOG4CPLUS_DEBUG(logger, "Connection pool: max_idle=" << max_idle << " max_idle_per_key=" << max_idle_per_key << " idle_timeout=" << idle_timeout.count() << " ms");
+}
+
+void Connection_pool::evict_expired_locked(steady_clock::time_point now)
+{
+    for (auto it = m_idle.begin(); it != m_idle.end();)
+    {
+        auto& entries = it->second;
+
+        // entries are in the order of their release, oldest first
+        while (!entries.empty() && now - entries.front().since > m_idle_timeout)
+        {
+            entries.pop_front();
+            --m_idle_count;
+        }
+
+        if (entries.empty())
+        {
+            it = m_idle.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void Connection_pool::evict_oldest_locked()
+{
+    auto oldest = m_idle.end();
+
+    for (auto it = m_idle.begin(); it != m_idle.end(); ++it)
+    {
+        if (!it->second.empty() && (oldest == m_idle.end() || it->second.front().since < oldest->second.front().since))
+        {
+            oldest = it;
+        }
+    }
+
+    if (oldest != m_idle.end())
+    {
+        oldest->second.pop_front();
+        --m_idle_count;
+
+        if (oldest->second.empty())
+        {
+            m_idle.erase(oldest);
+        }
+    }
+}
+
+} // namespace upstream
+} // namespace imp
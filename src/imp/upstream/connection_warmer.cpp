@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/connection_warmer.h>
+#include <imp/upstream/load_balancer.h>
+
+using RestClient::Connection;
+using std::lock_guard;
+using std::mutex;
+using std::string;
+using std::unique_lock;
+using std::unique_ptr;
+using std::vector;
+using std::chrono::milliseconds;
+
+namespace imp
+{
+namespace upstream
+{
+
+Connection_warmer::Connection_warmer()
+: m_key_template{"", "", true, true, false}
+, m_identities()
+, m_path("/")
+, m_connections(1)
+, m_threads(4)
+, m_interval(milliseconds(30000))
+, m_running(false)
+{
+}
+
+Connection_warmer::~Connection_warmer()
+{
+    stop();
+}
+
+Connection_warmer* Connection_warmer::get_instance()
+{
+    static std::unique_ptr<Connection_warmer> m_instance(new Connection_warmer);
+    return m_instance.get();
+}
+
+/**
+ *  The rounds block for the HEAD round trips of all the identities and endpoints, so
+ *  they run here, not on a restbed worker.
+ */
+void Connection_warmer::start()
+{
+    if (m_running)
+    {
+        return;
+    }
+
+    m_running = true;
+    m_thread = std::thread(&Connection_warmer::run, this);
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    LOG4CPLUS_INFO(logger, "Upstream keep-warm started, interval=" << m_interval.count() << " ms");
+}
+
+void Connection_warmer::stop()
+{
+    if (!m_running)
+    {
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_stop.notify_all();
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+void Connection_warmer::run()
+{
+    while (m_running)
+    {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            if (m_stop.wait_for(lock, m_interval, [this]() { return !m_running; }))
+            {
+                break;
+            }
+        }
+
+        warm_up();
+    }
+}
+
+/**
+ *  Warms up every identity - endpoint pair, on a few threads in parallel.
+ */
+void Connection_warmer::warm_up()
+{
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+
+    vector<Pool_key> keys;
+    for (auto const& endpoint : Load_balancer::get_instance()->get_endpoints())
+    {
+        for (auto const& identity : m_identities)
+        {
+            Pool_key key = m_key_template;
+            key.base_url = endpoint->get_base_url();
+            key.identity = identity;
+            keys.push_back(key);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next(0);
+    std::atomic<uint> warm(0);
+
+    auto worker = [this, &keys, &next, &warm]()
+    {
+        for (size_t i = next++; i < keys.size(); i = next++)
+        {
+            warm += warm_up(keys[i]);
+        }
+    };
+
+    vector<std::thread> threads;
+    size_t thread_count = std::min<size_t>(std::max(m_threads, 1u), keys.size());
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        threads.emplace_back(worker);
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    LOG4CPLUS_INFO(logger, "Upstream warm-up: " << warm << " connections for " << keys.size() << " identity / endpoint pairs in " << elapsed.count() << " ms");
+}
+
+void Connection_warmer::set_config(Pool_key const& key_template, vector<string> const& identities, string const& path, uint connections, uint threads, milliseconds interval)
+{
+    auto pool = Connection_pool::get_instance();
+
+    m_key_template = key_template;
+    m_identities = identities;
+    m_path = path;
+    m_connections = std::min(connections, pool->get_max_idle_per_key());
+    m_threads = threads;
+    m_interval = interval;
+
+    if (m_connections < connections)
+    {
+        log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+        LOG4CPLUS_WARN(logger, "Warm connections per identity are limited by upstream/pool/max_idle_per_key to " << m_connections);
+    }
+}
+
+uint Connection_warmer::warm_up(Pool_key const& key)
+{
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    auto pool = Connection_pool::get_instance();
+
+    // the idle ones are reused, the missing ones are opened
+    auto connections = pool->take_idle(key, m_connections);
+
+    try
+    {
+        while (connections.size() < m_connections)
+        {
+            connections.push_back(pool->create(key));
+        }
+    }
+    catch (std::exception const& exc)
+    {
+        LOG4CPLUS_WARN(logger, "Cannot create warm connection to " << key.base_url << " [" << key.identity << "]: " << exc.what());
+    }
+
+    uint warm = 0;
+
+    for (auto& connection : connections)
+    {
+        auto response = connection->head(m_path);
+
+        if (response.code < 100)
+        {
+            LOG4CPLUS_WARN(logger, "Warm-up of " << key.base_url << " [" << key.identity << "] failed: " << response.body);
+            continue;
+        }
+
+        pool->release(key, std::move(connection));
+        ++warm;
+    }
+
+    return warm;
+}
+
+} // namespace upstream
+} // namespace imp
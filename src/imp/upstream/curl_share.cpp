@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/app/error.h>
+#include <imp/upstream/curl_share.h>
+
+using imp::app::application_error;
+
+namespace imp
+{
+namespace upstream
+{
+
+Curl_share::Curl_share()
+: m_share(curl_share_init())
+{
+    if (!m_share)
+    {
+        throw application_error("ERR_UPSTREAM_CURL_SHARE_INIT");
+    }
+
+    curl_share_setopt(m_share, CURLSHOPT_LOCKFUNC, Curl_share::lock_callback);
+    curl_share_setopt(m_share, CURLSHOPT_UNLOCKFUNC, Curl_share::unlock_callback);
+    curl_share_setopt(m_share, CURLSHOPT_USERDATA, this);
+
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+Curl_share::~Curl_share()
+{
+    cleanup();
+}
+
+Curl_share* Curl_share::get_instance()
+{
+    static std::unique_ptr<Curl_share> m_instance(new Curl_share);
+    return m_instance.get();
+}
+
+CURLSH* Curl_share::get_handle() const
+{
+    return m_share;
+}
+
+void Curl_share::cleanup()
+{
+    if (!m_share)
+    {
+        return;
+    }
+
+    CURLSHcode result = curl_share_cleanup(m_share);
+    if (result != CURLSHE_OK)
+    {
+        // still used by a handle: left to the process exit, after curl_global_cleanup() it can not be released
+        log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+        LOG4CPLUS_WARN(logger, "Cannot release the curl share: " << curl_share_strerror(result));
+    }
+
+    m_share = nullptr;
+}
+
+void Curl_share::lock_callback(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr)
+{
+    (void)handle;
+    (void)access;
+
+    Curl_share* share = static_cast<Curl_share*>(userptr);
+    share->m_mutexes[data].lock();
+}
+
+void Curl_share::unlock_callback(CURL* handle, curl_lock_data data, void* userptr)
+{
+    (void)handle;
+
+    Curl_share* share = static_cast<Curl_share*>(userptr);
+    share->m_mutexes[data].unlock();
+}
+
+} // namespace upstream
+} // namespace imp
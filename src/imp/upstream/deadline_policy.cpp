@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/deadline_policy.h>
+#include <imp/upstream/header_store.h>
+
+using std::map;
+using std::multimap;
+using std::optional;
+using std::string;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+namespace imp
+{
+namespace upstream
+{
+
+Deadline_policy::Deadline_policy()
+: m_enabled(false)
+, m_header("x-request-timeout-ms")
+, m_max_budget(milliseconds(300000))
+, m_routes()
+{
+}
+
+Deadline_policy* Deadline_policy::get_instance()
+{
+    static std::unique_ptr<Deadline_policy> m_instance(new Deadline_policy);
+    return m_instance.get();
+}
+
+bool Deadline_policy::is_enabled() const
+{
+    return m_enabled;
+}
+
+/**
+ *  The header holds the budget in milliseconds, an invalid or non-positive value is
+ *  ignored. A larger one than max_budget is cut to it (the sum with the arrival time
+ *  has to fit into the clock).
+ */
+optional<deadline_t> Deadline_policy::get_deadline(string const& path, multimap<string, string> const& headers, deadline_t received) const
+{
+    if (!m_enabled)
+    {
+        return std::nullopt;
+    }
+
+    optional<milliseconds> budget;
+
+    // the longest prefix is the last one not greater than the path, which matches
+    for (auto it = m_routes.upper_bound(path); it != m_routes.begin();)
+    {
+        --it;
+        if (path.compare(0, it->first.size(), it->first) == 0)
+        {
+            budget = it->second;
+            break;
+        }
+    }
+
+    for (auto const& [name, value] : headers)
+    {
+        if (Header_store::iequals(name, m_header))
+        {
+            char* end = nullptr;
+            long long client_budget = strtoll(value.c_str(), &end, 10);
+
+            if (end != value.c_str() && client_budget > 0)
+            {
+                milliseconds limited(std::min<long long>(client_budget, m_max_budget.count()));
+                if (!budget || limited < *budget)
+                {
+                    budget = limited;
+                }
+            }
+            break;
+        }
+    }
+
+    if (!budget)
+    {
+        return std::nullopt;
+    }
+
+    return received + *budget;
+}
+
+milliseconds Deadline_policy::get_remaining(deadline_t deadline)
+{
+    auto remaining = std::chrono::duration_cast<milliseconds>(deadline - steady_clock::now());
+    return (remaining.count() > 0) ? remaining : milliseconds(0);
+}
+
+bool Deadline_policy::is_expired(optional<deadline_t> const& deadline)
+{
+    return deadline && steady_clock::now() >= *deadline;
+}
+
+const string& Deadline_policy::get_header() const
+{
+    return m_header;
+}
+
+void Deadline_policy::set_config(bool enabled, string const& header, milliseconds max_budget, map<string, milliseconds> const& routes)
+{
+    m_enabled = enabled;
+    m_header = header;
+    m_max_budget = max_budget;
+    m_routes = routes;
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    LOG4CPLUS_DEBUG(logger, "Deadline policy: enabled=" << enabled << " header=" << header << " max_budget=" << max_budget.count() << " ms routes=" << routes.size());
+}
+
+} // namespace upstream
+} // namespace imp
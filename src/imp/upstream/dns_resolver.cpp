@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <algorithm>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <curl/curl.h>
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/dns_resolver.h>
+#include <imp/upstream/load_balancer.h>
+
+using std::lock_guard;
+using std::make_shared;
+using std::mutex;
+using std::shared_ptr;
+using std::string;
+using std::unique_lock;
+using std::vector;
+using std::chrono::milliseconds;
+
+namespace imp
+{
+namespace upstream
+{
+
+/**
+ *  Host and port of a base url, the port defaults to the one of the scheme.
+ */
+static bool split_base_url(string const& base_url, string& host, string& port)
+{
+    CURLU* url = curl_url();
+    if (!url)
+    {
+        return false;
+    }
+
+    bool ok = false;
+    char* host_part = nullptr;
+    char* port_part = nullptr;
+
+    if (curl_url_set(url, CURLUPART_URL, base_url.c_str(), 0) == CURLUE_OK
+        && curl_url_get(url, CURLUPART_HOST, &host_part, 0) == CURLUE_OK
+        && curl_url_get(url, CURLUPART_PORT, &port_part, CURLU_DEFAULT_PORT) == CURLUE_OK)
+    {
+        host = host_part;
+        port = port_part;
+        ok = true;
+    }
+
+    curl_free(host_part);
+    curl_free(port_part);
+    curl_url_cleanup(url);
+
+    return ok;
+}
+
+static bool is_address(string const& host)
+{
+    unsigned char buffer[sizeof(struct in6_addr)];
+
+    // IPv6 hosts come in brackets from the url
+    string bare = (host.size() > 2 && host.front() == '[') ? host.substr(1, host.size() - 2) : host;
+
+    return inet_pton(AF_INET, bare.c_str(), buffer) == 1 || inet_pton(AF_INET6, bare.c_str(), buffer) == 1;
+}
+
+/**
+ *  Addresses of the host in CURLOPT_RESOLVE notation (IPv6 ones in brackets).
+ */
+static int lookup(string const& host, string const& port, vector<string>& addresses)
+{
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* result = nullptr;
+    int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+    if (rc != 0)
+    {
+        return rc;
+    }
+
+    for (struct addrinfo* it = result; it; it = it->ai_next)
+    {
+        char text[INET6_ADDRSTRLEN];
+        string address;
+
+        if (it->ai_family == AF_INET && inet_ntop(AF_INET, &reinterpret_cast<struct sockaddr_in*>(it->ai_addr)->sin_addr, text, sizeof(text)))
+        {
+            address = text;
+        }
+        else if (it->ai_family == AF_INET6 && inet_ntop(AF_INET6, &reinterpret_cast<struct sockaddr_in6*>(it->ai_addr)->sin6_addr, text, sizeof(text)))
+        {
+            address = string("[") + text + "]";
+        }
+
+        // the order of the resolver is kept, it is the preferred one
+        if (!address.empty() && std::find(addresses.begin(), addresses.end(), address) == addresses.end())
+        {
+            addresses.push_back(address);
+        }
+    }
+
+    freeaddrinfo(result);
+
+    return addresses.empty() ? EAI_NODATA : 0;
+}
+
+Dns_resolver::Dns_resolver()
+: m_refresh_interval(milliseconds(30000))
+, m_running(false)
+, m_entries(make_shared<const vector<string>>())
+{
+}
+
+Dns_resolver::~Dns_resolver()
+{
+    stop();
+}
+
+Dns_resolver* Dns_resolver::get_instance()
+{
+    static std::unique_ptr<Dns_resolver> m_instance(new Dns_resolver);
+    return m_instance.get();
+}
+
+void Dns_resolver::start()
+{
+    if (m_running)
+    {
+        return;
+    }
+
+    // the first calls already find the addresses
+    resolve_all();
+
+    m_running = true;
+    m_thread = std::thread(&Dns_resolver::run, this);
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    LOG4CPLUS_INFO(logger, "Upstream DNS pre-resolution started, refresh_interval=" << m_refresh_interval.count() << " ms");
+}
+
+void Dns_resolver::stop()
+{
+    if (!m_running)
+    {
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_stop.notify_all();
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+void Dns_resolver::resolve_all()
+{
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+
+    for (auto const& endpoint : Load_balancer::get_instance()->get_endpoints())
+    {
+        string host;
+        string port;
+
+        if (!split_base_url(endpoint->get_base_url(), host, port) || is_address(host))
+        {
+            continue;
+        }
+
+        vector<string> addresses;
+        int rc = lookup(host, port, addresses);
+        string host_port = host + ":" + port;
+
+        if (rc != 0)
+        {
+            // the last known addresses stay pinned
+            LOG4CPLUS_WARN(logger, "Cannot resolve " << host << ": " << gai_strerror(rc) << ((m_resolved.count(host_port) > 0) ? ", the previous addresses are kept" : ""));
+            continue;
+        }
+
+        string entry = host_port + ":";
+        for (size_t i = 0; i < addresses.size(); ++i)
+        {
+            entry += (i > 0) ? "," : "";
+            entry += addresses[i];
+        }
+
+        auto& resolved = m_resolved[host_port];
+        if (resolved != entry)
+        {
+            LOG4CPLUS_DEBUG(logger, "Upstream address pinned: " << entry);
+            resolved = entry;
+        }
+    }
+
+    auto entries = make_shared<vector<string>>();
+    for (auto const& resolved : m_resolved)
+    {
+        entries->push_back(resolved.second);
+    }
+
+    lock_guard<mutex> lock(m_mutex);
+    if (*entries != *m_entries)
+    {
+        m_entries = entries;
+    }
+}
+
+shared_ptr<const vector<string>> Dns_resolver::get_entries() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_entries;
+}
+
+void Dns_resolver::set_config(milliseconds refresh_interval)
+{
+    m_refresh_interval = (refresh_interval.count() > 0) ? refresh_interval : milliseconds(1000);
+}
+
+void Dns_resolver::run()
+{
+    while (m_running)
+    {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            if (m_stop.wait_for(lock, m_refresh_interval, [this]() { return !m_running; }))
+            {
+                break;
+            }
+        }
+
+        resolve_all();
+    }
+}
+
+} // namespace upstream
+} // namespace imp
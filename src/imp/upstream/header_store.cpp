@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <cstring>
+
+#include <imp/upstream/header_store.h>
+
+using std::string_view;
+
+namespace imp
+{
+namespace upstream
+{
+
+static inline bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline char to_lower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+Header_store::Header_store(size_t initial_capacity)
+: m_arena()
+, m_entries()
+{
+    m_arena.reserve(initial_capacity);
+    m_entries.reserve(32);
+}
+
+/**
+ *  Indexes a header line. A status line starts a new header block (e.g. after
+ *  100 Continue or a redirect), so the previous headers are dropped.
+ */
+void Header_store::append_line(const char* data, size_t size)
+{
+    if (size >= 5 && string_view(data, 5) == "HTTP/")
+    {
+        clear();
+        return;
+    }
+
+    const char* colon = static_cast<const char*>(memchr(data, ':', size));
+    if (!colon)
+    {
+        // blank line, or a continuation we do not support
+        return;
+    }
+
+    size_t base = m_arena.size();
+    m_arena.append(data, size);
+
+    size_t name_begin = 0;
+    size_t name_end = colon - data;
+    size_t value_begin = name_end + 1;
+    size_t value_end = size;
+
+    while (name_begin < name_end && is_space(data[name_begin]))
+        ++name_begin;
+    while (name_end > name_begin && is_space(data[name_end - 1]))
+        --name_end;
+    while (value_begin < value_end && is_space(data[value_begin]))
+        ++value_begin;
+    while (value_end > value_begin && is_space(data[value_end - 1]))
+        --value_end;
+
+    m_entries.push_back({static_cast<uint32_t>(base + name_begin),
+                         static_cast<uint32_t>(name_end - name_begin),
+                         static_cast<uint32_t>(base + value_begin),
+                         static_cast<uint32_t>(value_end - value_begin)});
+}
+
+void Header_store::clear()
+{
+    // keeps the capacity for the next block / call
+    m_arena.clear();
+    m_entries.clear();
+}
+
+std::optional<string_view> Header_store::get(string_view name) const
+{
+    for (size_t i = 0; i < m_entries.size(); ++i)
+    {
+        if (iequals(get_name(i), name))
+        {
+            return get_value(i);
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::vector<string_view> Header_store::get_all(string_view name) const
+{
+    std::vector<string_view> values;
+
+    for (size_t i = 0; i < m_entries.size(); ++i)
+    {
+        if (iequals(get_name(i), name))
+        {
+            values.push_back(get_value(i));
+        }
+    }
+
+    return values;
+}
+
+bool Header_store::contains(string_view name) const
+{
+    return get(name).has_value();
+}
+
+size_t Header_store::size() const
+{
+    return m_entries.size();
+}
+
+string_view Header_store::get_name(size_t index) const
+{
+    Entry const& entry = m_entries[index];
+    return string_view(m_arena.data() + entry.name_offset, entry.name_length);
+}
+
+string_view Header_store::get_value(size_t index) const
+{
+    Entry const& entry = m_entries[index];
+    return string_view(m_arena.data() + entry.value_offset, entry.value_length);
+}
+
+std::multimap<std::string, std::string> Header_store::to_multimap() const
+{
+    std::multimap<std::string, std::string> headers;
+
+    for (size_t i = 0; i < m_entries.size(); ++i)
+    {
+        headers.emplace(get_name(i), get_value(i));
+    }
+
+    return headers;
+}
+
+bool Header_store::iequals(string_view lhs, string_view rhs)
+{
+    if (lhs.size() != rhs.size())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < lhs.size(); ++i)
+    {
+        if (to_lower(lhs[i]) != to_lower(rhs[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+size_t Header_store::header_callback(void* data, size_t size, size_t nmemb, void* userdata)
+{
+    Header_store* store = static_cast<Header_store*>(userdata);
+    store->append_line(static_cast<const char*>(data), size * nmemb);
+
+    return size * nmemb;
+}
+
+} // namespace upstream
+} // namespace imp
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/health_checker.h>
+#include <imp/upstream/load_balancer.h>
+
+using RestClient::Connection;
+using std::lock_guard;
+using std::mutex;
+using std::string;
+using std::unique_lock;
+using std::chrono::milliseconds;
+
+namespace imp
+{
+namespace upstream
+{
+
+Health_checker::Health_checker()
+: m_key_template{"", "", true, true, false}
+, m_path("/health")
+, m_interval(milliseconds(5000))
+, m_timeout(milliseconds(2000))
+, m_rise(2)
+, m_fall(2)
+, m_running(false)
+{
+}
+
+Health_checker::~Health_checker()
+{
+    stop();
+}
+
+Health_checker* Health_checker::get_instance()
+{
+    static std::unique_ptr<Health_checker> m_instance(new Health_checker);
+    return m_instance.get();
+}
+
+void Health_checker::start()
+{
+    if (m_running)
+    {
+        return;
+    }
+
+    m_running = true;
+    m_thread = std::thread(&Health_checker::run, this);
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    LOG4CPLUS_INFO(logger, "Upstream health checks started, path=" << m_path << " interval=" << m_interval.count() << " ms");
+}
+
+void Health_checker::stop()
+{
+    if (!m_running)
+    {
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_stop.notify_all();
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+
+    m_probes.clear();
+}
+
+void Health_checker::check_all()
+{
+    for (auto const& endpoint : Load_balancer::get_instance()->get_endpoints())
+    {
+        auto& state = m_probes[endpoint->get_base_url()];
+        bool ok = probe(endpoint->get_base_url(), state);
+
+        if (ok)
+        {
+            state.failures = 0;
+            ++state.successes;
+        }
+        else
+        {
+            state.successes = 0;
+            ++state.failures;
+        }
+
+        if (endpoint->is_healthy() && state.failures >= m_fall)
+        {
+            endpoint->set_healthy(false);
+
+            log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+            LOG4CPLUS_WARN(logger, "Upstream endpoint " << endpoint->get_base_url() << " is down");
+        }
+        else if (!endpoint->is_healthy() && state.successes >= m_rise)
+        {
+            endpoint->set_healthy(true);
+
+            log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+            LOG4CPLUS_INFO(logger, "Upstream endpoint " << endpoint->get_base_url() << " is up");
+        }
+    }
+}
+
+void Health_checker::set_config(Pool_key const& key_template, string const& path, milliseconds interval, milliseconds timeout, uint rise, uint fall)
+{
+    m_key_template = key_template;
+    m_path = path;
+    m_interval = interval;
+    m_timeout = timeout;
+    m_rise = (rise > 0) ? rise : 1;
+    m_fall = (fall > 0) ? fall : 1;
+}
+
+void Health_checker::run()
+{
+    while (m_running)
+    {
+        check_all();
+
+        unique_lock<mutex> lock(m_mutex);
+        m_stop.wait_for(lock, m_interval, [this]() { return !m_running; });
+    }
+}
+
+bool Health_checker::probe(string const& base_url, Probe_state& state)
+{
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+
+    try
+    {
+        if (!state.connection)
+        {
+            Pool_key key = m_key_template;
+            key.base_url = base_url;
+
+            state.connection = Connection_pool::get_instance()->create(key);
+            // the pool set the timeout of the target in ms, which would take precedence
+            state.connection->SetTimeoutMs(static_cast<int>(m_timeout.count()));
+        }
+
+        auto response = state.connection->get(m_path);
+
+        if (response.code < 100)
+        {
+            // the connection is set up again for the next probe
+            state.connection.reset();
+        }
+
+        if (response.code >= 200 && response.code < 400)
+        {
+            return true;
+        }
+
+        LOG4CPLUS_DEBUG(logger, "Health check of " << base_url << " failed: " << response.code << " " << ((response.code < 100) ? response.body : ""));
+    }
+    catch (std::exception const& exc)
+    {
+        state.connection.reset();
+        LOG4CPLUS_DEBUG(logger, "Health check of " << base_url << " failed: " << exc.what());
+    }
+
+    return false;
+}
+
+} // namespace upstream
+} // namespace imp
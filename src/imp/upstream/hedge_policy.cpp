@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/hedge_policy.h>
+#include <imp/upstream/upstream_metrics.h>
+
+using std::optional;
+using std::set;
+using std::string;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+namespace imp
+{
+namespace upstream
+{
+
+Hedge_policy::Hedge_policy()
+: m_enabled(false)
+, m_verbs({"GET", "HEAD"})
+, m_percentile(0.95)
+, m_min_delay(milliseconds(10))
+, m_max_rate(0.05)
+, m_min_samples(100)
+{
+}
+
+Hedge_policy* Hedge_policy::get_instance()
+{
+    static std::unique_ptr<Hedge_policy> m_instance(new Hedge_policy);
+    return m_instance.get();
+}
+
+bool Hedge_policy::is_enabled() const
+{
+    return m_enabled;
+}
+
+bool Hedge_policy::is_hedgeable(string const& method) const
+{
+    return m_enabled && m_verbs.count(method) != 0;
+}
+
+/**
+ *  @return The configured percentile of the target's total call time, but at least min_delay
+ */
+optional<microseconds> Hedge_policy::get_delay(string const& target) const
+{
+    auto& metrics = Upstream_metrics::get_instance()->get_hedge_metrics(target);
+
+    if (metrics.total.get_count() < m_min_samples)
+    {
+        return std::nullopt;
+    }
+
+    microseconds delay(metrics.total.get_percentile(m_percentile));
+
+    return (delay < m_min_delay) ? microseconds(m_min_delay) : delay;
+}
+
+bool Hedge_policy::try_hedge(string const& target)
+{
+    auto& metrics = Upstream_metrics::get_instance()->get_hedge_metrics(target);
+
+    uint64_t candidates = metrics.candidates.load(std::memory_order_relaxed);
+    uint64_t sent = metrics.sent.load(std::memory_order_relaxed);
+
+    if (sent + 1 > m_max_rate * candidates)
+    {
+        return false;
+    }
+
+    metrics.sent.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void Hedge_policy::set_config(bool enabled, set<string> const& verbs, double percentile, milliseconds min_delay, double max_rate, uint min_samples)
+{
+    m_enabled = enabled;
+    m_verbs = verbs;
+    m_percentile = percentile;
+    m_min_delay = min_delay;
+    m_max_rate = max_rate;
+    m_min_samples = min_samples;
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    LOG4CPLUS_DEBUG(logger, "Hedge policy: enabled=" << enabled << " percentile=" << percentile << " min_delay=" << min_delay.count() << " ms max_rate=" << max_rate << " min_samples=" << min_samples);
+}
+
+} // namespace upstream
+} // namespace imp
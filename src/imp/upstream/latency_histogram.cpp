@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <cmath>
+
+#include <imp/upstream/latency_histogram.h>
+
+namespace imp
+{
+namespace upstream
+{
+
+Latency_histogram::Latency_histogram()
+: m_count(0)
+, m_sum(0)
+, m_max(0)
+{
+    for (auto& bucket : m_buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void Latency_histogram::record(uint64_t value_us)
+{
+    m_buckets[bucket_index(value_us)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value_us, std::memory_order_relaxed);
+
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (value_us > max && !m_max.compare_exchange_weak(max, value_us, std::memory_order_relaxed))
+    {
+    }
+}
+
+uint64_t Latency_histogram::get_count() const
+{
+    return m_count.load(std::memory_order_relaxed);
+}
+
+/**
+ *  @param quantile Between 0 and 1 (e.g. 0.99)
+ *  @return The value (in microseconds) below which the given part of the samples are, 0 if empty
+ */
+uint64_t Latency_histogram::get_percentile(double quantile) const
+{
+    // the buckets are read one by one, their sum is the count of this read
+    uint64_t total = 0;
+    for (auto const& bucket : m_buckets)
+    {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(std::ceil(quantile * total));
+    if (target == 0)
+    {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; ++i)
+    {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= target)
+        {
+            uint64_t value = bucket_value(i);
+            uint64_t max = m_max.load(std::memory_order_relaxed);
+            return (value < max) ? value : max;
+        }
+    }
+
+    return m_max.load(std::memory_order_relaxed);
+}
+
+Latency_histogram::Snapshot Latency_histogram::get_snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.count = m_count.load(std::memory_order_relaxed);
+    snapshot.sum_us = m_sum.load(std::memory_order_relaxed);
+    snapshot.max_us = m_max.load(std::memory_order_relaxed);
+    snapshot.p50_us = get_percentile(0.5);
+    snapshot.p90_us = get_percentile(0.9);
+    snapshot.p99_us = get_percentile(0.99);
+    snapshot.p999_us = get_percentile(0.999);
+
+    return snapshot;
+}
+
+size_t Latency_histogram::bucket_index(uint64_t value)
+{
+    const uint64_t limit = (uint64_t(1) << max_value_bits) - 1;
+    if (value > limit)
+    {
+        value = limit;
+    }
+
+    if (value < sub_bucket_count)
+    {
+        return static_cast<size_t>(value);
+    }
+
+    // the top sub_bucket_bits + 1 bits select the bucket
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - sub_bucket_bits;
+
+    return static_cast<size_t>((shift + 1) * sub_bucket_count + ((value >> shift) - sub_bucket_count));
+}
+
+// upper end of the bucket's range
+uint64_t Latency_histogram::bucket_value(size_t index)
+{
+    if (index < sub_bucket_count)
+    {
+        return index;
+    }
+
+    int shift = static_cast<int>(index / sub_bucket_count) - 1;
+    uint64_t sub_bucket = index % sub_bucket_count + sub_bucket_count;
+
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+} // namespace upstream
+} // namespace imp
@@ -0,0 +1,382 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <cmath>
+#include <random>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/app/error.h>
+#include <imp/upstream/load_balancer.h>
+
+using imp::app::application_error;
+using std::lock_guard;
+using std::make_shared;
+using std::map;
+using std::mutex;
+using std::shared_lock;
+using std::shared_mutex;
+using std::shared_ptr;
+using std::string;
+using std::unique_lock;
+using std::chrono::steady_clock;
+
+namespace imp
+{
+namespace upstream
+{
+
+// time constant of the latency average, older observations fade out on this scale
+static const double decay_time_us = 10000000.0;
+
+//--------------------------------------------------------
+//-
+//- Endpoint
+//-
+//--------------------------------------------------------
+
+Upstream_endpoint::Upstream_endpoint(string const& base_url, uint weight)
+: current_weight(0)
+, m_base_url(base_url)
+, m_weight(weight > 0 ? weight : 1)
+, m_outstanding(0)
+, m_healthy(true)
+, m_latency_us(0)
+, m_observed(steady_clock::now())
+{
+}
+
+const string& Upstream_endpoint::get_base_url() const
+{
+    return m_base_url;
+}
+
+uint Upstream_endpoint::get_weight() const
+{
+    return m_weight;
+}
+
+int Upstream_endpoint::get_outstanding() const
+{
+    return m_outstanding.load(std::memory_order_relaxed);
+}
+
+double Upstream_endpoint::get_latency_us() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_latency_us;
+}
+
+/**
+ *  A slower call is taken at once (peak), faster ones pull the average down
+ *  gradually, depending on the time passed since the previous observation.
+ */
+void Upstream_endpoint::observe(uint64_t latency_us)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    auto now = steady_clock::now();
+    double rtt = static_cast<double>(latency_us);
+
+    if (m_latency_us == 0 || rtt > m_latency_us)
+    {
+        m_latency_us = rtt;
+    }
+    else
+    {
+        double elapsed = std::chrono::duration<double, std::micro>(now - m_observed).count();
+        double w = std::exp(-elapsed / decay_time_us);
+        m_latency_us = m_latency_us * w + rtt * (1.0 - w);
+    }
+
+    m_observed = now;
+}
+
+bool Upstream_endpoint::is_healthy() const
+{
+    return m_healthy.load(std::memory_order_relaxed);
+}
+
+void Upstream_endpoint::set_healthy(bool healthy)
+{
+    m_healthy.store(healthy, std::memory_order_relaxed);
+}
+
+//--------------------------------------------------------
+//-
+//- Lease
+//-
+//--------------------------------------------------------
+
+Endpoint_lease::Endpoint_lease()
+: m_endpoint(nullptr)
+{
+}
+
+Endpoint_lease::Endpoint_lease(shared_ptr<Upstream_endpoint> endpoint)
+: m_endpoint(std::move(endpoint))
+{
+    if (m_endpoint)
+    {
+        m_endpoint->m_outstanding.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+Endpoint_lease::Endpoint_lease(Endpoint_lease&& other)
+: m_endpoint(std::move(other.m_endpoint))
+{
+}
+
+Endpoint_lease& Endpoint_lease::operator=(Endpoint_lease&& other)
+{
+    if (this != &other)
+    {
+        if (m_endpoint)
+        {
+            m_endpoint->m_outstanding.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        m_endpoint = std::move(other.m_endpoint);
+    }
+
+    return *this;
+}
+
+Endpoint_lease::~Endpoint_lease()
+{
+    if (m_endpoint)
+    {
+        m_endpoint->m_outstanding.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+Upstream_endpoint* Endpoint_lease::operator->() const
+{
+    return m_endpoint.get();
+}
+
+Upstream_endpoint* Endpoint_lease::get() const
+{
+    return m_endpoint.get();
+}
+
+Endpoint_lease::operator bool() const
+{
+    return m_endpoint != nullptr;
+}
+
+//--------------------------------------------------------
+//-
+//- Policies
+//-
+//--------------------------------------------------------
+
+// the scans start at a random position, so equal endpoints share the load
+static size_t random_start(size_t count)
+{
+    thread_local std::minstd_rand random(std::random_device{}());
+    return random() % count;
+}
+
+shared_ptr<Upstream_endpoint> round_robin_policy(endpoint_list const& endpoints)
+{
+    static mutex rr_mutex;
+    lock_guard<mutex> lock(rr_mutex);
+
+    shared_ptr<Upstream_endpoint> best = nullptr;
+    int64_t total = 0;
+
+    for (auto const& endpoint : endpoints)
+    {
+        endpoint->current_weight += endpoint->get_weight();
+        total += endpoint->get_weight();
+
+        if (!best || endpoint->current_weight > best->current_weight)
+        {
+            best = endpoint;
+        }
+    }
+
+    if (best)
+    {
+        best->current_weight -= total;
+    }
+
+    return best;
+}
+
+shared_ptr<Upstream_endpoint> least_outstanding_policy(endpoint_list const& endpoints)
+{
+    if (endpoints.empty())
+    {
+        return nullptr;
+    }
+
+    size_t start = random_start(endpoints.size());
+    shared_ptr<Upstream_endpoint> best = nullptr;
+    double best_load = 0;
+
+    for (size_t i = 0; i < endpoints.size(); ++i)
+    {
+        auto const& endpoint = endpoints[(start + i) % endpoints.size()];
+        double load = static_cast<double>(endpoint->get_outstanding() + 1) / endpoint->get_weight();
+
+        if (!best || load < best_load)
+        {
+            best = endpoint;
+            best_load = load;
+        }
+    }
+
+    return best;
+}
+
+shared_ptr<Upstream_endpoint> peak_ewma_policy(endpoint_list const& endpoints)
+{
+    if (endpoints.empty())
+    {
+        return nullptr;
+    }
+
+    size_t start = random_start(endpoints.size());
+    shared_ptr<Upstream_endpoint> best = nullptr;
+    double best_cost = 0;
+
+    for (size_t i = 0; i < endpoints.size(); ++i)
+    {
+        auto const& endpoint = endpoints[(start + i) % endpoints.size()];
+
+        // an endpoint without measurement is tried first
+        double cost = endpoint->get_latency_us() * (endpoint->get_outstanding() + 1) / endpoint->get_weight();
+
+        if (!best || cost < best_cost)
+        {
+            best = endpoint;
+            best_cost = cost;
+        }
+    }
+
+    return best;
+}
+
+//--------------------------------------------------------
+//-
+//- Balancer
+//-
+//--------------------------------------------------------
+
+Load_balancer::Load_balancer()
+: m_endpoints()
+, m_policy(round_robin_policy)
+, m_policies({{"round_robin", round_robin_policy}, {"least_outstanding", least_outstanding_policy}, {"peak_ewma", peak_ewma_policy}})
+{
+}
+
+Load_balancer* Load_balancer::get_instance()
+{
+    static std::unique_ptr<Load_balancer> m_instance(new Load_balancer);
+    return m_instance.get();
+}
+
+Endpoint_lease Load_balancer::pick()
+{
+    shared_lock<shared_mutex> lock(m_mutex);
+
+    if (m_endpoints.empty())
+    {
+        return Endpoint_lease();
+    }
+
+    if (m_endpoints.size() == 1)
+    {
+        return Endpoint_lease(m_endpoints.front());
+    }
+
+    size_t healthy = 0;
+    for (auto const& endpoint : m_endpoints)
+    {
+        if (endpoint->is_healthy())
+        {
+            ++healthy;
+        }
+    }
+
+    // all down: better to try than to fail for sure
+    if (healthy == m_endpoints.size() || healthy == 0)
+    {
+        return Endpoint_lease(m_policy(m_endpoints));
+    }
+
+    endpoint_list alive;
+    alive.reserve(healthy);
+    for (auto const& endpoint : m_endpoints)
+    {
+        if (endpoint->is_healthy())
+        {
+            alive.push_back(endpoint);
+        }
+    }
+
+    return Endpoint_lease(m_policy(alive));
+}
+
+shared_ptr<Upstream_endpoint> Load_balancer::find(string const& base_url) const
+{
+    shared_lock<shared_mutex> lock(m_mutex);
+
+    for (auto const& endpoint : m_endpoints)
+    {
+        if (endpoint->get_base_url() == base_url)
+        {
+            return endpoint;
+        }
+    }
+
+    return nullptr;
+}
+
+endpoint_list Load_balancer::get_endpoints() const
+{
+    shared_lock<shared_mutex> lock(m_mutex);
+    return m_endpoints;
+}
+
+void Load_balancer::register_policy(string const& name, balancing_fn const& fn)
+{
+    unique_lock<shared_mutex> lock(m_mutex);
+    m_policies[name] = fn;
+}
+
+void Load_balancer::set_endpoints(map<string, uint> const& endpoints, string const& policy)
+{
+    unique_lock<shared_mutex> lock(m_mutex);
+
+    auto it = m_policies.find(policy);
+    if (it == m_policies.end())
+    {
+        throw application_error("ERR_UPSTREAM_UNKNOWN_BALANCING_POLICY: " + policy);
+    }
+
+    m_policy = it->second;
+    m_endpoints.clear();
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+
+    for (auto const& [base_url, weight] : endpoints)
+    {
+        m_endpoints.push_back(make_shared<Upstream_endpoint>(base_url, weight));
+        LOG4CPLUS_DEBUG(logger, "Target endpoint: " << base_url << " weight=" << weight);
+    }
+
+    LOG4CPLUS_DEBUG(logger, "Balancing policy: " << policy);
+}
+
+} // namespace upstream
+} // namespace imp
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/request_coalescer.h>
+
+using std::lock_guard;
+using std::multimap;
+using std::mutex;
+using std::set;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace imp
+{
+namespace upstream
+{
+
+// the parts of the key are separated by a character, which can not be in a header
+static const char key_separator = '\n';
+
+static string to_lower(string value)
+{
+    std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return value;
+}
+
+Request_coalescer::Request_coalescer()
+: m_enabled(false)
+, m_headers({"accept"})
+, m_leaders(0)
+, m_coalesced(0)
+{
+}
+
+Request_coalescer* Request_coalescer::get_instance()
+{
+    static std::unique_ptr<Request_coalescer> m_instance(new Request_coalescer);
+    return m_instance.get();
+}
+
+bool Request_coalescer::is_enabled() const
+{
+    return m_enabled;
+}
+
+bool Request_coalescer::is_coalescable(string const& method) const
+{
+    return m_enabled && method == "GET";
+}
+
+/**
+ *  @param identity The identities used for the call (e.g. signing key id and mTLS key id),
+ *                  calls of different identities are never coalesced
+ *  @param headers The headers of the client, only the configured ones are part of the key
+ */
+string Request_coalescer::make_key(string const& method, string const& path, string const& query, string const& identity, multimap<string, string> const& headers) const
+{
+    string key;
+    key.reserve(method.size() + path.size() + query.size() + identity.size() + 64);
+
+    key.append(method).push_back(key_separator);
+    key.append(path).push_back('?');
+    key.append(query).push_back(key_separator);
+    key.append(identity).push_back(key_separator);
+
+    for (auto const& name : m_headers)
+    {
+        key.append(name).push_back(':');
+
+        for (auto const& [header, value] : headers)
+        {
+            if (Header_store::iequals(header, name))
+            {
+                key.append(value).push_back(',');
+            }
+        }
+
+        key.push_back(key_separator);
+    }
+
+    return key;
+}
+
+bool Request_coalescer::join(string const& key, completion_fn const& on_complete)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+
+        auto it = m_flights.find(key);
+        if (it == m_flights.end())
+        {
+            m_flights.emplace(key, vector<completion_fn>());
+            m_leaders.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        it->second.push_back(on_complete);
+    }
+
+    m_coalesced.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+completion_fn Request_coalescer::lead(string const& key, completion_fn const& on_complete, shared_ptr<Header_store> const& headers)
+{
+    return [this, key, on_complete, headers](RestClient::Response& response)
+    {
+        // the waiters get the headers in the response, not in a store
+        if (headers && response.headers.empty())
+        {
+            RestClient::Response copy{response.code, response.body, {}};
+            for (size_t i = 0; i < headers->size(); ++i)
+            {
+                copy.headers.emplace(string(headers->get_name(i)), string(headers->get_value(i)));
+            }
+            complete(key, copy);
+        }
+        else
+        {
+            complete(key, response);
+        }
+
+        if (on_complete)
+        {
+            on_complete(response);
+        }
+    };
+}
+
+/**
+ *  Every waiter gets its own copy, as the completion handlers may take over the body.
+ */
+void Request_coalescer::complete(string const& key, RestClient::Response const& response)
+{
+    vector<completion_fn> waiters;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+
+        auto it = m_flights.find(key);
+        if (it == m_flights.end())
+        {
+            return;
+        }
+
+        waiters.swap(it->second);
+        m_flights.erase(it);
+    }
+
+    for (auto const& waiter : waiters)
+    {
+        if (!waiter)
+        {
+            continue;
+        }
+
+        try
+        {
+            RestClient::Response copy = response;
+            waiter(copy);
+        }
+        catch (std::exception const& exc)
+        {
+            log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+            LOG4CPLUS_ERROR(logger, "Coalesced completion handler failed: " << exc.what());
+        }
+    }
+}
+
+bool Request_coalescer::has_waiters(string const& key)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    auto it = m_flights.find(key);
+    return it != m_flights.end() && !it->second.empty();
+}
+
+Flight_guard::Flight_guard(string const& key)
+: m_key(key)
+, m_released(false)
+{
+}
+
+Flight_guard::~Flight_guard()
+{
+    if (m_released)
+    {
+        return;
+    }
+
+    RestClient::Response response;
+    response.code = 502;
+    response.body = "Upstream call not sent";
+    Request_coalescer::get_instance()->complete(m_key, response);
+}
+
+void Flight_guard::release()
+{
+    m_released = true;
+}
+
+string Request_coalescer::get_text() const
+{
+    std::ostringstream os;
+
+    os << "# TYPE scall_upstream_coalesce_leaders_total counter\n";
+    os << "scall_upstream_coalesce_leaders_total " << m_leaders.load(std::memory_order_relaxed) << "\n";
+    os << "# TYPE scall_upstream_coalesced_total counter\n";
+    os << "scall_upstream_coalesced_total " << m_coalesced.load(std::memory_order_relaxed) << "\n";
+
+    return os.str();
+}
+
+void Request_coalescer::set_config(bool enabled, set<string> const& headers)
+{
+    m_enabled = enabled;
+
+    m_headers.clear();
+    for (auto const& header : headers)
+    {
+        m_headers.insert(to_lower(header));
+    }
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    LOG4CPLUS_DEBUG(logger, "Request coalescing: enabled=" << enabled << " headers=" << m_headers.size());
+}
+
+} // namespace upstream
+} // namespace imp
@@ -0,0 +1,542 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <functional>
+#include <sstream>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/header_store.h>
+#include <imp/upstream/response_cache.h>
+
+using std::lock_guard;
+using std::make_shared;
+using std::make_unique;
+using std::multimap;
+using std::mutex;
+using std::optional;
+using std::shared_ptr;
+using std::string;
+using std::string_view;
+using std::vector;
+using std::chrono::seconds;
+using std::chrono::steady_clock;
+
+namespace imp
+{
+namespace upstream
+{
+
+static const char key_separator = '\n';
+
+static inline bool is_space(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static string_view trim(string_view value)
+{
+    while (!value.empty() && is_space(value.front()))
+    {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && is_space(value.back()))
+    {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+static string to_lower(string_view value)
+{
+    string result(value);
+    std::transform(result.begin(), result.end(), result.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return result;
+}
+
+// all the values of a header, comma separated (as if it was sent in one line)
+static optional<string> get_header(multimap<string, string> const& headers, string_view name)
+{
+    optional<string> result;
+
+    for (auto const& [header, value] : headers)
+    {
+        if (Header_store::iequals(header, name))
+        {
+            if (result)
+            {
+                result->append(",").append(value);
+            }
+            else
+            {
+                result = value;
+            }
+        }
+    }
+
+    return result;
+}
+
+// calls fn for each element of a comma separated header value
+static void for_each_token(string_view value, std::function<void(string_view)> const& fn)
+{
+    while (!value.empty())
+    {
+        size_t comma = value.find(',');
+        string_view token = trim(value.substr(0, comma));
+
+        if (!token.empty())
+        {
+            fn(token);
+        }
+
+        if (comma == string_view::npos)
+        {
+            break;
+        }
+        value.remove_prefix(comma + 1);
+    }
+}
+
+/**
+ *  The answers, which may be stored with an explicit freshness (RFC 9111 4.2.2 lists the
+ *  heuristically cacheable ones, we do not use heuristics though).
+ */
+static bool is_cacheable_status(int code)
+{
+    switch (code)
+    {
+        case 200:
+        case 203:
+        case 204:
+        case 300:
+        case 301:
+        case 308:
+        case 404:
+        case 405:
+        case 410:
+        case 414:
+        case 501:
+            return true;
+        default:
+            return false;
+    }
+}
+
+Response_cache::Response_cache()
+: m_enabled(false)
+, m_max_bytes(67108864)
+, m_max_entry_bytes(1048576)
+, m_shards()
+, m_hits(0)
+, m_misses(0)
+, m_revalidated(0)
+, m_stored(0)
+, m_evicted(0)
+{
+    m_shards.push_back(make_unique<Shard>());
+}
+
+Response_cache* Response_cache::get_instance()
+{
+    static std::unique_ptr<Response_cache> m_instance(new Response_cache);
+    return m_instance.get();
+}
+
+bool Response_cache::is_enabled() const
+{
+    return m_enabled;
+}
+
+bool Response_cache::is_cacheable(string const& method) const
+{
+    return m_enabled && method == "GET";
+}
+
+/**
+ *  @param identity The identities used for the call (e.g. signing key id and mTLS key id),
+ *                  an entry is served only to the same identity
+ */
+string Response_cache::make_key(string const& path, string const& query, string const& identity) const
+{
+    string key;
+    key.reserve(path.size() + query.size() + identity.size() + 2);
+
+    key.append(path).push_back('?');
+    key.append(query).push_back(key_separator);
+    key.append(identity);
+
+    return key;
+}
+
+Response_cache::Lookup Response_cache::lookup(string const& key, multimap<string, string> const& headers)
+{
+    shared_ptr<const Cached_response> entry;
+
+    {
+        Shard& shard = get_shard(key);
+        lock_guard<mutex> lock(shard.mutex);
+
+        auto it = shard.index.find(key);
+        if (it != shard.index.end())
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            entry = it->second->second;
+        }
+    }
+
+    if (entry)
+    {
+        // another variant is stored
+        for (auto const& [name, value] : entry->vary)
+        {
+            if (get_header(headers, name).value_or("") != value)
+            {
+                entry = nullptr;
+                break;
+            }
+        }
+    }
+
+    if (!entry)
+    {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return {Status::miss, nullptr};
+    }
+
+    if (!entry->must_revalidate && steady_clock::now() < entry->expires)
+    {
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        return {Status::fresh, entry};
+    }
+
+    // stale, and nothing to revalidate with
+    if (entry->etag.empty() && entry->last_modified.empty())
+    {
+        erase(key);
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return {Status::miss, nullptr};
+    }
+
+    return {Status::stale, entry};
+}
+
+RestClient::HeaderFields Response_cache::get_conditional_headers(Cached_response const& entry) const
+{
+    RestClient::HeaderFields result;
+
+    if (!entry.etag.empty())
+    {
+        result.emplace("If-None-Match", entry.etag);
+    }
+    if (!entry.last_modified.empty())
+    {
+        result.emplace("If-Modified-Since", entry.last_modified);
+    }
+
+    return result;
+}
+
+void Response_cache::store(string const& key, multimap<string, string> const& headers, RestClient::Response const& response)
+{
+    if (!m_enabled)
+    {
+        return;
+    }
+
+    auto entry = make_entry(headers, response);
+    if (!entry)
+    {
+        // a newer answer says, the stored one is not to be used
+        erase(key);
+        return;
+    }
+
+    insert(key, entry);
+    m_stored.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ *  The headers of the 304 answer replace the ones of the stored response (RFC 9111 4.3.4),
+ *  the body is the stored one.
+ */
+RestClient::Response Response_cache::revalidate(string const& key, multimap<string, string> const& headers, Cached_response const& entry, RestClient::Response const& not_modified)
+{
+    RestClient::Response response = entry.response;
+    RestClient::HeaderFields updated;
+
+    // the framing of the 304 is not the one of the stored body
+    for (auto const& [name, value] : not_modified.headers)
+    {
+        if (!Header_store::iequals(name, "content-length") && !Header_store::iequals(name, "transfer-encoding"))
+        {
+            updated.emplace(name, value);
+        }
+    }
+
+    for (auto const& [name, value] : updated)
+    {
+        for (auto it = response.headers.begin(); it != response.headers.end();)
+        {
+            if (Header_store::iequals(it->first, name))
+            {
+                it = response.headers.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+    for (auto const& header : updated)
+    {
+        response.headers.insert(header);
+    }
+
+    m_revalidated.fetch_add(1, std::memory_order_relaxed);
+
+    auto refreshed = make_entry(headers, response);
+    if (refreshed)
+    {
+        insert(key, refreshed);
+    }
+    else
+    {
+        erase(key);
+    }
+
+    return response;
+}
+
+void Response_cache::erase(string const& key)
+{
+    Shard& shard = get_shard(key);
+    lock_guard<mutex> lock(shard.mutex);
+
+    auto it = shard.index.find(key);
+    if (it != shard.index.end())
+    {
+        shard.size -= it->second->second->size;
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+}
+
+void Response_cache::clear()
+{
+    for (auto& shard : m_shards)
+    {
+        lock_guard<mutex> lock(shard->mutex);
+
+        shard->index.clear();
+        shard->lru.clear();
+        shard->size = 0;
+    }
+}
+
+size_t Response_cache::get_size() const
+{
+    size_t size = 0;
+
+    for (auto const& shard : m_shards)
+    {
+        lock_guard<mutex> lock(shard->mutex);
+        size += shard->size;
+    }
+
+    return size;
+}
+
+string Response_cache::get_text() const
+{
+    std::ostringstream os;
+
+    os << "# TYPE scall_upstream_cache_hits_total counter\n";
+    os << "scall_upstream_cache_hits_total " << m_hits.load(std::memory_order_relaxed) << "\n";
+    os << "# TYPE scall_upstream_cache_misses_total counter\n";
+    os << "scall_upstream_cache_misses_total " << m_misses.load(std::memory_order_relaxed) << "\n";
+    os << "# TYPE scall_upstream_cache_revalidated_total counter\n";
+    os << "scall_upstream_cache_revalidated_total " << m_revalidated.load(std::memory_order_relaxed) << "\n";
+    os << "# TYPE scall_upstream_cache_stored_total counter\n";
+    os << "scall_upstream_cache_stored_total " << m_stored.load(std::memory_order_relaxed) << "\n";
+    os << "# TYPE scall_upstream_cache_evicted_total counter\n";
+    os << "scall_upstream_cache_evicted_total " << m_evicted.load(std::memory_order_relaxed) << "\n";
+    os << "# TYPE scall_upstream_cache_bytes gauge\n";
+    os << "scall_upstream_cache_bytes " << get_size() << "\n";
+
+    return os.str();
+}
+
+/**
+ *  Called at startup, the stored entries are dropped.
+ */
+void Response_cache::set_config(bool enabled, size_t max_bytes, size_t max_entry_bytes, uint shards)
+{
+    m_enabled = enabled;
+    m_max_bytes = max_bytes;
+    m_max_entry_bytes = max_entry_bytes;
+
+    m_shards.clear();
+    for (uint i = 0; i < std::max(shards, 1u); ++i)
+    {
+        m_shards.push_back(make_unique<Shard>());
+    }
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    LOG4CPLUS_DEBUG(logger, "Response cache: enabled=" << enabled << " max_bytes=" << max_bytes << " max_entry_bytes=" << max_entry_bytes << " shards=" << m_shards.size());
+}
+
+Response_cache::Shard& Response_cache::get_shard(string const& key)
+{
+    return *m_shards[std::hash<string>()(key) % m_shards.size()];
+}
+
+/**
+ *  The least recently used entries of the shard are dropped, until it fits in its
+ *  part of the budget.
+ */
+void Response_cache::insert(string const& key, shared_ptr<const Cached_response> entry)
+{
+    Shard& shard = get_shard(key);
+    size_t budget = m_max_bytes / m_shards.size();
+
+    lock_guard<mutex> lock(shard.mutex);
+
+    auto it = shard.index.find(key);
+    if (it != shard.index.end())
+    {
+        shard.size -= it->second->second->size;
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+
+    shard.size += entry->size;
+    shard.lru.emplace_front(key, std::move(entry));
+    shard.index[key] = shard.lru.begin();
+
+    while (shard.size > budget && !shard.lru.empty())
+    {
+        auto& oldest = shard.lru.back();
+
+        shard.size -= oldest.second->size;
+        shard.index.erase(oldest.first);
+        shard.lru.pop_back();
+
+        m_evicted.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ *  Storable: a cacheable status with an explicit freshness (s-maxage / max-age) or a
+ *  validator, no no-store, no Vary: *, and not larger than max_entry_bytes. Private
+ *  answers are fine, as the entries are kept per identity.
+ */
+shared_ptr<Cached_response> Response_cache::make_entry(multimap<string, string> const& headers, RestClient::Response const& response) const
+{
+    if (!is_cacheable_status(response.code))
+    {
+        return nullptr;
+    }
+
+    bool no_store = false;
+    bool no_cache = false;
+    optional<long> max_age;
+    optional<long> s_maxage;
+
+    auto cache_control = get_header(response.headers, "cache-control");
+    if (cache_control)
+    {
+        for_each_token(*cache_control, [&](string_view token)
+                       {
+                           size_t equals = token.find('=');
+                           string name = to_lower(trim(token.substr(0, equals)));
+                           string value = (equals == string_view::npos) ? string() : string(trim(token.substr(equals + 1)));
+
+                           if (name == "no-store")
+                               no_store = true;
+                           else if (name == "no-cache")
+                               no_cache = true;
+                           else if (name == "max-age")
+                               max_age = strtol(value.c_str(), nullptr, 10);
+                           else if (name == "s-maxage")
+                               s_maxage = strtol(value.c_str(), nullptr, 10);
+                       });
+    }
+
+    if (no_store)
+    {
+        return nullptr;
+    }
+
+    auto entry = make_shared<Cached_response>();
+
+    entry->etag = get_header(response.headers, "etag").value_or("");
+    entry->last_modified = get_header(response.headers, "last-modified").value_or("");
+
+    // a shared cache prefers s-maxage
+    long lifetime = s_maxage.value_or(max_age.value_or(0));
+    if (lifetime <= 0 && entry->etag.empty() && entry->last_modified.empty())
+    {
+        return nullptr;
+    }
+
+    auto vary = get_header(response.headers, "vary");
+    if (vary)
+    {
+        bool any = false;
+
+        for_each_token(*vary, [&](string_view token)
+                       {
+                           if (token == "*")
+                           {
+                               any = true;
+                               return;
+                           }
+
+                           string name = to_lower(token);
+                           entry->vary.emplace_back(name, get_header(headers, name).value_or(""));
+                       });
+
+        if (any)
+        {
+            return nullptr;
+        }
+    }
+
+    // the time the answer spent in caches before us
+    long age = strtol(get_header(response.headers, "age").value_or("0").c_str(), nullptr, 10);
+
+    entry->response = response;
+    entry->must_revalidate = no_cache || lifetime <= age;
+    entry->expires = steady_clock::now() + seconds(std::max(0L, lifetime - age));
+
+    entry->size = response.body.size();
+    for (auto const& [name, value] : response.headers)
+    {
+        entry->size += name.size() + value.size();
+    }
+    for (auto const& [name, value] : entry->vary)
+    {
+        entry->size += name.size() + value.size();
+    }
+
+    if (entry->size > m_max_entry_bytes)
+    {
+        return nullptr;
+    }
+
+    return entry;
+}
+
+} // namespace upstream
+} // namespace imp
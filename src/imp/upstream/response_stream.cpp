@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <cstdio>
+#include <string_view>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/app/app_config.h>
+#include <imp/upstream/response_stream.h>
+
+using imp::app::App_config;
+using restbed::Bytes;
+using restbed::Service;
+using restbed::Session;
+using std::lock_guard;
+using std::mutex;
+using std::shared_ptr;
+using std::string;
+
+namespace imp
+{
+namespace upstream
+{
+
+// connection specific headers are not forwarded
+static const std::string_view hop_by_hop_headers[] = {
+    "connection",
+    "keep-alive",
+    "proxy-authenticate",
+    "proxy-authorization",
+    "te",
+    "trailer",
+    "transfer-encoding",
+    "upgrade",
+};
+
+static bool is_hop_by_hop(std::string_view name)
+{
+    for (auto const& header : hop_by_hop_headers)
+    {
+        if (Header_store::iequals(name, header))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ *  @param service The service of the session, its workers do the session calls
+ *  @param session The inbound session, which receives the response
+ */
+Response_stream::Response_stream(Service& service, shared_ptr<Session> session, size_t max_buffered)
+: m_service(&service)
+, m_session(session)
+, m_is_head(session->get_request()->get_method() == "HEAD")
+, m_handle(nullptr)
+, m_response(nullptr)
+, m_resume(nullptr)
+, m_disconnected(nullptr)
+, m_high_watermark(max_buffered)
+, m_low_watermark(max_buffered / 2)
+, m_headers_sent(false)
+, m_chunked(false)
+, m_headers()
+, m_buffered(0)
+, m_paused(false)
+, m_mutex()
+, m_tasks()
+, m_scheduled(false)
+{
+}
+
+/**
+ *  Creates the stream of an inbound session, with upstream/streaming/max_buffered as
+ *  the high watermark. Streaming needs the async engine, the pause / resume is done there.
+ *
+ *  @param service The service of the session
+ *  @param session The inbound session, which receives the response
+ *  @return The stream to set on the Async_call, or nullptr if streaming is disabled
+ */
+shared_ptr<Response_stream> Response_stream::from_config(Service& service, shared_ptr<Session> session)
+{
+    auto app_config = App_config::get_instance();
+
+    if (!app_config->get_streaming_enabled() || !app_config->get_async_enabled())
+    {
+        return nullptr;
+    }
+
+    return std::make_shared<Response_stream>(service, session, app_config->get_streaming_max_buffered());
+}
+
+/**
+ *  Connects the stream to the transfer. Called by the engine, after the handle is prepared.
+ *
+ *  @param handle The curl handle of the transfer
+ *  @param response The response, which receives the status code
+ *  @param fn Unpauses the transfer, callable from any thread
+ *  @param disconnected Set once the client went away, optional
+ */
+void Response_stream::attach(CURL* handle, RestClient::Response* response, resume_fn const& fn, disconnect_flag const& disconnected)
+{
+    m_handle = handle;
+    m_response = response;
+    m_resume = fn;
+    m_disconnected = disconnected;
+
+    // leftover of a failed attempt
+    m_headers.clear();
+
+    curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, Response_stream::header_callback);
+    curl_easy_setopt(handle, CURLOPT_HEADERDATA, this);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, Response_stream::write_callback);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, this);
+}
+
+/**
+ *  Closes the inbound session, once the transfer is over. Called on the engine thread,
+ *  by the completion of the call.
+ */
+void Response_stream::finish(RestClient::Response const& response)
+{
+    if (is_disconnected())
+    {
+        return;
+    }
+
+    auto session = m_session;
+
+    if (!m_headers_sent)
+    {
+        // failed before the target answered, nothing was sent yet
+        log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+        LOG4CPLUS_WARN(logger, "Upstream call failed before the response headers: " << response.body);
+
+        post([session]() { session->close(restbed::BAD_GATEWAY, "", {{"Content-Length", "0"}}); });
+        return;
+    }
+
+    if (response.code >= 100 && response.code < 600)
+    {
+        string last_chunk = m_chunked ? string("0\r\n\r\n") : string();
+        post([session, last_chunk]() { session->close(last_chunk); });
+    }
+    else
+    {
+        // transfer broken in the middle, the client has to see the truncation
+        post([session]() { session->close(); });
+    }
+}
+
+bool Response_stream::is_disconnected() const
+{
+    return m_disconnected && m_disconnected->load(std::memory_order_relaxed);
+}
+
+bool Response_stream::is_headers_sent() const
+{
+    return m_headers_sent;
+}
+
+Header_store const& Response_stream::get_headers() const
+{
+    return m_headers;
+}
+
+size_t Response_stream::get_buffered() const
+{
+    return m_buffered;
+}
+
+size_t Response_stream::header_callback(void* data, size_t size, size_t nmemb, void* userdata)
+{
+    Response_stream* stream = static_cast<Response_stream*>(userdata);
+    size_t length = size * nmemb;
+
+    if (length <= 2 && (length == 0 || static_cast<char*>(data)[0] == '\r' || static_cast<char*>(data)[0] == '\n'))
+    {
+        // end of a header block; informational (1xx) ones are followed by the real one
+        long code = 0;
+        curl_easy_getinfo(stream->m_handle, CURLINFO_RESPONSE_CODE, &code);
+
+        if (code >= 200)
+        {
+            stream->send_headers();
+        }
+
+        return length;
+    }
+
+    // status lines reset the store
+    stream->m_headers.append_line(static_cast<const char*>(data), length);
+
+    return length;
+}
+
+size_t Response_stream::write_callback(void* data, size_t size, size_t nmemb, void* userdata)
+{
+    Response_stream* stream = static_cast<Response_stream*>(userdata);
+    size_t length = size * nmemb;
+
+    if (stream->is_disconnected())
+    {
+        // client went away, aborts the transfer
+        return 0;
+    }
+
+    if (stream->m_buffered > stream->m_high_watermark)
+    {
+        stream->m_paused = true;
+
+        // the writes might have completed in the meantime
+        if (stream->m_buffered > stream->m_low_watermark || !stream->m_paused.exchange(false))
+        {
+            // curl delivers the same data again after the resume
+            return CURL_WRITEFUNC_PAUSE;
+        }
+    }
+
+    stream->send_chunk(static_cast<char*>(data), length);
+
+    return length;
+}
+
+void Response_stream::send_headers()
+{
+    if (m_headers_sent)
+    {
+        return;
+    }
+
+    long code = 0;
+    curl_easy_getinfo(m_handle, CURLINFO_RESPONSE_CODE, &code);
+    m_response->code = static_cast<int>(code);
+
+    std::multimap<string, string> headers;
+    for (size_t i = 0; i < m_headers.size(); ++i)
+    {
+        if (!is_hop_by_hop(m_headers.get_name(i)))
+        {
+            headers.emplace(m_headers.get_name(i), m_headers.get_value(i));
+        }
+    }
+
+    // without a length the body is framed by chunked encoding towards the client
+    bool has_body = (code != 204 && code != 304 && !m_is_head);
+    m_chunked = (!m_headers.contains("Content-Length") && has_body);
+    if (m_chunked)
+    {
+        headers.emplace("Transfer-Encoding", "chunked");
+    }
+
+    m_headers_sent = true;
+
+    auto session = m_session;
+    post([session, code, headers]() { session->yield(static_cast<int>(code), headers); });
+}
+
+void Response_stream::send_chunk(const char* data, size_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+
+    Bytes chunk;
+
+    if (m_chunked)
+    {
+        char prefix[24];
+        int prefix_length = snprintf(prefix, sizeof(prefix), "%zx\r\n", size);
+
+        chunk.reserve(prefix_length + size + 2);
+        chunk.insert(chunk.end(), prefix, prefix + prefix_length);
+        chunk.insert(chunk.end(), data, data + size);
+        chunk.push_back('\r');
+        chunk.push_back('\n');
+    }
+    else
+    {
+        chunk.assign(data, data + size);
+    }
+
+    size_t chunk_size = chunk.size();
+    m_buffered += chunk_size;
+
+    auto self = shared_from_this();
+    post([self, chunk = std::move(chunk), chunk_size]() { self->m_session->yield(chunk, [self, chunk_size](const shared_ptr<Session>) { self->written(chunk_size); }); });
+}
+
+/**
+ *  The session is not used from the engine thread: the task is run by a restbed worker.
+ *  The tasks of the stream run in the order posted, and never at the same time, as only
+ *  one worker drains them.
+ */
+void Response_stream::post(std::function<void()> task)
+{
+    bool schedule = false;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+        schedule = !m_scheduled;
+        m_scheduled = true;
+    }
+
+    if (schedule)
+    {
+        auto self = shared_from_this();
+        m_service->schedule([self]() { self->run_tasks(); });
+    }
+}
+
+void Response_stream::run_tasks()
+{
+    while (true)
+    {
+        std::function<void()> task;
+
+        {
+            lock_guard<mutex> lock(m_mutex);
+            if (m_tasks.empty())
+            {
+                m_scheduled = false;
+                return;
+            }
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+void Response_stream::written(size_t size)
+{
+    m_buffered -= size;
+
+    if (m_buffered <= m_low_watermark && m_paused.exchange(false) && m_resume)
+    {
+        m_resume();
+    }
+}
+
+} // namespace upstream
+} // namespace imp
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <algorithm>
+#include <strings.h>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/retry_policy.h>
+
+using std::lock_guard;
+using std::mutex;
+using std::string;
+using std::chrono::milliseconds;
+
+namespace imp
+{
+namespace upstream
+{
+
+// the budget allows a burst of this many retries, before it has to be earned back
+static const double min_budget_tokens = 10.0;
+
+Retry_policy::Retry_policy()
+: m_enabled(false)
+, m_max_attempts(3)
+, m_base_backoff(milliseconds(50))
+, m_max_backoff(milliseconds(1000))
+, m_budget_ratio(0.1)
+, m_idempotency_header("Idempotency-Key")
+, m_tokens(min_budget_tokens)
+, m_max_tokens(min_budget_tokens)
+, m_random(std::random_device()())
+{
+}
+
+Retry_policy* Retry_policy::get_instance()
+{
+    static std::unique_ptr<Retry_policy> m_instance(new Retry_policy);
+    return m_instance.get();
+}
+
+bool Retry_policy::is_enabled() const
+{
+    return m_enabled;
+}
+
+bool Retry_policy::is_repeatable(string const& method, bool has_idempotency_key) const
+{
+    if (!m_enabled)
+    {
+        return false;
+    }
+
+    if (has_idempotency_key)
+    {
+        return true;
+    }
+
+    return strcasecmp(method.c_str(), "GET") == 0
+           || strcasecmp(method.c_str(), "HEAD") == 0
+           || strcasecmp(method.c_str(), "OPTIONS") == 0
+           || strcasecmp(method.c_str(), "TRACE") == 0;
+}
+
+/**
+ *  @param response The outcome of the attempt, code < 100 is a curl error
+ */
+bool Retry_policy::is_retryable(RestClient::Response const& response) const
+{
+    return response.code < 100 || response.code == 502 || response.code == 503;
+}
+
+void Retry_policy::on_request()
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_tokens = std::min(m_max_tokens, m_tokens + m_budget_ratio);
+}
+
+/**
+ *  @param attempt The number of attempts done so far
+ */
+bool Retry_policy::try_retry(uint attempt)
+{
+    if (attempt >= m_max_attempts)
+    {
+        return false;
+    }
+
+    lock_guard<mutex> lock(m_mutex);
+
+    if (m_tokens < 1.0)
+    {
+        log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+        LOG4CPLUS_DEBUG(logger, "Retry budget exhausted");
+        return false;
+    }
+
+    m_tokens -= 1.0;
+    return true;
+}
+
+/**
+ *  Exponential backoff with full jitter: uniform between 0 and base * 2^(attempt - 1),
+ *  capped at max_backoff. The jitter spreads the retries of the calls, which failed
+ *  together.
+ */
+milliseconds Retry_policy::get_backoff(uint attempt)
+{
+    uint shift = std::min(attempt > 0 ? attempt - 1 : 0, 20u);
+    int64_t limit = std::min<int64_t>(m_base_backoff.count() << shift, m_max_backoff.count());
+
+    lock_guard<mutex> lock(m_mutex);
+    std::uniform_int_distribution<int64_t> distribution(0, std::max<int64_t>(limit, 0));
+
+    return milliseconds(distribution(m_random));
+}
+
+const string& Retry_policy::get_idempotency_header() const
+{
+    return m_idempotency_header;
+}
+
+void Retry_policy::set_config(bool enabled, uint max_attempts, milliseconds base_backoff, milliseconds max_backoff, double budget_ratio, string const& idempotency_header)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    m_enabled = enabled;
+    m_max_attempts = std::max(max_attempts, 1u);
+    m_base_backoff = base_backoff;
+    m_max_backoff = max_backoff;
+    m_budget_ratio = budget_ratio;
+    m_idempotency_header = idempotency_header;
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+    LOG4CPLUS_DEBUG(logger, "Retry policy: enabled=" << enabled << " max_attempts=" << m_max_attempts << " backoff=" << base_backoff.count() << ".." << max_backoff.count() << " ms budget_ratio=" << budget_ratio);
+}
+
+} // namespace upstream
+} // namespace imp
@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/curl_share.h>
+#include <imp/upstream/tls_session_store.h>
+
+using std::lock_guard;
+using std::mutex;
+using std::string;
+
+namespace imp
+{
+namespace upstream
+{
+
+#if LIBCURL_VERSION_NUM >= 0x080c00
+
+static const char file_magic[8] = {'S', 'C', 'T', 'L', 'S', '0', '0', '1'};
+
+// records: shmac length (u32), shmac, data length (u32), data, valid until (i64, unix time)
+struct Export_context
+{
+    string buffer;
+    size_t count;
+};
+
+static void put_u32(string& buffer, uint32_t value)
+{
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void put_i64(string& buffer, int64_t value)
+{
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static bool get_bytes(string const& buffer, size_t& pos, void* out, size_t size)
+{
+    if (buffer.size() - pos < size)
+    {
+        return false;
+    }
+
+    memcpy(out, buffer.data() + pos, size);
+    pos += size;
+    return true;
+}
+
+static CURLcode export_callback(CURL* handle, void* userptr, const char* session_key, const unsigned char* shmac, size_t shmac_len, const unsigned char* sdata, size_t sdata_len, curl_off_t valid_until, int ietf_tls_id, const char* alpn, size_t earlydata_max)
+{
+    (void)handle;
+    (void)session_key;
+    (void)ietf_tls_id;
+    (void)alpn;
+    (void)earlydata_max;
+
+    // only the salted hash identifies the session in the file
+    if (!shmac || shmac_len == 0 || !sdata || sdata_len == 0)
+    {
+        return CURLE_OK;
+    }
+
+    Export_context* context = static_cast<Export_context*>(userptr);
+
+    put_u32(context->buffer, static_cast<uint32_t>(shmac_len));
+    context->buffer.append(reinterpret_cast<const char*>(shmac), shmac_len);
+    put_u32(context->buffer, static_cast<uint32_t>(sdata_len));
+    context->buffer.append(reinterpret_cast<const char*>(sdata), sdata_len);
+    put_i64(context->buffer, static_cast<int64_t>(valid_until));
+    ++context->count;
+
+    return CURLE_OK;
+}
+
+static bool read_file(string const& path, string& content)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    char chunk[65536];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0)
+    {
+        content.append(chunk, static_cast<size_t>(n));
+    }
+
+    close(fd);
+    return n == 0;
+}
+
+static bool write_file(string const& path, string const& content)
+{
+    // written aside, then renamed, so a crash does not leave a partial file
+    string temp_path = path + ".tmp";
+
+    int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    size_t written = 0;
+    while (written < content.size())
+    {
+        ssize_t n = write(fd, content.data() + written, content.size() - written);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            close(fd);
+            unlink(temp_path.c_str());
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+
+    if (fsync(fd) != 0 || close(fd) != 0)
+    {
+        unlink(temp_path.c_str());
+        return false;
+    }
+
+    return rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+#endif
+
+Tls_session_store::Tls_session_store()
+: m_path("")
+{
+}
+
+Tls_session_store* Tls_session_store::get_instance()
+{
+    static std::unique_ptr<Tls_session_store> m_instance(new Tls_session_store);
+    return m_instance.get();
+}
+
+void Tls_session_store::set_path(string const& path)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_path = path;
+}
+
+void Tls_session_store::load()
+{
+    lock_guard<mutex> lock(m_mutex);
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+
+    if (m_path.empty())
+    {
+        return;
+    }
+
+#if LIBCURL_VERSION_NUM >= 0x080c00
+    string content;
+    if (!read_file(m_path, content))
+    {
+        LOG4CPLUS_INFO(logger, "No TLS sessions loaded from " << m_path << ": " << strerror(errno));
+        return;
+    }
+
+    if (content.size() < sizeof(file_magic) || memcmp(content.data(), file_magic, sizeof(file_magic)) != 0)
+    {
+        LOG4CPLUS_WARN(logger, "TLS session file " << m_path << " has unknown format, ignored");
+        return;
+    }
+
+    // the import goes into the shared cache through a handle using it
+    CURL* handle = curl_easy_init();
+    if (!handle)
+    {
+        return;
+    }
+    curl_easy_setopt(handle, CURLOPT_SHARE, Curl_share::get_instance()->get_handle());
+
+    int64_t now = static_cast<int64_t>(time(nullptr));
+    size_t pos = sizeof(file_magic);
+    size_t imported = 0;
+    size_t expired = 0;
+
+    while (pos < content.size())
+    {
+        uint32_t shmac_len;
+        uint32_t sdata_len;
+        int64_t valid_until;
+
+        if (!get_bytes(content, pos, &shmac_len, sizeof(shmac_len)) || content.size() - pos < shmac_len)
+        {
+            break;
+        }
+        const unsigned char* shmac = reinterpret_cast<const unsigned char*>(content.data() + pos);
+        pos += shmac_len;
+
+        if (!get_bytes(content, pos, &sdata_len, sizeof(sdata_len)) || content.size() - pos < sdata_len)
+        {
+            break;
+        }
+        const unsigned char* sdata = reinterpret_cast<const unsigned char*>(content.data() + pos);
+        pos += sdata_len;
+
+        if (!get_bytes(content, pos, &valid_until, sizeof(valid_until)))
+        {
+            break;
+        }
+
+        if (valid_until <= now)
+        {
+            ++expired;
+            continue;
+        }
+
+        if (curl_easy_ssls_import(handle, nullptr, shmac, shmac_len, sdata, sdata_len) == CURLE_OK)
+        {
+            ++imported;
+        }
+    }
+
+    curl_easy_cleanup(handle);
+
+    LOG4CPLUS_INFO(logger, "TLS sessions loaded from " << m_path << ": " << imported << " imported, " << expired << " expired");
+#else
+    LOG4CPLUS_WARN(logger, "curl " LIBCURL_VERSION " cannot import TLS sessions (needs 8.12.0), " << m_path << " is not used");
+#endif
+}
+
+void Tls_session_store::save()
+{
+    lock_guard<mutex> lock(m_mutex);
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+
+    if (m_path.empty())
+    {
+        return;
+    }
+
+#if LIBCURL_VERSION_NUM >= 0x080c00
+    CURL* handle = curl_easy_init();
+    if (!handle)
+    {
+        return;
+    }
+    curl_easy_setopt(handle, CURLOPT_SHARE, Curl_share::get_instance()->get_handle());
+
+    Export_context context;
+    context.buffer.assign(file_magic, sizeof(file_magic));
+    context.count = 0;
+
+    CURLcode result = curl_easy_ssls_export(handle, export_callback, &context);
+    curl_easy_cleanup(handle);
+
+    if (result != CURLE_OK)
+    {
+        LOG4CPLUS_WARN(logger, "Cannot export TLS sessions: " << curl_easy_strerror(result));
+        return;
+    }
+
+    if (!write_file(m_path, context.buffer))
+    {
+        LOG4CPLUS_WARN(logger, "Cannot write TLS session file " << m_path << ": " << strerror(errno));
+        return;
+    }
+
+    LOG4CPLUS_DEBUG(logger, context.count << " TLS sessions saved to " << m_path);
+#else
+    LOG4CPLUS_DEBUG(logger, "curl " LIBCURL_VERSION " cannot export TLS sessions (needs 8.12.0)");
+#endif
+}
+
+} // namespace upstream
+} // namespace imp
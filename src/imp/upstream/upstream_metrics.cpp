@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/upstream_metrics.h>
+
+using RestClient::Connection;
+using std::make_unique;
+using std::shared_lock;
+using std::shared_mutex;
+using std::string;
+using std::unique_lock;
+
+namespace imp
+{
+namespace upstream
+{
+
+// curl reports the times in seconds, cumulated from the start of the call
+static uint64_t to_us(double seconds)
+{
+    return (seconds > 0) ? static_cast<uint64_t>(seconds * 1000000.0) : 0;
+}
+
+static string escape_label(string const& value)
+{
+    string result;
+    result.reserve(value.size());
+
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+        {
+            result.push_back('\\');
+            result.push_back(c);
+        }
+        else if (c == '\n')
+        {
+            result.append("\\n");
+        }
+        else
+        {
+            result.push_back(c);
+        }
+    }
+
+    return result;
+}
+
+static void write_histogram(std::ostringstream& os, string const& labels, const char* phase, Latency_histogram const& histogram)
+{
+    auto snapshot = histogram.get_snapshot();
+    string prefix = "scall_upstream_phase_seconds{" + labels + ",phase=\"" + phase + "\"";
+
+    os << prefix << ",quantile=\"0.5\"} " << snapshot.p50_us / 1e6 << "\n";
+    os << prefix << ",quantile=\"0.9\"} " << snapshot.p90_us / 1e6 << "\n";
+    os << prefix << ",quantile=\"0.99\"} " << snapshot.p99_us / 1e6 << "\n";
+    os << prefix << ",quantile=\"0.999\"} " << snapshot.p999_us / 1e6 << "\n";
+    os << "scall_upstream_phase_seconds_sum{" << labels << ",phase=\"" << phase << "\"} " << snapshot.sum_us / 1e6 << "\n";
+    os << "scall_upstream_phase_seconds_count{" << labels << ",phase=\"" << phase << "\"} " << snapshot.count << "\n";
+}
+
+Upstream_metrics* Upstream_metrics::get_instance()
+{
+    static std::unique_ptr<Upstream_metrics> m_instance(new Upstream_metrics);
+    return m_instance.get();
+}
+
+/**
+ *  Adds the timings of a finished call. Connect and TLS are recorded only, when the call
+ *  opened a new connection (they are 0 on a reused one).
+ *
+ *  @param key The pool key of the connection used for the call
+ *  @param info Diagnostics of the call, see Connection::GetLastRequestInfo()
+ */
+void Upstream_metrics::record(Pool_key const& key, Connection::RequestInfo const& info)
+{
+    auto& metrics = get_metrics(key);
+
+    if (info.curlCode != 0)
+    {
+        metrics.errors.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint64_t name_lookup = to_us(info.nameLookupTime);
+    uint64_t connect = to_us(info.connectTime);
+    uint64_t app_connect = to_us(info.appConnectTime);
+    uint64_t start_transfer = to_us(info.startTransferTime);
+
+    metrics.dns.record(name_lookup);
+
+    if (connect > 0)
+    {
+        metrics.connect.record(connect - std::min(name_lookup, connect));
+    }
+
+    if (app_connect > 0)
+    {
+        metrics.tls.record(app_connect - std::min(connect, app_connect));
+    }
+
+    // time to first byte, after the connection was ready
+    uint64_t ready = std::max(connect, app_connect);
+    metrics.server.record(start_transfer - std::min(ready, start_transfer));
+
+    metrics.total.record(to_us(info.totalTime));
+    get_hedge_metrics(key.base_url).total.record(to_us(info.totalTime));
+}
+
+string Upstream_metrics::get_text() const
+{
+    std::ostringstream os;
+
+    os << "# TYPE scall_upstream_phase_seconds summary\n";
+
+    shared_lock<shared_mutex> lock(m_mutex);
+
+    for (auto const& [key, metrics] : m_metrics)
+    {
+        string labels = "target=\"" + escape_label(key.first) + "\",identity=\"" + escape_label(key.second) + "\"";
+
+        write_histogram(os, labels, "dns", metrics->dns);
+        write_histogram(os, labels, "connect", metrics->connect);
+        write_histogram(os, labels, "tls", metrics->tls);
+        write_histogram(os, labels, "server", metrics->server);
+        write_histogram(os, labels, "total", metrics->total);
+    }
+
+    os << "# TYPE scall_upstream_errors_total counter\n";
+
+    for (auto const& [key, metrics] : m_metrics)
+    {
+        os << "scall_upstream_errors_total{target=\"" << escape_label(key.first) << "\",identity=\"" << escape_label(key.second) << "\"} "
+           << metrics->errors.load(std::memory_order_relaxed) << "\n";
+    }
+
+    os << "# TYPE scall_upstream_hedges_sent_total counter\n";
+
+    for (auto const& [target, metrics] : m_hedge_metrics)
+    {
+        os << "scall_upstream_hedges_sent_total{target=\"" << escape_label(target) << "\"} " << metrics->sent.load(std::memory_order_relaxed) << "\n";
+    }
+
+    os << "# TYPE scall_upstream_hedges_won_total counter\n";
+
+    for (auto const& [target, metrics] : m_hedge_metrics)
+    {
+        os << "scall_upstream_hedges_won_total{target=\"" << escape_label(target) << "\"} " << metrics->won.load(std::memory_order_relaxed) << "\n";
+    }
+
+    return os.str();
+}
+
+void Upstream_metrics::log_dump() const
+{
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("upstream"));
+
+    shared_lock<shared_mutex> lock(m_mutex);
+
+    for (auto const& [key, metrics] : m_metrics)
+    {
+        auto total = metrics->total.get_snapshot();
+        auto server = metrics->server.get_snapshot();
+
+        LOG4CPLUS_INFO(logger, "Upstream latency [" << key.first << "][" << key.second << "]: calls=" << total.count
+                                                    << " errors=" << metrics->errors.load(std::memory_order_relaxed)
+                                                    << " total p50/p99/max=" << total.p50_us << "/" << total.p99_us << "/" << total.max_us << " us"
+                                                    << " server p50/p99=" << server.p50_us << "/" << server.p99_us << " us"
+                                                    << " new connections=" << metrics->connect.get_count());
+    }
+
+    for (auto const& [target, metrics] : m_hedge_metrics)
+    {
+        if (metrics->candidates.load(std::memory_order_relaxed) > 0)
+        {
+            LOG4CPLUS_INFO(logger, "Upstream hedging [" << target << "]: candidates=" << metrics->candidates.load(std::memory_order_relaxed)
+                                                        << " hedges sent/won=" << metrics->sent.load(std::memory_order_relaxed) << "/" << metrics->won.load(std::memory_order_relaxed));
+        }
+    }
+}
+
+Target_metrics& Upstream_metrics::get_metrics(Pool_key const& key)
+{
+    metrics_key mkey(key.base_url, key.identity);
+
+    {
+        shared_lock<shared_mutex> lock(m_mutex);
+
+        auto it = m_metrics.find(mkey);
+        if (it != m_metrics.end())
+        {
+            return *it->second;
+        }
+    }
+
+    // first call of the target and identity
+    unique_lock<shared_mutex> lock(m_mutex);
+
+    auto& metrics = m_metrics[mkey];
+    if (!metrics)
+    {
+        metrics = make_unique<Target_metrics>();
+    }
+
+    return *metrics;
+}
+
+Hedge_metrics& Upstream_metrics::get_hedge_metrics(string const& target)
+{
+    {
+        shared_lock<shared_mutex> lock(m_mutex);
+
+        auto it = m_hedge_metrics.find(target);
+        if (it != m_hedge_metrics.end())
+        {
+            return *it->second;
+        }
+    }
+
+    unique_lock<shared_mutex> lock(m_mutex);
+
+    auto& metrics = m_hedge_metrics[target];
+    if (!metrics)
+    {
+        metrics = make_unique<Hedge_metrics>();
+    }
+
+    return *metrics;
+}
+
+} // namespace upstream
+} // namespace imp
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <imp/app/app_config.h>
+#include <imp/upstream/upstream_profile.h>
+
+using imp::app::App_config;
+using RestClient::Connection;
+
+namespace imp
+{
+namespace upstream
+{
+
+Upstream_profile::Upstream_profile()
+: ca_file()
+, proxy()
+, user_agent()
+, timeout(0)
+, connect_timeout(0)
+, headers()
+{
+}
+
+void Upstream_profile::apply(Connection& connection) const
+{
+    if (!ca_file.empty())
+    {
+        connection.SetCAInfoFilePath(ca_file);
+    }
+
+    if (!proxy.empty())
+    {
+        connection.SetProxy(proxy);
+    }
+
+    if (!user_agent.empty())
+    {
+        connection.SetUserAgent(user_agent);
+    }
+
+    if (timeout.count() > 0)
+    {
+        connection.SetTimeoutMs(static_cast<int>(timeout.count()));
+    }
+
+    if (connect_timeout.count() > 0)
+    {
+        connection.SetConnectTimeoutMs(static_cast<int>(connect_timeout.count()));
+    }
+
+    // worker threads, no signals
+    connection.SetNoSignal(true);
+
+    for (auto const& header : headers)
+    {
+        connection.AppendHeader(header.first, header.second);
+    }
+
+    connection.SetPersistentOptions(true);
+}
+
+Upstream_profile Upstream_profile::from_config()
+{
+    auto app_config = App_config::get_instance();
+
+    Upstream_profile profile;
+    profile.ca_file = app_config->get_target_ca();
+    if (profile.ca_file.compare(0, 7, "file://") == 0)
+    {
+        profile.ca_file.erase(0, 7);
+    }
+    profile.proxy = app_config->get_target_proxy();
+    profile.user_agent = app_config->get_target_user_agent();
+    profile.timeout = app_config->get_target_timeout_ms();
+    profile.connect_timeout = app_config->get_target_connect_timeout();
+    profile.headers = app_config->get_target_headers();
+
+    return profile;
+}
+
+} // namespace upstream
+} // namespace imp
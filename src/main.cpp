@@ -7,12 +7,14 @@
  * https://opensource.org/license/mit/
  */
 
+#include <algorithm>
 #include <corvusoft/restbed/logger.hpp>
 #include <fstream>
 #include <iostream>
 #include <log4cplus/configurator.h>
 #include <log4cplus/logger.h>
 #include <log4cplus/loggingmacros.h>
+#include <map>
 #include <memory>
 #include <nlohmann/json.hpp>
 #include <openssl/crypto.h>
@@ -24,11 +26,30 @@
 #include <imp/app/app_config.h>
 #include <imp/app/error.h>
 #include <imp/app/log.h>
+#include <imp/crypto/key_store.h>
+#include <imp/restserver/metrics_service.h>
 #include <imp/restserver/service.h>
 #include <imp/scall/cavage12.h>
 #include <imp/scall/http_sign_factory.h>
 #include <imp/scall/wrapper_service.h>
 #include <imp/toolbox/toolbox.h>
+#include <imp/upstream/async_engine.h>
+#include <imp/upstream/buffer_pool.h>
+#include <imp/upstream/bulkhead.h>
+#include <imp/upstream/circuit_breaker.h>
+#include <imp/upstream/connection_pool.h>
+#include <imp/upstream/connection_warmer.h>
+#include <imp/upstream/curl_share.h>
+#include <imp/upstream/deadline_policy.h>
+#include <imp/upstream/dns_resolver.h>
+#include <imp/upstream/health_checker.h>
+#include <imp/upstream/hedge_policy.h>
+#include <imp/upstream/load_balancer.h>
+#include <imp/upstream/request_coalescer.h>
+#include <imp/upstream/response_cache.h>
+#include <imp/upstream/retry_policy.h>
+#include <imp/upstream/tls_session_store.h>
+#include <imp/upstream/upstream_metrics.h>
 
 // forward declare
 namespace restbed
@@ -39,10 +60,31 @@ class Settings;
 using imp::app::App_config;
 using imp::app::application_error;
 using imp::app::init_logger;
+using imp::crypto::Key_store;
+using imp::restserver::Metrics_service;
 using imp::restserver::service_ready_handler;
 using imp::scall::cavage12_sign;
 using imp::scall::Http_sign_factory;
 using imp::toolbox::demangle_typeid;
+using imp::upstream::Async_engine;
+using imp::upstream::Buffer_pool;
+using imp::upstream::Bulkhead;
+using imp::upstream::Circuit_breaker;
+using imp::upstream::Connection_pool;
+using imp::upstream::Connection_warmer;
+using imp::upstream::Curl_share;
+using imp::upstream::Deadline_policy;
+using imp::upstream::Dns_resolver;
+using imp::upstream::Health_checker;
+using imp::upstream::Hedge_policy;
+using imp::upstream::Load_balancer;
+using imp::upstream::Pool_key;
+using imp::upstream::Request_coalescer;
+using imp::upstream::Response_cache;
+using imp::upstream::Retry_policy;
+using imp::upstream::Tls_session_store;
+using imp::upstream::Upstream_metrics;
+using imp::upstream::Upstream_profile;
 using log4cplus::Logger;
 using nlohmann::json;
 using restbed::Settings;
@@ -52,6 +94,7 @@ using std::make_shared;
 using std::setlocale;
 using std::shared_ptr;
 using std::string;
+using std::unique_ptr;
 using std::vector;
 
 // ------------------------------------------------------------------------------------
@@ -162,6 +205,98 @@ int main(const int parc, const char** pars)
         //  - libcurl: global init should run before multi threaded part
         curl_global_init(CURL_GLOBAL_DEFAULT);
 
+        // Setup upstream
+        auto app_config = App_config::get_instance();
+
+        //  - client identities are parsed (and decrypted) once, keys/dir is not needed without mTLS
+        if (app_config->get_mtls_enabled())
+        {
+            Key_store::get_instance()->load(app_config->get_keys_dir(), [app_config](string const& key_id) { return app_config->get_password(key_id); });
+        }
+
+        //  - response buffers keep their capacity between the calls
+        Buffer_pool::set_limits(app_config->get_buffers_max_retained(), app_config->get_buffers_max_capacity());
+
+        //  - the calls are spread over the replicas of the target
+        Load_balancer::get_instance()->set_endpoints(app_config->get_target_endpoints(), app_config->get_target_balancing());
+
+        //  - the target names are resolved in advance, not by the calls
+        if (app_config->get_dns_enabled())
+        {
+            Dns_resolver::get_instance()->set_config(app_config->get_dns_refresh_interval());
+            Dns_resolver::get_instance()->start();
+        }
+
+        //  - warm connections are kept in the pool between the calls
+        Connection_pool::get_instance()->set_profile(Upstream_profile::from_config());
+        Connection_pool::get_instance()->set_limits(app_config->get_pool_max_idle(), app_config->get_pool_max_idle_per_key(), app_config->get_pool_idle_timeout());
+
+        //  - transient target failures are retried within a budget
+        Retry_policy::get_instance()->set_config(app_config->get_retry_enabled(), app_config->get_retry_max_attempts(), app_config->get_retry_base_backoff(), app_config->get_retry_max_backoff(), app_config->get_retry_budget_ratio(), app_config->get_retry_idempotency_header());
+
+        //  - slow calls are hedged with a second copy
+        Hedge_policy::get_instance()->set_config(app_config->get_hedge_enabled(), app_config->get_hedge_verbs(), app_config->get_hedge_percentile(), app_config->get_hedge_min_delay(), app_config->get_hedge_max_rate(), app_config->get_hedge_min_samples());
+
+        //  - a failing target is not waited for
+        Circuit_breaker::get_instance()->set_config(app_config->get_breaker_enabled(), app_config->get_breaker_window(), app_config->get_breaker_min_requests(), app_config->get_breaker_failure_rate(), app_config->get_breaker_open_time(), app_config->get_breaker_probes());
+
+        //  - identical GETs in flight share one call
+        Request_coalescer::get_instance()->set_config(app_config->get_coalescing_enabled(), app_config->get_coalescing_headers());
+
+        //  - cacheable answers are not fetched again
+        Response_cache::get_instance()->set_config(app_config->get_cache_enabled(), app_config->get_cache_max_bytes(), app_config->get_cache_max_entry_bytes(), app_config->get_cache_shards());
+
+        //  - calls nobody waits for are not sent
+        Deadline_policy::get_instance()->set_config(app_config->get_deadline_enabled(), app_config->get_deadline_header(), app_config->get_deadline_max_budget(), app_config->get_deadline_routes());
+
+        //  - a single identity can not hold all the workers
+        {
+            std::map<string, Bulkhead::Limits> limits;
+            for (auto const& [identity, limit] : app_config->get_bulkhead_identities())
+            {
+                limits[identity] = {limit.first, limit.second};
+            }
+            Bulkhead::get_instance()->set_config(app_config->get_bulkhead_enabled(), {app_config->get_bulkhead_max_concurrent(), app_config->get_bulkhead_max_queue()}, limits, app_config->get_bulkhead_queue_timeout(), app_config->get_bulkhead_reject_status());
+        }
+
+        //  - TLS sessions of the previous run are resumed
+        if (app_config->get_tls_sessions_enabled())
+        {
+            Tls_session_store::get_instance()->set_path(app_config->get_tls_sessions_file());
+            Tls_session_store::get_instance()->load();
+        }
+
+        //  - non-blocking engine, the restbed workers are not waiting for the target
+        if (app_config->get_async_enabled())
+        {
+            Async_engine::get_instance()->set_max_connections(app_config->get_async_max_connections());
+            Async_engine::get_instance()->set_max_concurrent_streams(app_config->get_target_max_concurrent_streams());
+            Async_engine::get_instance()->start();
+        }
+
+        //  - dead endpoints are found by probes, not by the calls
+        if (app_config->get_health_enabled())
+        {
+            Pool_key probe_key{"", app_config->get_health_identity(), app_config->get_target_verify_peer(), app_config->get_target_verify_host(), app_config->get_target_http2_enabled()};
+            Health_checker::get_instance()->set_config(probe_key, app_config->get_health_path(), app_config->get_health_interval(), app_config->get_health_timeout(), app_config->get_health_rise(), app_config->get_health_fall());
+            Health_checker::get_instance()->start();
+        }
+
+        //  - the handshakes are done before the service gets ready
+        if (app_config->get_warm_up_enabled())
+        {
+            vector<string> identities = app_config->get_mtls_enabled() ? Key_store::get_instance()->get_key_ids() : vector<string>{""};
+            Pool_key warm_key{"", "", app_config->get_target_verify_peer(), app_config->get_target_verify_host(), app_config->get_target_http2_enabled()};
+            // warm connections are used again before they would expire
+            Connection_warmer::get_instance()->set_config(warm_key, identities, app_config->get_warm_up_path(), app_config->get_warm_up_connections(), app_config->get_warm_up_threads(), app_config->get_pool_idle_timeout() / 2);
+            Connection_warmer::get_instance()->warm_up();
+
+            if (app_config->get_warm_up_keep_warm())
+            {
+                Connection_warmer::get_instance()->start();
+            }
+        }
+
         // Setup factories
         //  - Register connection handlers
         // Connection_factory::get_instance()->register_type("https", connection_https_creator);
@@ -197,6 +332,41 @@ int main(const int parc, const char** pars)
             // add services...
             imp::scall::WrapperService wrapper_api(service);
 
+            unique_ptr<Metrics_service> metrics_api;
+            if (App_config::get_instance()->get_metrics_enabled())
+            {
+                metrics_api = std::make_unique<Metrics_service>(service, App_config::get_instance()->get_metrics_path());
+            }
+
+            // idle upstream connections are closed after the idle timeout
+            service.schedule([]()
+                             { Connection_pool::get_instance()->evict_expired(); },
+                             App_config::get_instance()->get_pool_idle_timeout());
+
+            // calls waiting too long for their identity's slot are answered
+            if (App_config::get_instance()->get_bulkhead_enabled())
+            {
+                service.schedule([]()
+                                 { Bulkhead::get_instance()->expire_waiting(); },
+                                 std::max(std::chrono::milliseconds(10), App_config::get_instance()->get_bulkhead_queue_timeout() / 4));
+            }
+
+            // TLS sessions survive a crash as well
+            if (App_config::get_instance()->get_tls_sessions_enabled())
+            {
+                service.schedule([]()
+                                 { Tls_session_store::get_instance()->save(); },
+                                 App_config::get_instance()->get_tls_sessions_save_interval());
+            }
+
+            // upstream latency percentiles to the log
+            if (App_config::get_instance()->get_metrics_log_interval().count() > 0)
+            {
+                service.schedule([]()
+                                 { Upstream_metrics::get_instance()->log_dump(); },
+                                 App_config::get_instance()->get_metrics_log_interval());
+            }
+
             service.start(settings);
         }
         catch (std::system_error const& exc)
@@ -218,6 +388,15 @@ int main(const int parc, const char** pars)
     }
 
     // cleanup
+    Connection_warmer::get_instance()->stop();
+    Health_checker::get_instance()->stop();
+    Dns_resolver::get_instance()->stop();
+    Async_engine::get_instance()->stop();
+    Tls_session_store::get_instance()->save();
+    Connection_pool::get_instance()->clear();
+    // the singletons holding curl objects are destroyed only after main(), too late for curl
+    Curl_share::get_instance()->cleanup();
+    curl_global_cleanup();
     OPENSSL_cleanup();
 
     return exit_code;
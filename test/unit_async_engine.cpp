@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <catch2/catch_session.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+#include <log4cplus/configurator.h>
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/async_engine.h>
+#include <imp/upstream/bulkhead.h>
+#include <imp/upstream/circuit_breaker.h>
+#include <imp/upstream/connection_pool.h>
+#include <imp/upstream/curl_share.h>
+#include <imp/upstream/hedge_policy.h>
+#include <imp/upstream/response_cache.h>
+#include <imp/upstream/retry_policy.h>
+
+#include "unit_base.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+using namespace imp::upstream;
+
+/**
+ *  Accepts connections on a local port, and closes each of them without an answer,
+ *  after the delay given for it (in the order of the accepts).
+ */
+class Closing_server
+{
+    public:
+    explicit Closing_server(vector<chrono::milliseconds> const& delays)
+    : m_fd(socket(AF_INET, SOCK_STREAM, 0))
+    , m_port(0)
+    {
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+
+        socklen_t length = sizeof(addr);
+        bind(m_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+        listen(m_fd, 8);
+        getsockname(m_fd, reinterpret_cast<struct sockaddr*>(&addr), &length);
+        m_port = ntohs(addr.sin_port);
+
+        m_thread = thread([this, delays]() {
+            vector<thread> closers;
+
+            for (auto delay : delays)
+            {
+                int client = accept(m_fd, nullptr, nullptr);
+                if (client < 0)
+                {
+                    break;
+                }
+
+                closers.emplace_back([client, delay]() {
+                    this_thread::sleep_for(delay);
+                    close(client);
+                });
+            }
+
+            for (auto& closer : closers)
+            {
+                closer.join();
+            }
+        });
+    }
+
+    ~Closing_server()
+    {
+        shutdown(m_fd, SHUT_RDWR);
+        close(m_fd);
+        m_thread.join();
+    }
+
+    string get_url() const
+    {
+        return "http://127.0.0.1:" + to_string(m_port);
+    }
+
+    private:
+    int m_fd;
+    uint16_t m_port;
+    thread m_thread;
+};
+
+TEST_CASE("Hedge handed over after a failed original completes through an open breaker", "[async_engine]")
+{
+    // original fails at 300 ms, the hedge (sent at 100 ms) at 600 ms
+    Closing_server server({300ms, 600ms});
+
+    Hedge_policy::get_instance()->set_config(true, {"GET"}, 0.95, 100ms, 1.0, 0);
+    Circuit_breaker::get_instance()->set_config(true, 10000ms, 1, 0.5, 60000ms, 1);
+    Retry_policy::get_instance()->set_config(true, 3, 10ms, 10ms, 1.0, "Idempotency-Key");
+
+    auto engine = Async_engine::get_instance();
+    engine->start();
+
+    Pool_key key = {server.get_url(), "", false, false, false};
+    auto call = make_unique<Async_call>(Connection_pool::get_instance()->acquire(key));
+    call->method = "GET";
+    call->uri = "/slow";
+
+    promise<int> completed;
+    auto result = completed.get_future();
+    call->on_complete = [&completed](RestClient::Response& response) { completed.set_value(response.code); };
+
+    engine->submit(std::move(call));
+
+    // the failed original opened the breaker, the retry of the hedge is refused by it
+    REQUIRE(result.wait_for(5s) == future_status::ready);
+    REQUIRE(result.get() == 503);
+
+    engine->stop();
+}
+
+TEST_CASE("A call waiting in the bulkhead is signed when it is sent", "[async_engine]")
+{
+    Closing_server server({200ms, 0ms});
+
+    Hedge_policy::get_instance()->set_config(false, {"GET"}, 0.95, 100ms, 1.0, 0);
+    Circuit_breaker::get_instance()->set_config(false, 10000ms, 1, 0.5, 60000ms, 1);
+    Retry_policy::get_instance()->set_config(false, 3, 10ms, 10ms, 1.0, "Idempotency-Key");
+    Bulkhead::get_instance()->set_config(true, {1, 4}, {}, 5000ms, 429);
+
+    auto engine = Async_engine::get_instance();
+    engine->start();
+
+    Pool_key key = {server.get_url(), "", false, false, false};
+
+    promise<chrono::steady_clock::time_point> first_completed;
+    promise<chrono::steady_clock::time_point> second_signed;
+    promise<int> second_completed;
+
+    auto first = make_unique<Async_call>(Connection_pool::get_instance()->acquire(key));
+    first->uri = "/first";
+    first->on_complete = [&first_completed](RestClient::Response&) { first_completed.set_value(chrono::steady_clock::now()); };
+
+    auto second = make_unique<Async_call>(Connection_pool::get_instance()->acquire(key));
+    second->uri = "/second";
+    second->on_sign = [&second_signed](Async_call&) { second_signed.set_value(chrono::steady_clock::now()); };
+    second->on_complete = [&second_completed](RestClient::Response& response) { second_completed.set_value(response.code); };
+
+    engine->submit(std::move(first));
+    engine->submit(std::move(second));
+
+    auto completed = first_completed.get_future();
+    auto signed_at = second_signed.get_future();
+    auto result = second_completed.get_future();
+
+    REQUIRE(result.wait_for(5s) == future_status::ready);
+    REQUIRE(result.get() != 429);
+
+    // not when it was queued, but once the first one gave back the slot
+    REQUIRE(signed_at.get() >= completed.get());
+
+    engine->stop();
+    Bulkhead::get_instance()->set_config(false, {1, 4}, {}, 5000ms, 429);
+}
+
+TEST_CASE("A cache hit is neither signed nor sent", "[async_engine]")
+{
+    // nothing listens there, a call sent would fail
+    Pool_key key = {"http://127.0.0.1:1", "", false, false, false};
+
+    auto cache = Response_cache::get_instance();
+    cache->set_config(true, 1048576, 65536, 4);
+
+    RestClient::Response stored;
+    stored.code = 200;
+    stored.body = "cached";
+    stored.headers = {{"Cache-Control", "max-age=60"}};
+    cache->store(cache->make_key(key.base_url + "/cached", "a=1", ""), {}, stored);
+
+    auto engine = Async_engine::get_instance();
+    engine->start();
+
+    auto call = make_unique<Async_call>(Connection_pool::get_instance()->acquire(key));
+    call->uri = "/cached?a=1";
+
+    bool is_signed = false;
+    int code = 0;
+    string body;
+    call->on_sign = [&is_signed](Async_call&) { is_signed = true; };
+    call->on_complete = [&code, &body](RestClient::Response& response)
+    {
+        code = response.code;
+        body = response.body;
+    };
+
+    // answered on the calling thread
+    engine->submit(std::move(call));
+
+    REQUIRE(code == 200);
+    REQUIRE(body == "cached");
+    REQUIRE_FALSE(is_signed);
+    REQUIRE(engine->get_in_flight() == 0);
+
+    engine->stop();
+    cache->set_config(false, 1048576, 65536, 4);
+}
+
+TEST_CASE("An expired call is neither signed nor sent", "[async_engine]")
+{
+    Pool_key key = {"http://127.0.0.1:1", "", false, false, false};
+
+    auto engine = Async_engine::get_instance();
+    engine->start();
+
+    auto call = make_unique<Async_call>(Connection_pool::get_instance()->acquire(key));
+    call->uri = "/expired";
+    call->deadline = chrono::steady_clock::now() - 1ms;
+
+    atomic<bool> is_signed(false);
+    promise<int> completed;
+    auto result = completed.get_future();
+    call->on_sign = [&is_signed](Async_call&) { is_signed = true; };
+    call->on_complete = [&completed](RestClient::Response& response) { completed.set_value(response.code); };
+
+    engine->submit(std::move(call));
+
+    REQUIRE(result.wait_for(5s) == future_status::ready);
+    REQUIRE(result.get() == 504);
+    REQUIRE_FALSE(is_signed);
+
+    engine->stop();
+}
+
+TEST_CASE("Calls waiting in the bulkhead are answered when the engine stops", "[async_engine]")
+{
+    Closing_server server({2000ms});
+
+    Hedge_policy::get_instance()->set_config(false, {"GET"}, 0.95, 100ms, 1.0, 0);
+    Circuit_breaker::get_instance()->set_config(false, 10000ms, 1, 0.5, 60000ms, 1);
+    Retry_policy::get_instance()->set_config(false, 3, 10ms, 10ms, 1.0, "Idempotency-Key");
+    Bulkhead::get_instance()->set_config(true, {1, 4}, {}, 60000ms, 429);
+
+    auto engine = Async_engine::get_instance();
+    engine->start();
+
+    Pool_key key = {server.get_url(), "", false, false, false};
+
+    vector<promise<int>> completed(3);
+    for (auto& result : completed)
+    {
+        auto call = make_unique<Async_call>(Connection_pool::get_instance()->acquire(key));
+        call->uri = "/slow";
+        call->on_complete = [&result](RestClient::Response& response) { result.set_value(response.code); };
+        engine->submit(std::move(call));
+    }
+
+    this_thread::sleep_for(100ms);
+    engine->stop();
+
+    // the one in flight is aborted, the waiting ones are rejected
+    vector<int> codes;
+    for (auto& result : completed)
+    {
+        auto future = result.get_future();
+        REQUIRE(future.wait_for(0s) == future_status::ready);
+        codes.push_back(future.get());
+    }
+    REQUIRE(codes == vector<int>{CURLE_ABORTED_BY_CALLBACK, 503, 503});
+    REQUIRE(engine->get_in_flight() == 0);
+
+    Bulkhead::get_instance()->set_config(false, {1, 4}, {}, 5000ms, 429);
+}
+
+// ===========================================================================
+
+void init_logger()
+{
+    std::string log_config_filename = "log.ini";
+    char* log_config_filename_ptr = getenv("LOG4CPLUS_CONFIG");
+
+    if (log_config_filename_ptr)
+    {
+        log_config_filename = log_config_filename_ptr;
+    }
+
+    log4cplus::PropertyConfigurator::doConfigure(log_config_filename.c_str());
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("main"));
+    LOG4CPLUS_INFO(logger, LOG4CPLUS_TEXT("Logging initialized from: " << log_config_filename));
+}
+
+int main(int argc, char* argv[])
+{
+    init_logger();
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    int result = Catch::Session().run(argc, argv);
+
+    Connection_pool::get_instance()->clear();
+    Curl_share::get_instance()->cleanup();
+    curl_global_cleanup();
+
+    return result;
+}
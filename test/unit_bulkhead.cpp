@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <catch2/catch_session.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <log4cplus/configurator.h>
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/bulkhead.h>
+
+#include "unit_base.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+using imp::upstream::Bulkhead;
+using imp::upstream::Bulkhead_permit;
+
+// records what happened to each call
+struct Calls
+{
+    map<string, shared_ptr<Bulkhead_permit>> permits;
+    vector<string> admitted;
+    vector<pair<string, int>> rejected;
+
+    void acquire(string const& name, string const& identity, optional<imp::upstream::deadline_t> deadline = nullopt)
+    {
+        Bulkhead::get_instance()->acquire(
+            identity,
+            [this, name](shared_ptr<Bulkhead_permit> permit)
+            {
+                permits[name] = permit;
+                admitted.push_back(name);
+            },
+            [this, name](int status) { rejected.emplace_back(name, status); },
+            deadline);
+    }
+
+    // the next waiter is admitted from the destructor of the permit, so it is moved out first
+    void release(string const& name)
+    {
+        auto permit = std::move(permits[name]);
+        permits.erase(name);
+    }
+};
+
+TEST_CASE("Disabled bulkhead admits everything", "[bulkhead]")
+{
+    Bulkhead::get_instance()->set_config(false, {1, 0}, {}, 1000ms, 429);
+
+    Calls calls;
+    calls.acquire("a", "");
+    calls.acquire("b", "");
+    calls.acquire("c", "");
+
+    REQUIRE(calls.admitted.size() == 3);
+    REQUIRE(calls.rejected.empty());
+}
+
+TEST_CASE("Queueing and handing over the slot", "[bulkhead]")
+{
+    Bulkhead::get_instance()->set_config(true, {2, 2}, {}, 10000ms, 429);
+
+    Calls calls;
+    calls.acquire("a", "");
+    calls.acquire("b", "");
+    REQUIRE(calls.admitted == vector<string>{"a", "b"});
+
+    // waiting, then the queue is full
+    calls.acquire("c", "");
+    calls.acquire("d", "");
+    calls.acquire("e", "");
+    REQUIRE(calls.admitted.size() == 2);
+    REQUIRE(calls.rejected == vector<pair<string, int>>{{"e", 429}});
+
+    // a released slot goes to the oldest waiter
+    calls.release("a");
+    REQUIRE(calls.admitted == vector<string>{"a", "b", "c"});
+
+    calls.release("b");
+    REQUIRE(calls.admitted == vector<string>{"a", "b", "c", "d"});
+
+    // nobody waits, the slot is free again
+    calls.release("c");
+    calls.acquire("f", "");
+    REQUIRE(calls.admitted.back() == "f");
+    REQUIRE(calls.rejected.size() == 1);
+}
+
+TEST_CASE("Queue timeout", "[bulkhead]")
+{
+    Bulkhead::get_instance()->set_config(true, {1, 3}, {}, 50ms, 429);
+
+    Calls calls;
+    calls.acquire("a", "");
+    calls.acquire("b", "");
+
+    Bulkhead::get_instance()->expire_waiting();
+    REQUIRE(calls.rejected.empty());
+
+    this_thread::sleep_for(100ms);
+    calls.acquire("c", "");
+
+    Bulkhead::get_instance()->expire_waiting();
+    REQUIRE(calls.rejected == vector<pair<string, int>>{{"b", 503}});
+
+    // an expired waiter is skipped on release, the next one gets the slot
+    calls.acquire("d", "");
+    this_thread::sleep_for(100ms);
+    calls.acquire("e", "");
+
+    calls.release("a");
+    REQUIRE(calls.rejected == vector<pair<string, int>>{{"b", 503}, {"c", 503}, {"d", 503}});
+    REQUIRE(calls.admitted == vector<string>{"a", "e"});
+}
+
+TEST_CASE("Deadlines", "[bulkhead]")
+{
+    Bulkhead::get_instance()->set_config(true, {1, 2}, {}, 10000ms, 429);
+
+    Calls calls;
+
+    // already over
+    calls.acquire("a", "", chrono::steady_clock::now() - 1ms);
+    REQUIRE(calls.rejected == vector<pair<string, int>>{{"a", 504}});
+
+    // waits only until the deadline
+    calls.acquire("b", "");
+    calls.acquire("c", "", chrono::steady_clock::now() + 50ms);
+
+    this_thread::sleep_for(100ms);
+    Bulkhead::get_instance()->expire_waiting();
+    REQUIRE(calls.rejected.back() == pair<string, int>{"c", 504});
+}
+
+TEST_CASE("Compartments", "[bulkhead]")
+{
+    Bulkhead::get_instance()->set_config(true, {1, 0}, {{"partner", {2, 0}}}, 1000ms, 429);
+
+    Calls calls;
+
+    // a configured identity has its own limits
+    calls.acquire("p1", "partner");
+    calls.acquire("p2", "partner");
+    calls.acquire("p3", "partner");
+    REQUIRE(calls.admitted == vector<string>{"p1", "p2"});
+
+    // unknown identities share the anonymous compartment
+    calls.acquire("u1", "unknown-1");
+    calls.acquire("u2", "unknown-2");
+    calls.acquire("u3", "");
+    REQUIRE(calls.admitted == vector<string>{"p1", "p2", "u1"});
+    REQUIRE(calls.rejected == vector<pair<string, int>>{{"p3", 429}, {"u2", 429}, {"u3", 429}});
+
+    REQUIRE(calls.permits["u1"]->get_identity().empty());
+
+    string text = Bulkhead::get_instance()->get_text();
+    REQUIRE(text.find("scall_bulkhead_in_use{identity=\"partner\"} 2") != string::npos);
+    REQUIRE(text.find("scall_bulkhead_in_use{identity=\"\"} 1") != string::npos);
+    REQUIRE(text.find("unknown-1") == string::npos);
+    REQUIRE(text.find("unknown-2") == string::npos);
+}
+
+TEST_CASE("Rejecting the waiters", "[bulkhead]")
+{
+    Bulkhead::get_instance()->set_config(true, {1, 2}, {{"partner", {1, 1}}}, 10000ms, 429);
+
+    Calls calls;
+    calls.acquire("a", "");
+    calls.acquire("b", "");
+    calls.acquire("p1", "partner");
+    calls.acquire("p2", "partner");
+
+    Bulkhead::get_instance()->reject_waiting(503);
+    REQUIRE(calls.rejected == vector<pair<string, int>>{{"b", 503}, {"p2", 503}});
+
+    // nobody is left to hand the slot over to
+    calls.release("a");
+    REQUIRE(calls.admitted == vector<string>{"a", "p1"});
+}
+
+// ===========================================================================
+
+void init_logger()
+{
+    std::string log_config_filename = "log.ini";
+    char* log_config_filename_ptr = getenv("LOG4CPLUS_CONFIG");
+
+    if (log_config_filename_ptr)
+    {
+        log_config_filename = log_config_filename_ptr;
+    }
+
+    log4cplus::PropertyConfigurator::doConfigure(log_config_filename.c_str());
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("main"));
+    LOG4CPLUS_INFO(logger, LOG4CPLUS_TEXT("Logging initialized from: " << log_config_filename));
+}
+
+int main(int argc, char* argv[])
+{
+    init_logger();
+
+    int result = Catch::Session().run(argc, argv);
+
+    return result;
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <catch2/catch_session.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <thread>
+#include <log4cplus/configurator.h>
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/circuit_breaker.h>
+
+#include "unit_base.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+using imp::upstream::Circuit_breaker;
+
+static RestClient::Response make_response(int code)
+{
+    RestClient::Response response;
+    response.code = code;
+    return response;
+}
+
+TEST_CASE("Failures", "[circuit_breaker]")
+{
+    REQUIRE(Circuit_breaker::is_failure(make_response(28)));
+    REQUIRE(Circuit_breaker::is_failure(make_response(502)));
+    REQUIRE(Circuit_breaker::is_failure(make_response(503)));
+    REQUIRE(Circuit_breaker::is_failure(make_response(504)));
+
+    REQUIRE_FALSE(Circuit_breaker::is_failure(make_response(200)));
+    REQUIRE_FALSE(Circuit_breaker::is_failure(make_response(404)));
+    REQUIRE_FALSE(Circuit_breaker::is_failure(make_response(500)));
+}
+
+TEST_CASE("Disabled breaker lets everything through", "[circuit_breaker]")
+{
+    auto breaker = Circuit_breaker::get_instance();
+    breaker->set_config(false, 10000ms, 1, 0.5, 60000ms, 1);
+
+    breaker->record("http://disabled", make_response(503));
+    breaker->record("http://disabled", make_response(503));
+
+    REQUIRE(breaker->allow("http://disabled"));
+    REQUIRE(breaker->get_state("http://disabled") == Circuit_breaker::State::closed);
+}
+
+TEST_CASE("Closed, open, half open, closed", "[circuit_breaker]")
+{
+    const string target = "http://target";
+
+    auto breaker = Circuit_breaker::get_instance();
+    breaker->set_config(true, 10000ms, 4, 0.5, 100ms, 2);
+
+    // below min_requests, the failure rate does not count yet
+    breaker->record(target, make_response(200));
+    breaker->record(target, make_response(200));
+    breaker->record(target, make_response(503));
+    REQUIRE(breaker->get_state(target) == Circuit_breaker::State::closed);
+    REQUIRE(breaker->allow(target));
+
+    // 2 of 4 failed
+    breaker->record(target, make_response(504));
+    REQUIRE(breaker->get_state(target) == Circuit_breaker::State::open);
+    REQUIRE_FALSE(breaker->allow(target));
+
+    // after open_time only the probes go through
+    this_thread::sleep_for(150ms);
+    REQUIRE(breaker->allow(target));
+    REQUIRE(breaker->get_state(target) == Circuit_breaker::State::half_open);
+    REQUIRE(breaker->allow(target));
+    REQUIRE_FALSE(breaker->allow(target));
+
+    // all the probes have to pass
+    breaker->record(target, make_response(200));
+    REQUIRE(breaker->get_state(target) == Circuit_breaker::State::half_open);
+    breaker->record(target, make_response(200));
+    REQUIRE(breaker->get_state(target) == Circuit_breaker::State::closed);
+    REQUIRE(breaker->allow(target));
+}
+
+TEST_CASE("A failed probe opens again", "[circuit_breaker]")
+{
+    const string target = "http://probe";
+
+    auto breaker = Circuit_breaker::get_instance();
+    breaker->set_config(true, 10000ms, 1, 0.5, 100ms, 1);
+
+    breaker->record(target, make_response(502));
+    REQUIRE(breaker->get_state(target) == Circuit_breaker::State::open);
+
+    this_thread::sleep_for(150ms);
+    REQUIRE(breaker->allow(target));
+    REQUIRE_FALSE(breaker->allow(target));
+
+    breaker->record(target, make_response(28));
+    REQUIRE(breaker->get_state(target) == Circuit_breaker::State::open);
+    REQUIRE_FALSE(breaker->allow(target));
+}
+
+TEST_CASE("Targets are separate", "[circuit_breaker]")
+{
+    auto breaker = Circuit_breaker::get_instance();
+    breaker->set_config(true, 10000ms, 1, 0.5, 60000ms, 1);
+
+    breaker->record("http://down", make_response(503));
+
+    REQUIRE_FALSE(breaker->allow("http://down"));
+    REQUIRE(breaker->allow("http://up"));
+}
+
+// ===========================================================================
+
+void init_logger()
+{
+    std::string log_config_filename = "log.ini";
+    char* log_config_filename_ptr = getenv("LOG4CPLUS_CONFIG");
+
+    if (log_config_filename_ptr)
+    {
+        log_config_filename = log_config_filename_ptr;
+    }
+
+    log4cplus::PropertyConfigurator::doConfigure(log_config_filename.c_str());
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("main"));
+    LOG4CPLUS_INFO(logger, LOG4CPLUS_TEXT("Logging initialized from: " << log_config_filename));
+}
+
+int main(int argc, char* argv[])
+{
+    init_logger();
+
+    int result = Catch::Session().run(argc, argv);
+
+    return result;
+}
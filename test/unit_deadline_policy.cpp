@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <catch2/catch_session.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <log4cplus/configurator.h>
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/deadline_policy.h>
+
+#include "unit_base.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+using imp::upstream::Deadline_policy;
+using imp::upstream::deadline_t;
+
+typedef multimap<string, string> headers_t;
+
+static Deadline_policy* make_policy(map<string, chrono::milliseconds> const& routes = {{"/", 10000ms}, {"/accounts", 5000ms}, {"/accounts/export", 60000ms}})
+{
+    auto policy = Deadline_policy::get_instance();
+    policy->set_config(true, "X-Request-Timeout-Ms", 30000ms, routes);
+    return policy;
+}
+
+// the budget given to the call, or -1ms if it has none
+static chrono::milliseconds get_budget(string const& path, headers_t const& headers = {})
+{
+    deadline_t received = chrono::steady_clock::now();
+    auto deadline = Deadline_policy::get_instance()->get_deadline(path, headers, received);
+    if (!deadline)
+    {
+        return -1ms;
+    }
+    return chrono::duration_cast<chrono::milliseconds>(*deadline - received);
+}
+
+TEST_CASE("Disabled policy", "[deadline_policy]")
+{
+    Deadline_policy::get_instance()->set_config(false, "X-Request-Timeout-Ms", 30000ms, {{"/", 10000ms}});
+
+    REQUIRE(get_budget("/accounts", {{"X-Request-Timeout-Ms", "100"}}) == -1ms);
+}
+
+TEST_CASE("Longest matching route", "[deadline_policy]")
+{
+    make_policy();
+
+    REQUIRE(get_budget("/accounts") == 5000ms);
+    REQUIRE(get_budget("/accounts/1") == 5000ms);
+    REQUIRE(get_budget("/accounts/export") == 60000ms);
+    REQUIRE(get_budget("/accounts/export/all") == 60000ms);
+
+    // between the longer routes, only the prefix matches
+    REQUIRE(get_budget("/accounts/b") == 5000ms);
+    REQUIRE(get_budget("/payments") == 10000ms);
+
+    make_policy({{"/accounts", 5000ms}});
+    REQUIRE(get_budget("/payments") == -1ms);
+    REQUIRE(get_budget("/") == -1ms);
+}
+
+TEST_CASE("The earlier of the client and the route wins", "[deadline_policy]")
+{
+    make_policy();
+
+    REQUIRE(get_budget("/accounts", {{"x-request-timeout-ms", "100"}}) == 100ms);
+    REQUIRE(get_budget("/accounts", {{"X-Request-Timeout-Ms", "8000"}}) == 5000ms);
+
+    // the client alone
+    make_policy({});
+    REQUIRE(get_budget("/accounts", {{"X-Request-Timeout-Ms", "8000"}}) == 8000ms);
+    REQUIRE(get_budget("/accounts") == -1ms);
+}
+
+TEST_CASE("Client budgets not taken", "[deadline_policy]")
+{
+    make_policy();
+
+    REQUIRE(get_budget("/accounts", {{"X-Request-Timeout-Ms", "0"}}) == 5000ms);
+    REQUIRE(get_budget("/accounts", {{"X-Request-Timeout-Ms", "-100"}}) == 5000ms);
+    REQUIRE(get_budget("/accounts", {{"X-Request-Timeout-Ms", "soon"}}) == 5000ms);
+    REQUIRE(get_budget("/accounts", {{"X-Request-Timeout-Ms", ""}}) == 5000ms);
+}
+
+TEST_CASE("The client budget is limited", "[deadline_policy]")
+{
+    make_policy({});
+
+    REQUIRE(get_budget("/accounts", {{"X-Request-Timeout-Ms", "60000"}}) == 30000ms);
+    REQUIRE(get_budget("/accounts", {{"X-Request-Timeout-Ms", "9223372036854775807"}}) == 30000ms);
+    REQUIRE(get_budget("/accounts", {{"X-Request-Timeout-Ms", "99999999999999999999999"}}) == 30000ms);
+}
+
+TEST_CASE("Remaining time", "[deadline_policy]")
+{
+    REQUIRE_FALSE(Deadline_policy::is_expired(nullopt));
+
+    deadline_t deadline = chrono::steady_clock::now() + 50ms;
+    REQUIRE_FALSE(Deadline_policy::is_expired(deadline));
+    REQUIRE(Deadline_policy::get_remaining(deadline) > 0ms);
+    REQUIRE(Deadline_policy::get_remaining(deadline) <= 50ms);
+
+    this_thread::sleep_for(100ms);
+    REQUIRE(Deadline_policy::is_expired(deadline));
+    REQUIRE(Deadline_policy::get_remaining(deadline) == 0ms);
+}
+
+// ===========================================================================
+
+void init_logger()
+{
+    std::string log_config_filename = "log.ini";
+    char* log_config_filename_ptr = getenv("LOG4CPLUS_CONFIG");
+
+    if (log_config_filename_ptr)
+    {
+        log_config_filename = log_config_filename_ptr;
+    }
+
+    log4cplus::PropertyConfigurator::doConfigure(log_config_filename.c_str());
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("main"));
+    LOG4CPLUS_INFO(logger, LOG4CPLUS_TEXT("Logging initialized from: " << log_config_filename));
+}
+
+int main(int argc, char* argv[])
+{
+    init_logger();
+
+    int result = Catch::Session().run(argc, argv);
+
+    return result;
+}
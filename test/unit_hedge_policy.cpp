@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <catch2/catch_session.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <string>
+#include <log4cplus/configurator.h>
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/hedge_policy.h>
+#include <imp/upstream/upstream_metrics.h>
+
+#include "unit_base.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+using imp::upstream::Hedge_policy;
+using imp::upstream::Pool_key;
+using imp::upstream::Upstream_metrics;
+
+static void record(string const& target, string const& identity, double seconds)
+{
+    RestClient::Connection::RequestInfo info = {};
+    info.totalTime = seconds;
+    info.startTransferTime = seconds;
+
+    Upstream_metrics::get_instance()->record(Pool_key{target, identity, true, true, false}, info);
+}
+
+TEST_CASE("The delay comes from all the calls of the target", "[hedge_policy]")
+{
+    auto policy = Hedge_policy::get_instance();
+    policy->set_config(true, {"GET"}, 0.95, 10ms, 0.05, 10);
+
+    const string target = "http://delay";
+
+    // 5 + 5 samples: neither identity has enough on its own
+    for (int i = 0; i < 5; ++i)
+    {
+        record(target, "alice", 0.1);
+    }
+    REQUIRE_FALSE(policy->get_delay(target));
+
+    for (int i = 0; i < 5; ++i)
+    {
+        record(target, "bob", 0.1);
+    }
+
+    auto delay = policy->get_delay(target);
+    REQUIRE(delay);
+    REQUIRE(*delay >= 90ms);
+    REQUIRE(*delay <= 110ms);
+
+    REQUIRE_FALSE(policy->get_delay("http://other"));
+}
+
+TEST_CASE("The delay is at least min_delay", "[hedge_policy]")
+{
+    auto policy = Hedge_policy::get_instance();
+    policy->set_config(true, {"GET"}, 0.95, 50ms, 0.05, 1);
+
+    record("http://fast", "", 0.001);
+
+    REQUIRE(policy->get_delay("http://fast") == chrono::microseconds(50ms));
+}
+
+TEST_CASE("Hedges are limited per target", "[hedge_policy]")
+{
+    auto policy = Hedge_policy::get_instance();
+    policy->set_config(true, {"GET"}, 0.95, 10ms, 0.1, 0);
+
+    const string target = "http://rate";
+    auto& metrics = Upstream_metrics::get_instance()->get_hedge_metrics(target);
+
+    metrics.candidates.fetch_add(20);
+
+    REQUIRE(policy->try_hedge(target));
+    REQUIRE(policy->try_hedge(target));
+    REQUIRE_FALSE(policy->try_hedge(target));
+    REQUIRE(metrics.sent.load() == 2);
+
+    metrics.candidates.fetch_add(10);
+    REQUIRE(policy->try_hedge(target));
+    REQUIRE_FALSE(policy->try_hedge(target));
+}
+
+TEST_CASE("Hedged verbs", "[hedge_policy]")
+{
+    auto policy = Hedge_policy::get_instance();
+    policy->set_config(true, {"GET", "HEAD"}, 0.95, 10ms, 0.05, 100);
+
+    REQUIRE(policy->is_hedgeable("GET"));
+    REQUIRE_FALSE(policy->is_hedgeable("POST"));
+
+    policy->set_config(false, {"GET", "HEAD"}, 0.95, 10ms, 0.05, 100);
+    REQUIRE_FALSE(policy->is_hedgeable("GET"));
+}
+
+// ===========================================================================
+
+void init_logger()
+{
+    std::string log_config_filename = "log.ini";
+    char* log_config_filename_ptr = getenv("LOG4CPLUS_CONFIG");
+
+    if (log_config_filename_ptr)
+    {
+        log_config_filename = log_config_filename_ptr;
+    }
+
+    log4cplus::PropertyConfigurator::doConfigure(log_config_filename.c_str());
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("main"));
+    LOG4CPLUS_INFO(logger, LOG4CPLUS_TEXT("Logging initialized from: " << log_config_filename));
+}
+
+int main(int argc, char* argv[])
+{
+    init_logger();
+
+    int result = Catch::Session().run(argc, argv);
+
+    return result;
+}
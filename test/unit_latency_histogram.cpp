@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <catch2/catch_session.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <log4cplus/configurator.h>
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/latency_histogram.h>
+
+#include "unit_base.h"
+
+using namespace std;
+using imp::upstream::Latency_histogram;
+
+// the buckets are 1/16 of a power of two wide
+static bool is_near(uint64_t value, uint64_t expected)
+{
+    return std::abs(static_cast<double>(value) - static_cast<double>(expected)) <= expected * 0.0625;
+}
+
+TEST_CASE("Empty histogram", "[latency_histogram]")
+{
+    Latency_histogram histogram;
+
+    auto snapshot = histogram.get_snapshot();
+    REQUIRE(snapshot.count == 0);
+    REQUIRE(snapshot.sum_us == 0);
+    REQUIRE(snapshot.max_us == 0);
+    REQUIRE(snapshot.p50_us == 0);
+    REQUIRE(snapshot.p999_us == 0);
+}
+
+TEST_CASE("Small values are exact", "[latency_histogram]")
+{
+    Latency_histogram histogram;
+
+    for (uint64_t value = 1; value <= 10; ++value)
+    {
+        histogram.record(value);
+    }
+
+    REQUIRE(histogram.get_count() == 10);
+    REQUIRE(histogram.get_percentile(0.5) == 5);
+    REQUIRE(histogram.get_percentile(0.9) == 9);
+    REQUIRE(histogram.get_percentile(1.0) == 10);
+    REQUIRE(histogram.get_percentile(0.0) == 1);
+}
+
+TEST_CASE("Quantiles of a uniform distribution", "[latency_histogram]")
+{
+    Latency_histogram histogram;
+
+    uint64_t sum = 0;
+    for (uint64_t value = 1; value <= 100000; ++value)
+    {
+        histogram.record(value);
+        sum += value;
+    }
+
+    auto snapshot = histogram.get_snapshot();
+    REQUIRE(snapshot.count == 100000);
+    REQUIRE(snapshot.sum_us == sum);
+    REQUIRE(snapshot.max_us == 100000);
+
+    REQUIRE(is_near(snapshot.p50_us, 50000));
+    REQUIRE(is_near(snapshot.p90_us, 90000));
+    REQUIRE(is_near(snapshot.p99_us, 99000));
+    REQUIRE(is_near(snapshot.p999_us, 99900));
+
+    REQUIRE(snapshot.p50_us <= snapshot.p90_us);
+    REQUIRE(snapshot.p90_us <= snapshot.p99_us);
+    REQUIRE(snapshot.p99_us <= snapshot.p999_us);
+    REQUIRE(snapshot.p999_us <= snapshot.max_us);
+}
+
+TEST_CASE("Outliers", "[latency_histogram]")
+{
+    Latency_histogram histogram;
+
+    for (int i = 0; i < 999; ++i)
+    {
+        histogram.record(1000);
+    }
+    histogram.record(5000000);
+
+    REQUIRE(is_near(histogram.get_percentile(0.5), 1000));
+    REQUIRE(is_near(histogram.get_percentile(0.999), 1000));
+
+    // the top bucket is capped by the largest value seen
+    REQUIRE(histogram.get_percentile(1.0) == 5000000);
+}
+
+TEST_CASE("Values above the range", "[latency_histogram]")
+{
+    Latency_histogram histogram;
+
+    histogram.record(uint64_t(1) << 50);
+
+    REQUIRE(histogram.get_count() == 1);
+    REQUIRE(histogram.get_percentile(0.5) > 0);
+    REQUIRE(histogram.get_percentile(0.5) <= (uint64_t(1) << 50));
+}
+
+// ===========================================================================
+
+void init_logger()
+{
+    std::string log_config_filename = "log.ini";
+    char* log_config_filename_ptr = getenv("LOG4CPLUS_CONFIG");
+
+    if (log_config_filename_ptr)
+    {
+        log_config_filename = log_config_filename_ptr;
+    }
+
+    log4cplus::PropertyConfigurator::doConfigure(log_config_filename.c_str());
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("main"));
+    LOG4CPLUS_INFO(logger, LOG4CPLUS_TEXT("Logging initialized from: " << log_config_filename));
+}
+
+int main(int argc, char* argv[])
+{
+    init_logger();
+
+    int result = Catch::Session().run(argc, argv);
+
+    return result;
+}
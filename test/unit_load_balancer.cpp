@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <catch2/catch_session.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <map>
+#include <string>
+#include <vector>
+#include <log4cplus/configurator.h>
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/load_balancer.h>
+
+#include "unit_base.h"
+
+using namespace std;
+using imp::upstream::Load_balancer;
+
+static vector<string> pick_urls(size_t count)
+{
+    vector<string> urls;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto lease = Load_balancer::get_instance()->pick();
+        urls.push_back(lease ? lease->get_base_url() : string());
+    }
+
+    return urls;
+}
+
+TEST_CASE("No endpoints", "[load_balancer]")
+{
+    Load_balancer::get_instance()->set_endpoints({}, "round_robin");
+
+    REQUIRE_FALSE(Load_balancer::get_instance()->pick());
+}
+
+TEST_CASE("Smooth weighted round robin", "[load_balancer]")
+{
+    Load_balancer::get_instance()->set_endpoints({{"http://a", 5}, {"http://b", 1}, {"http://c", 1}}, "round_robin");
+
+    // the heavy endpoint is interleaved with the others, not picked 5 times in a row
+    vector<string> expected = {"http://a", "http://a", "http://b", "http://a", "http://c", "http://a", "http://a"};
+    REQUIRE(pick_urls(7) == expected);
+    REQUIRE(pick_urls(7) == expected);
+
+    map<string, int> counts;
+    for (auto const& url : pick_urls(700))
+    {
+        ++counts[url];
+    }
+    REQUIRE(counts["http://a"] == 500);
+    REQUIRE(counts["http://b"] == 100);
+    REQUIRE(counts["http://c"] == 100);
+}
+
+TEST_CASE("Down endpoints are skipped", "[load_balancer]")
+{
+    auto balancer = Load_balancer::get_instance();
+    balancer->set_endpoints({{"http://a", 1}, {"http://b", 1}, {"http://c", 1}}, "round_robin");
+
+    balancer->find("http://b")->set_healthy(false);
+    for (auto const& url : pick_urls(30))
+    {
+        REQUIRE(url != "http://b");
+    }
+
+    // all down: still tried, rather than failing for sure
+    balancer->find("http://a")->set_healthy(false);
+    balancer->find("http://c")->set_healthy(false);
+
+    map<string, int> counts;
+    for (auto const& url : pick_urls(30))
+    {
+        ++counts[url];
+    }
+    REQUIRE(counts.size() == 3);
+    REQUIRE(counts["http://b"] == 10);
+
+    balancer->find("http://b")->set_healthy(true);
+    for (auto const& url : pick_urls(10))
+    {
+        REQUIRE(url == "http://b");
+    }
+}
+
+TEST_CASE("Lease counts the outstanding calls", "[load_balancer]")
+{
+    auto balancer = Load_balancer::get_instance();
+    balancer->set_endpoints({{"http://a", 1}}, "least_outstanding");
+
+    auto endpoint = balancer->find("http://a");
+    REQUIRE(endpoint->get_outstanding() == 0);
+
+    {
+        auto first = balancer->pick();
+        auto second = balancer->pick();
+        REQUIRE(endpoint->get_outstanding() == 2);
+    }
+
+    REQUIRE(endpoint->get_outstanding() == 0);
+}
+
+// ===========================================================================
+
+void init_logger()
+{
+    std::string log_config_filename = "log.ini";
+    char* log_config_filename_ptr = getenv("LOG4CPLUS_CONFIG");
+
+    if (log_config_filename_ptr)
+    {
+        log_config_filename = log_config_filename_ptr;
+    }
+
+    log4cplus::PropertyConfigurator::doConfigure(log_config_filename.c_str());
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("main"));
+    LOG4CPLUS_INFO(logger, LOG4CPLUS_TEXT("Logging initialized from: " << log_config_filename));
+}
+
+int main(int argc, char* argv[])
+{
+    init_logger();
+
+    int result = Catch::Session().run(argc, argv);
+
+    return result;
+}
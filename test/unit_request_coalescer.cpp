@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <catch2/catch_session.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <log4cplus/configurator.h>
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/request_coalescer.h>
+
+#include "unit_base.h"
+
+using namespace std;
+using imp::upstream::completion_fn;
+using imp::upstream::Flight_guard;
+using imp::upstream::Header_store;
+using imp::upstream::Request_coalescer;
+
+typedef multimap<string, string> headers_t;
+
+static Request_coalescer* make_coalescer(set<string> const& headers = {"Accept"})
+{
+    auto coalescer = Request_coalescer::get_instance();
+    coalescer->set_config(true, headers);
+    return coalescer;
+}
+
+// collects the answers of the waiters
+struct Answers
+{
+    vector<RestClient::Response> responses;
+
+    completion_fn add()
+    {
+        return [this](RestClient::Response& response) { responses.push_back(response); };
+    }
+};
+
+TEST_CASE("Only GETs", "[request_coalescer]")
+{
+    auto coalescer = make_coalescer();
+
+    REQUIRE(coalescer->is_coalescable("GET"));
+    REQUIRE_FALSE(coalescer->is_coalescable("HEAD"));
+    REQUIRE_FALSE(coalescer->is_coalescable("POST"));
+
+    coalescer->set_config(false, {});
+    REQUIRE_FALSE(coalescer->is_coalescable("GET"));
+}
+
+TEST_CASE("Keys", "[request_coalescer]")
+{
+    auto coalescer = make_coalescer({"Accept", "X-Tenant"});
+
+    headers_t headers = {{"Accept", "application/json"}, {"X-Trace", "1"}};
+    string key = coalescer->make_key("GET", "/accounts", "id=1", "key-1", headers);
+
+    // identical calls, the header names are case insensitive, not configured headers do not count
+    REQUIRE(key == coalescer->make_key("GET", "/accounts", "id=1", "key-1", headers));
+    REQUIRE(key == coalescer->make_key("GET", "/accounts", "id=1", "key-1", {{"accept", "application/json"}, {"X-Trace", "2"}}));
+
+    // anything else differs
+    REQUIRE(key != coalescer->make_key("GET", "/accounts", "id=2", "key-1", headers));
+    REQUIRE(key != coalescer->make_key("GET", "/accounts/1", "", "key-1", headers));
+    REQUIRE(key != coalescer->make_key("GET", "/accounts", "id=1", "key-2", headers));
+    REQUIRE(key != coalescer->make_key("GET", "/accounts", "id=1", "key-1", {{"Accept", "application/xml"}}));
+    REQUIRE(key != coalescer->make_key("GET", "/accounts", "id=1", "key-1", {{"Accept", "application/json"}, {"X-Tenant", "a"}}));
+
+    // the parts can not be shifted into each other
+    REQUIRE(coalescer->make_key("GET", "/a", "b", "", {}) != coalescer->make_key("GET", "/a?b", "", "", {}));
+}
+
+TEST_CASE("Waiters get a copy of the answer of the leader", "[request_coalescer]")
+{
+    auto coalescer = make_coalescer();
+    string key = coalescer->make_key("GET", "/accounts", "", "", {});
+
+    Answers leader;
+    Answers waiters;
+
+    REQUIRE_FALSE(coalescer->join(key, waiters.add()));
+    REQUIRE_FALSE(coalescer->has_waiters(key));
+
+    REQUIRE(coalescer->join(key, waiters.add()));
+    REQUIRE(coalescer->join(key, waiters.add()));
+    REQUIRE(coalescer->has_waiters(key));
+
+    auto on_complete = coalescer->lead(key, leader.add());
+
+    RestClient::Response response{200, "body", {{"Content-Type", "text/plain"}}};
+    on_complete(response);
+
+    REQUIRE(leader.responses.size() == 1);
+    REQUIRE(waiters.responses.size() == 2);
+    for (auto const& copy : waiters.responses)
+    {
+        REQUIRE(copy.code == 200);
+        REQUIRE(copy.body == "body");
+        REQUIRE(copy.headers.find("Content-Type")->second == "text/plain");
+    }
+
+    // the key is free again, the next call leads
+    REQUIRE_FALSE(coalescer->has_waiters(key));
+    REQUIRE_FALSE(coalescer->join(key, waiters.add()));
+    coalescer->complete(key, response);
+}
+
+TEST_CASE("Waiters get the headers of the header store", "[request_coalescer]")
+{
+    auto coalescer = make_coalescer();
+    string key = coalescer->make_key("GET", "/accounts", "", "", {});
+
+    Answers waiters;
+
+    REQUIRE_FALSE(coalescer->join(key, nullptr));
+    REQUIRE(coalescer->join(key, waiters.add()));
+
+    auto store = make_shared<Header_store>();
+    const char* line = "ETag: \"v1\"\r\n";
+    store->append_line(line, strlen(line));
+
+    auto on_complete = coalescer->lead(key, nullptr, store);
+
+    RestClient::Response response{200, "body", {}};
+    on_complete(response);
+
+    REQUIRE(waiters.responses.size() == 1);
+    REQUIRE(waiters.responses[0].headers.find("ETag")->second == "\"v1\"");
+}
+
+TEST_CASE("A failing waiter does not stop the others", "[request_coalescer]")
+{
+    auto coalescer = make_coalescer();
+    string key = coalescer->make_key("GET", "/accounts", "", "", {});
+
+    Answers waiters;
+
+    REQUIRE_FALSE(coalescer->join(key, nullptr));
+    REQUIRE(coalescer->join(key, [](RestClient::Response&) { throw runtime_error("failed"); }));
+    REQUIRE(coalescer->join(key, waiters.add()));
+
+    coalescer->complete(key, RestClient::Response{200, "body", {}});
+    REQUIRE(waiters.responses.size() == 1);
+}
+
+TEST_CASE("Flight guard", "[request_coalescer]")
+{
+    auto coalescer = make_coalescer();
+    string key = coalescer->make_key("GET", "/accounts", "", "", {});
+
+    Answers waiters;
+
+    SECTION("the leader leaves without sending")
+    {
+        REQUIRE_FALSE(coalescer->join(key, nullptr));
+
+        {
+            Flight_guard guard(key);
+            REQUIRE(coalescer->join(key, waiters.add()));
+        }
+
+        REQUIRE(waiters.responses.size() == 1);
+        REQUIRE(waiters.responses[0].code == 502);
+        REQUIRE(waiters.responses[0].body == "Upstream call not sent");
+        REQUIRE_FALSE(coalescer->join(key, nullptr));
+        coalescer->complete(key, RestClient::Response{200, "", {}});
+    }
+
+    SECTION("the call was handed over")
+    {
+        REQUIRE_FALSE(coalescer->join(key, nullptr));
+
+        completion_fn on_complete;
+        {
+            Flight_guard guard(key);
+            REQUIRE(coalescer->join(key, waiters.add()));
+            on_complete = coalescer->lead(key, nullptr);
+            guard.release();
+        }
+
+        // still waiting for the call
+        REQUIRE(waiters.responses.empty());
+        REQUIRE(coalescer->has_waiters(key));
+
+        RestClient::Response response{200, "body", {}};
+        on_complete(response);
+        REQUIRE(waiters.responses.size() == 1);
+        REQUIRE(waiters.responses[0].code == 200);
+    }
+}
+
+TEST_CASE("Counters", "[request_coalescer]")
+{
+    auto coalescer = make_coalescer();
+
+    string text = coalescer->get_text();
+    REQUIRE(text.find("scall_upstream_coalesce_leaders_total ") != string::npos);
+    REQUIRE(text.find("scall_upstream_coalesced_total ") != string::npos);
+}
+
+// ===========================================================================
+
+void init_logger()
+{
+    std::string log_config_filename = "log.ini";
+    char* log_config_filename_ptr = getenv("LOG4CPLUS_CONFIG");
+
+    if (log_config_filename_ptr)
+    {
+        log_config_filename = log_config_filename_ptr;
+    }
+
+    log4cplus::PropertyConfigurator::doConfigure(log_config_filename.c_str());
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("main"));
+    LOG4CPLUS_INFO(logger, LOG4CPLUS_TEXT("Logging initialized from: " << log_config_filename));
+}
+
+int main(int argc, char* argv[])
+{
+    init_logger();
+
+    int result = Catch::Session().run(argc, argv);
+
+    return result;
+}
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <catch2/catch_session.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <map>
+#include <string>
+#include <log4cplus/configurator.h>
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/response_cache.h>
+
+#include "unit_base.h"
+
+using namespace std;
+using imp::upstream::Response_cache;
+
+typedef multimap<string, string> headers_t;
+
+static RestClient::Response make_response(int code, string const& body, headers_t const& headers)
+{
+    RestClient::Response response;
+    response.code = code;
+    response.body = body;
+    response.headers = headers;
+    return response;
+}
+
+static Response_cache* make_cache(size_t max_bytes = 1048576, size_t max_entry_bytes = 65536, uint shards = 4)
+{
+    auto cache = Response_cache::get_instance();
+    cache->set_config(true, max_bytes, max_entry_bytes, shards);
+    return cache;
+}
+
+TEST_CASE("Only GETs", "[response_cache]")
+{
+    auto cache = make_cache();
+
+    REQUIRE(cache->is_cacheable("GET"));
+    REQUIRE_FALSE(cache->is_cacheable("POST"));
+    REQUIRE_FALSE(cache->is_cacheable("HEAD"));
+}
+
+TEST_CASE("Cache-Control", "[response_cache]")
+{
+    auto cache = make_cache();
+
+    SECTION("max-age is served fresh")
+    {
+        cache->store("k", {}, make_response(200, "body", {{"Cache-Control", "public, max-age=60"}}));
+
+        auto found = cache->lookup("k", {});
+        REQUIRE(found.status == Response_cache::Status::fresh);
+        REQUIRE(found.entry->response.body == "body");
+    }
+
+    SECTION("no-store is not kept")
+    {
+        cache->store("k", {}, make_response(200, "body", {{"Cache-Control", "no-store, max-age=60"}}));
+
+        REQUIRE(cache->lookup("k", {}).status == Response_cache::Status::miss);
+    }
+
+    SECTION("no-cache is always revalidated")
+    {
+        cache->store("k", {}, make_response(200, "body", {{"Cache-Control", "no-cache, max-age=60"}, {"ETag", "\"v1\""}}));
+
+        auto found = cache->lookup("k", {});
+        REQUIRE(found.status == Response_cache::Status::stale);
+
+        auto conditional = cache->get_conditional_headers(*found.entry);
+        REQUIRE(conditional.find("If-None-Match")->second == "\"v1\"");
+    }
+
+    SECTION("s-maxage wins over max-age")
+    {
+        cache->store("k", {}, make_response(200, "body", {{"Cache-Control", "max-age=60, s-maxage=0"}}));
+
+        REQUIRE(cache->lookup("k", {}).status == Response_cache::Status::miss);
+    }
+
+    SECTION("an answer older than its lifetime is stale")
+    {
+        cache->store("k", {}, make_response(200, "body", {{"Cache-Control", "max-age=60"}, {"Age", "120"}, {"Last-Modified", "Mon, 01 Jan 2024 00:00:00 GMT"}}));
+
+        auto found = cache->lookup("k", {});
+        REQUIRE(found.status == Response_cache::Status::stale);
+        REQUIRE(cache->get_conditional_headers(*found.entry).count("If-Modified-Since") == 1);
+    }
+
+    SECTION("stale, without a validator, is dropped")
+    {
+        cache->store("k", {}, make_response(200, "body", {{"Cache-Control", "no-cache"}}));
+
+        REQUIRE(cache->lookup("k", {}).status == Response_cache::Status::miss);
+    }
+
+    SECTION("not cacheable status")
+    {
+        cache->store("k", {}, make_response(500, "body", {{"Cache-Control", "max-age=60"}}));
+
+        REQUIRE(cache->lookup("k", {}).status == Response_cache::Status::miss);
+    }
+
+    SECTION("a newer, not storable answer drops the entry")
+    {
+        cache->store("k", {}, make_response(200, "body", {{"Cache-Control", "max-age=60"}}));
+        cache->store("k", {}, make_response(200, "body", {{"Cache-Control", "no-store"}}));
+
+        REQUIRE(cache->lookup("k", {}).status == Response_cache::Status::miss);
+    }
+}
+
+TEST_CASE("Vary", "[response_cache]")
+{
+    auto cache = make_cache();
+
+    headers_t json = {{"accept", "application/json"}};
+    headers_t xml = {{"Accept", "application/xml"}};
+
+    cache->store("k", json, make_response(200, "{}", {{"Cache-Control", "max-age=60"}, {"Vary", "Accept"}}));
+
+    REQUIRE(cache->lookup("k", {{"Accept", "application/json"}}).status == Response_cache::Status::fresh);
+    REQUIRE(cache->lookup("k", xml).status == Response_cache::Status::miss);
+    REQUIRE(cache->lookup("k", {}).status == Response_cache::Status::miss);
+
+    cache->store("any", json, make_response(200, "{}", {{"Cache-Control", "max-age=60"}, {"Vary", "*"}}));
+    REQUIRE(cache->lookup("any", json).status == Response_cache::Status::miss);
+}
+
+TEST_CASE("Entries are kept per identity", "[response_cache]")
+{
+    auto cache = make_cache();
+
+    string alice = cache->make_key("/accounts", "id=1", "alice");
+    string bob = cache->make_key("/accounts", "id=1", "bob");
+    REQUIRE(alice != bob);
+
+    cache->store(alice, {}, make_response(200, "alice", {{"Cache-Control", "max-age=60"}}));
+
+    REQUIRE(cache->lookup(alice, {}).status == Response_cache::Status::fresh);
+    REQUIRE(cache->lookup(bob, {}).status == Response_cache::Status::miss);
+}
+
+TEST_CASE("304 merge", "[response_cache]")
+{
+    auto cache = make_cache();
+
+    cache->store("k", {}, make_response(200, "stored body", {{"Cache-Control", "no-cache"}, {"ETag", "\"v1\""}, {"X-Version", "1"}, {"Content-Type", "text/plain"}}));
+
+    auto found = cache->lookup("k", {});
+    REQUIRE(found.status == Response_cache::Status::stale);
+
+    auto not_modified = make_response(304, "", {{"Cache-Control", "max-age=60"}, {"ETag", "\"v1\""}, {"x-version", "2"}, {"Content-Length", "0"}});
+    auto response = cache->revalidate("k", {}, *found.entry, not_modified);
+
+    // the body is the stored one, the headers of the 304 replace the stored ones
+    REQUIRE(response.code == 200);
+    REQUIRE(response.body == "stored body");
+    REQUIRE(response.headers.count("X-Version") == 0);
+    REQUIRE(response.headers.find("x-version")->second == "2");
+    REQUIRE(response.headers.find("Content-Type")->second == "text/plain");
+    REQUIRE(response.headers.count("Content-Length") == 0);
+
+    // refreshed by the new Cache-Control
+    auto refreshed = cache->lookup("k", {});
+    REQUIRE(refreshed.status == Response_cache::Status::fresh);
+    REQUIRE(refreshed.entry->response.body == "stored body");
+}
+
+TEST_CASE("LRU eviction by bytes", "[response_cache]")
+{
+    // one shard, so the whole budget is in one LRU list
+    // each entry: 100 bytes of body, and "Cache-Control" "max-age=60" (23 bytes)
+    auto cache = make_cache(300, 200, 1);
+
+    string body(100, 'x');
+    headers_t headers = {{"Cache-Control", "max-age=60"}};
+
+    cache->store("a", {}, make_response(200, body, headers));
+    cache->store("b", {}, make_response(200, body, headers));
+    REQUIRE(cache->get_size() == 246);
+
+    // a is used, so b is the least recently used one
+    REQUIRE(cache->lookup("a", {}).status == Response_cache::Status::fresh);
+
+    cache->store("c", {}, make_response(200, body, headers));
+    REQUIRE(cache->get_size() == 246);
+
+    REQUIRE(cache->lookup("a", {}).status == Response_cache::Status::fresh);
+    REQUIRE(cache->lookup("b", {}).status == Response_cache::Status::miss);
+    REQUIRE(cache->lookup("c", {}).status == Response_cache::Status::fresh);
+
+    // above max_entry_bytes
+    cache->store("large", {}, make_response(200, string(300, 'x'), headers));
+    REQUIRE(cache->lookup("large", {}).status == Response_cache::Status::miss);
+    REQUIRE(cache->get_size() == 246);
+}
+
+// ===========================================================================
+
+void init_logger()
+{
+    std::string log_config_filename = "log.ini";
+    char* log_config_filename_ptr = getenv("LOG4CPLUS_CONFIG");
+
+    if (log_config_filename_ptr)
+    {
+        log_config_filename = log_config_filename_ptr;
+    }
+
+    log4cplus::PropertyConfigurator::doConfigure(log_config_filename.c_str());
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("main"));
+    LOG4CPLUS_INFO(logger, LOG4CPLUS_TEXT("Logging initialized from: " << log_config_filename));
+}
+
+int main(int argc, char* argv[])
+{
+    init_logger();
+
+    int result = Catch::Session().run(argc, argv);
+
+    return result;
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2024 Zoltan Patocs
+ *
+ * Licensed under the MIT License (the "License"). You may not use
+ * this file except in compliance with the License. You can obtain a copy
+ * in the file LICENSE in the source distribution or at
+ * https://opensource.org/license/mit/
+ */
+
+#include <catch2/catch_session.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <log4cplus/configurator.h>
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <imp/upstream/retry_policy.h>
+
+#include "unit_base.h"
+
+using namespace std;
+using namespace std::chrono_literals;
+using imp::upstream::Retry_policy;
+
+static RestClient::Response make_response(int code)
+{
+    RestClient::Response response;
+    response.code = code;
+    return response;
+}
+
+// takes all the whole tokens, less than one is left
+static void drain(Retry_policy* policy)
+{
+    for (int i = 0; i < 1000 && policy->try_retry(0); ++i)
+    {
+    }
+}
+
+TEST_CASE("Repeatable calls", "[retry_policy]")
+{
+    auto policy = Retry_policy::get_instance();
+    policy->set_config(true, 3, 50ms, 1000ms, 0.5, "Idempotency-Key");
+
+    REQUIRE(policy->is_repeatable("GET", false));
+    REQUIRE(policy->is_repeatable("HEAD", false));
+    REQUIRE(policy->is_repeatable("OPTIONS", false));
+    REQUIRE_FALSE(policy->is_repeatable("POST", false));
+    REQUIRE_FALSE(policy->is_repeatable("PATCH", false));
+    REQUIRE(policy->is_repeatable("POST", true));
+
+    REQUIRE(policy->is_retryable(make_response(7)));
+    REQUIRE(policy->is_retryable(make_response(502)));
+    REQUIRE(policy->is_retryable(make_response(503)));
+    REQUIRE_FALSE(policy->is_retryable(make_response(200)));
+    REQUIRE_FALSE(policy->is_retryable(make_response(500)));
+    REQUIRE_FALSE(policy->is_retryable(make_response(504)));
+
+    policy->set_config(false, 3, 50ms, 1000ms, 0.5, "Idempotency-Key");
+    REQUIRE_FALSE(policy->is_repeatable("GET", true));
+}
+
+TEST_CASE("Retry budget", "[retry_policy]")
+{
+    auto policy = Retry_policy::get_instance();
+    policy->set_config(true, 3, 50ms, 1000ms, 0.5, "Idempotency-Key");
+
+    drain(policy);
+    REQUIRE_FALSE(policy->try_retry(0));
+
+    // each first attempt deposits half a retry
+    policy->on_request();
+    policy->on_request();
+    REQUIRE(policy->try_retry(0));
+    REQUIRE_FALSE(policy->try_retry(0));
+
+    // the budget is capped, an idle period does not allow a retry storm later
+    for (int i = 0; i < 1000; ++i)
+    {
+        policy->on_request();
+    }
+
+    int retries = 0;
+    while (retries < 1000 && policy->try_retry(0))
+    {
+        ++retries;
+    }
+    REQUIRE(retries == 10);
+}
+
+TEST_CASE("Attempts are limited", "[retry_policy]")
+{
+    auto policy = Retry_policy::get_instance();
+    policy->set_config(true, 3, 50ms, 1000ms, 0.5, "Idempotency-Key");
+
+    for (int i = 0; i < 100; ++i)
+    {
+        policy->on_request();
+    }
+
+    REQUIRE(policy->try_retry(1));
+    REQUIRE(policy->try_retry(2));
+    REQUIRE_FALSE(policy->try_retry(3));
+}
+
+TEST_CASE("Backoff with full jitter", "[retry_policy]")
+{
+    auto policy = Retry_policy::get_instance();
+    policy->set_config(true, 10, 50ms, 300ms, 0.5, "Idempotency-Key");
+
+    for (int i = 0; i < 100; ++i)
+    {
+        REQUIRE(policy->get_backoff(1) <= 50ms);
+        REQUIRE(policy->get_backoff(2) <= 100ms);
+        REQUIRE(policy->get_backoff(3) <= 200ms);
+        REQUIRE(policy->get_backoff(8) <= 300ms);
+        REQUIRE(policy->get_backoff(8) >= 0ms);
+    }
+}
+
+// ===========================================================================
+
+void init_logger()
+{
+    std::string log_config_filename = "log.ini";
+    char* log_config_filename_ptr = getenv("LOG4CPLUS_CONFIG");
+
+    if (log_config_filename_ptr)
+    {
+        log_config_filename = log_config_filename_ptr;
+    }
+
+    log4cplus::PropertyConfigurator::doConfigure(log_config_filename.c_str());
+
+    log4cplus::Logger logger = log4cplus::Logger::getInstance(LOG4CPLUS_TEXT("main"));
+    LOG4CPLUS_INFO(logger, LOG4CPLUS_TEXT("Logging initialized from: " << log_config_filename));
+}
+
+int main(int argc, char* argv[])
+{
+    init_logger();
+
+    int result = Catch::Session().run(argc, argv);
+
+    return result;
+}